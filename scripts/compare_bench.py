@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+
+"""
+Compares two outputs of the kernel benchmarks (bin/bench, see src/bench.c), for example
+from the last release and from the current code, built with the same -D flags and run
+with the same config file on the same machine:
+
+    bin/bench config 20 > new.txt
+    scripts/compare_bench.py old.txt new.txt --tolerance 0.1
+
+Prints the ns/site of both runs for each kernel. Exits with status 1 if any kernel
+is slower than the baseline by more than the tolerance (relative), so that the script
+can be used in automated checks. Kernels that are missing from either file are reported
+but do not count as regressions. Timings fluctuate, so use enough passes
+and rerun before drawing conclusions from small differences.
+"""
+
+import sys
+import argparse
+
+## print to stderr
+def eprint(*args, **kwargs):
+    print(*args, file=sys.stderr, **kwargs)
+
+## Read a benchmark output and return a dict kernel -> ns/site. Lines starting with '#' are comments
+def ReadBench(fname):
+    res = {}
+    with open(fname) as f:
+        for line in f:
+            words = line.split()
+            if not words or words[0].startswith("#"):
+                continue
+            if len(words) < 2:
+                eprint("!!! Bad line in %s: %s" % (fname, line.strip()))
+                exit(2)
+            res[words[0]] = float(words[1])
+    return res
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare kernel benchmark results against a baseline")
+    parser.add_argument("baseline", help="output of bin/bench for the reference version")
+    parser.add_argument("current", help="output of bin/bench for the version to check")
+    parser.add_argument("--tolerance", type=float, default=0.1,
+                        help="allowed relative slowdown per kernel (default: %(default)s)")
+    args = parser.parse_args()
+
+    old = ReadBench(args.baseline)
+    new = ReadBench(args.current)
+
+    print("# %-18s %12s %12s %8s" % ("kernel", "baseline", "current", "ratio"))
+    slow = []
+    for name in old:
+        if name not in new:
+            print("%-20s %12.3f %12s" % (name, old[name], "missing"))
+            continue
+        ratio = new[name] / old[name]
+        flag = ""
+        if ratio > 1.0 + args.tolerance:
+            flag = "  SLOWER"
+            slow.append(name)
+        print("%-20s %12.3f %12.3f %8.3f%s" % (name, old[name], new[name], ratio, flag))
+
+    for name in new:
+        if name not in old:
+            print("%-20s %12s %12.3f" % (name, "missing", new[name]))
+
+    if slow:
+        eprint("!!! %d kernel(s) slower than baseline by more than %g%%: %s"
+               % (len(slow), 100*args.tolerance, " ".join(slow)))
+        exit(1)
+
+
+if __name__ == "__main__":
+    main()
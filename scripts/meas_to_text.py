@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+
+"""
+Converts a binary measurement file (written with 'binary_results 1' in the config)
+to plain text, one measurement per line, in the same column order as the 'labels' file.
+Binary layout (see init_results() in measure.c): the magic string "su2meas\\0",
+number of columns as a native int, the label text terminated by '\\0', followed by
+fixed-width records of doubles.
+
+Also converts local measurement files (measure_local_*, see write_local_field() in measure.c).
+These start with "su2local\\0" and the ints dim, L1, ..., Ldim, n, followed by n doubles
+for each site in natural ordering (x1 runs fastest). The text output has the site
+coordinates in the first dim columns and the observables from 'labels_local' after them.
+"""
+
+import sys
+import numpy as np
+import argparse
+
+MAGIC = b"su2meas\0"
+LOCAL_MAGIC = b"su2local\0"
+
+## print to stderr
+def eprint(*args, **kwargs):
+    print(*args, file=sys.stderr, **kwargs)
+
+## Read header of a local measurement file and return (L, number of observables, byte offset of data)
+def ReadLocalHeader(fname):
+    with open(fname, "rb") as f:
+        f.read(len(LOCAL_MAGIC))
+        dim = int(np.frombuffer(f.read(4), dtype=np.intc)[0])
+        ints = np.frombuffer(f.read(4*(dim+1)), dtype=np.intc)
+        return [int(x) for x in ints[:dim]], int(ints[dim]), f.tell()
+
+## Convert local measurements to text with explicit coordinates
+def ConvertLocal(args):
+    L, n, offset = ReadLocalHeader(args.infile)
+    data = np.fromfile(args.infile, dtype=np.float64, offset=offset)
+    vol = int(np.prod(L))
+    if data.size != vol*n:
+        eprint("!!! Expected %d values in %s, got %d" % (vol*n, args.infile, data.size))
+        exit(3)
+    data = data.reshape(vol, n)
+    ## coordinates in natural ordering, x1 fastest
+    coords = np.indices(L[::-1]).reshape(len(L), vol)[::-1].T
+    fmt = ["%d"]*len(L) + [args.fmt]*n
+    out = args.outfile if args.outfile else sys.stdout
+    np.savetxt(out, np.hstack((coords, data)), fmt=fmt)
+
+## Read the header and return (number of columns, label text, byte offset of first record)
+def ReadHeader(fname):
+    with open(fname, "rb") as f:
+        magic = f.read(len(MAGIC))
+        if magic != MAGIC:
+            eprint("!!! %s is not a binary measurement file" % fname)
+            exit(1)
+        columns = int(np.frombuffer(f.read(4), dtype=np.intc)[0])
+        labels = bytearray()
+        while True:
+            c = f.read(1)
+            if not c:
+                eprint("!!! Unexpected end of file in header of %s" % fname)
+                exit(2)
+            if c == b"\0":
+                break
+            labels += c
+        return columns, labels.decode(), f.tell()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert binary measurement file to text")
+    parser.add_argument("infile", help="binary measurement file")
+    parser.add_argument("outfile", nargs="?", help="output text file (default: stdout)")
+    parser.add_argument("--fmt", default="%.16g", help="number format (default: %(default)s)")
+    parser.add_argument("--labels", action="store_true", help="print the column labels and exit")
+    args = parser.parse_args()
+
+    with open(args.infile, "rb") as f:
+        if f.read(len(LOCAL_MAGIC)) == LOCAL_MAGIC:
+            ConvertLocal(args)
+            return
+
+    columns, labels, offset = ReadHeader(args.infile)
+    if args.labels:
+        print(labels, end="")
+        return
+
+    data = np.fromfile(args.infile, dtype=np.float64, offset=offset)
+    if data.size % columns != 0:
+        eprint("!!! Incomplete last record in %s, dropping it" % args.infile)
+        data = data[: data.size - data.size % columns]
+
+    data = data.reshape(-1, columns)
+    out = args.outfile if args.outfile else sys.stdout
+    np.savetxt(out, data, fmt=args.fmt)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,288 @@
+#!/usr/bin/env python3
+
+"""
+Regression tests, run with 'make test' from the repository root. For each build flavour
+in FLAVOURS, builds the simulation program and, with --timing, the kernel benchmarks
+(serial, see bench.c) and runs them in a scratch directory with tests/config, which has a fixed random seed:
+
+  1. Action and average plaquette of the test configuration of src/checks.c must agree
+     with tests/reference/<flavour>.txt to relative precision --tolerance. The run itself
+     stops with an error if the action is not gauge invariant or does not agree with
+     the local actions and other kernels used in the updates.
+  2. The last line of measurements after a short simulation, and of the gradient flow
+     measurements if any, must agree with the reference to relative precision
+     --meas-tolerance (the text file has 6 significant digits). The seed is fixed, so this
+     catches changes in the update algorithms that leave the action intact. The flavours
+     also differ in the update algorithms, see FLAVOURS.
+  3. Only with --timing: the best ns/site of --bench-runs runs of bin/bench is compared
+     against the timing baseline <build-dir>/<flavour>/bench_baseline.txt with
+     scripts/compare_bench.py, which fails if a kernel got slower than --timing-tolerance
+     allows. If there is no baseline yet, the timings are saved as the baseline instead.
+
+Timings depend on the machine, so the timing baselines are not part of the repository:
+make them by running with --timing on your machine before changing the code, and delete
+them to start over. Even on the same machine, short benchmarks fluctuate by tens of percent,
+hence the loose default tolerance. After a deliberate change of the physics, regenerate the references
+in tests/reference with
+
+    scripts/run_tests.py --update
+
+Exits with status 1 if any test fails.
+"""
+
+import os
+import re
+import sys
+import shutil
+import argparse
+import subprocess
+
+# Metropolis for all fields that have it, except SU(2) links
+METROPOLIS = {"algorithm_u1link": "metropolis", "algorithm_su2doublet": "metropolis",
+              "algorithm_su2triplet": "metropolis", "algorithm_singlet": "metropolis"}
+
+# name, PROGRAM_CFLAGS and changes to tests/config of the tested flavours.
+# With the update algorithms of version 72784ef, the references agree with what that version
+# gives with the same seed, except for the measurements of nhiggs2: there the cubic
+# equations of the overrelaxation are now solved more precisely, which changes the
+# Markov chain at the level of rounding.
+FLAVOURS = [
+    ("nhiggs0", "-DNHIGGS=0", {}),
+    ("nhiggs1", "-DNHIGGS=1", {}),
+    ("nhiggs2", "-DNHIGGS=2", {}),
+    ("u1", "-DNHIGGS=1 -DU1", {}),
+    ("triplet", "-DNHIGGS=1 -DTRIPLET", {}),
+    ("singlet", "-DNHIGGS=1 -DSINGLET", {}),
+    ("metropolis", "-DNHIGGS=1 -DSINGLET -DU1", METROPOLIS),
+    ("metropolis_triplet", "-DNHIGGS=1 -DTRIPLET", METROPOLIS),
+    ("metropolis_nhiggs2", "-DNHIGGS=2", METROPOLIS),
+    # checks_per_sweep does not divide the sites, so the overrelaxation batches end at the checks
+    ("muca", "-DNHIGGS=1 -DSINGLET", {"multicanonical": "1", "checks_per_sweep": "5"}),
+    ("muca_triplet", "-DNHIGGS=0 -DTRIPLET", {"multicanonical": "1", "checks_per_sweep": "5",
+                                              "orderparam": "Sigmasq", "min": "0.1", "max": "2.0"}),
+    ("flow", "-DNHIGGS=0 -DTRIPLET -DGRADFLOW", {"do_flow": "1", "flow_interval": "10", "flow_t_max": "1",
+                                                 "flow_meas_interval": "5", "flow_observables": "full"}),
+    # newer update algorithms, the references were made with the current code
+    ("multihit", "-DNHIGGS=1 -DSINGLET -DU1", dict(METROPOLIS, metro_hits="4")),
+    ("tuning", "-DNHIGGS=1 -DTRIPLET", dict(METROPOLIS, algorithm_su2link="metropolis", metro_target="0.5")),
+    ("overrelax_links", "-DNHIGGS=1 -DU1", {"algorithm_su2link": "overrelax", "algorithm_u1link": "overrelax",
+                                            "overrelax_links": "2"}),
+    ("u1_heatbath", "-DNHIGGS=1 -DU1", {"algorithm_u1link": "heatbath"}),
+    ("hmc", "-DNHIGGS=1 -DSINGLET -DU1 -DHMC", {"hmc_trajectories": "1", "hmc_steps": "20"}),
+    ("hmc_triplet", "-DNHIGGS=1 -DTRIPLET -DHMC", {"hmc_trajectories": "1", "hmc_steps": "20",
+                                                  "hmc_integrator": "0"}),
+    ("flow_rk3", "-DNHIGGS=1 -DSINGLET -DU1 -DGRADFLOW", {"do_flow": "1", "flow_interval": "10", "flow_t_max": "1",
+                                                         "flow_meas_interval": "1", "flow_integrator": "1",
+                                                         "flow_tolerance": "0.01", "flow_t2E_max": "0.001"}),
+]
+
+# measurements smaller than this are taken to be zero up to rounding
+MEAS_ZERO = 1e-10
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+TESTS = os.path.join(ROOT, "tests")
+
+## print to stderr
+def eprint(*args, **kwargs):
+    print(*args, file=sys.stderr, **kwargs)
+
+## Run a command, return its stdout. Returns None and prints the output if the command fails
+def Run(cmd, cwd):
+    res = subprocess.run(cmd, cwd=cwd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    if res.returncode != 0:
+        eprint(res.stdout)
+        eprint("!!! '%s' failed with status %d" % (" ".join(cmd), res.returncode))
+        return None
+    return res.stdout
+
+## Relative comparison of two lists of numbers, numbers below zero_tol in size count as zero
+def Agree(ref, new, tol, zero_tol=0.0):
+    if len(ref) != len(new):
+        return False
+    for a, b in zip(ref, new):
+        if abs(a - b) > tol * 0.5 * (abs(a) + abs(b)) + zero_tol + 1e-300:
+            return False
+    return True
+
+## Copy config file src to dst, replacing the values of the parameters in dict changes
+def WriteConfig(src, dst, changes):
+    done = set()
+    with open(src) as f, open(dst, "w") as out:
+        for line in f:
+            words = line.split()
+            if words and words[0] in changes:
+                line = "%s %s\n" % (words[0], changes[words[0]])
+                done.add(words[0])
+            out.write(line)
+    missing = set(changes) - done
+    if missing:
+        raise KeyError("parameters not found in %s: %s" % (src, " ".join(sorted(missing))))
+
+## Read a reference file of lines 'key value1 value2 ...' into a dict key -> list of floats
+def ReadReference(fname):
+    res = {}
+    with open(fname) as f:
+        for line in f:
+            words = line.split()
+            if not words or words[0].startswith("#"):
+                continue
+            res[words[0]] = [float(x) for x in words[1:]]
+    return res
+
+## Last line of measurements in the text results file
+def LastMeasurement(fname):
+    last = None
+    with open(fname) as f:
+        for line in f:
+            if line.strip() and not line.startswith("#"):
+                last = line
+    return [float(x) for x in last.split()]
+
+## Run bin/bench several times and return lines 'kernel ns/site' with the best time of each kernel
+def BestBench(bench, cwd, runs, passes):
+    best = {}
+    for r in range(runs):
+        out = Run([bench, "config", str(passes)], cwd)
+        if out is None:
+            return None
+        for line in out.splitlines():
+            words = line.split()
+            if len(words) < 2 or words[0].startswith("#"):
+                continue
+            try:
+                t = float(words[1])
+            except ValueError:
+                continue # other output of the program
+            if words[0] not in best or t < best[words[0]]:
+                best[words[0]] = t
+    return "".join("%s %.6g\n" % (k, t) for k, t in best.items())
+
+
+## Build and test one flavour, return list of failed tests
+def TestFlavour(name, flags, changes, args):
+    bdir = os.path.join(os.path.abspath(args.build_dir), name)
+    rundir = os.path.join(bdir, "run")
+    print("--- %s (%s)" % (name, flags))
+
+    if Run(["make", "-s", "SERIAL=1", "CC=" + args.cc, "PROGRAM_CFLAGS=" + flags, "BUILD_DIR=" + bdir + "/obj",
+            "BINARY_DIR=" + bdir, "BINARY=" + bdir + "/su2", "all"] + (["bench"] if args.timing else []), ROOT) is None:
+        return ["build"]
+
+    # fresh start, no lattice or weight files
+    shutil.rmtree(rundir, ignore_errors=True)
+    os.makedirs(rundir)
+    WriteConfig(os.path.join(TESTS, "config"), os.path.join(rundir, "config"), changes)
+
+    out = Run([os.path.join(bdir, "su2"), "config"], rundir)
+    if out is None:
+        return ["run"]
+    m = re.search(r"Test configuration: action (\S+), average plaquette (\S+)", out)
+    if m is None or "Action checks passed" not in out:
+        eprint("!!! Action checks were not run, is run_checks set in tests/config?")
+        return ["checks"]
+    new = {
+        "action": [float(m.group(1))],
+        "plaquette": [float(m.group(2))],
+        "measure": LastMeasurement(os.path.join(rundir, "measure")),
+    }
+    if os.path.exists(os.path.join(rundir, "measure_flow")):
+        new["flow"] = LastMeasurement(os.path.join(rundir, "measure_flow"))
+
+    bench = None
+    if args.timing:
+        bench = BestBench(os.path.join(bdir, "bench"), rundir, args.bench_runs, args.bench_passes)
+        if bench is None:
+            return ["bench"]
+
+    ref_file = os.path.join(TESTS, "reference", name + ".txt")
+    # machine dependent, so kept with the build
+    bench_file = os.path.join(bdir, "bench_baseline.txt")
+
+    if bench is not None and not os.path.exists(bench_file):
+        with open(bench_file, "w") as f:
+            f.write("# bin/bench baseline (ns/site) for PROGRAM_CFLAGS = %s, see scripts/run_tests.py\n" % flags)
+            f.write(bench)
+        print("Saved timing baseline %s" % bench_file)
+        bench = None
+
+    if args.update:
+        with open(ref_file, "w") as f:
+            f.write("# reference values for PROGRAM_CFLAGS = %s and tests/config, see scripts/run_tests.py\n" % flags)
+            if changes:
+                f.write("# with %s\n" % ", ".join("%s %s" % kv for kv in sorted(changes.items())))
+            for key in new:
+                f.write("%s %s\n" % (key, " ".join("%.12e" % x for x in new[key])))
+        print("Wrote reference values")
+        return []
+
+    failed = []
+    ref = ReadReference(ref_file)
+    checks = [("action", args.tolerance, 0.0), ("plaquette", args.tolerance, 0.0),
+              ("measure", args.meas_tolerance, MEAS_ZERO)]
+    if "flow" in new:
+        checks.append(("flow", args.meas_tolerance, MEAS_ZERO))
+    for key, tol, zero_tol in checks:
+        if key not in ref or not Agree(ref[key], new[key], tol, zero_tol):
+            eprint("!!! %s differs from reference:\n  reference %s\n  got       %s" % (key, ref.get(key), new[key]))
+            failed.append(key)
+        else:
+            print("%s agrees with reference" % key)
+
+    if bench is not None:
+        current = os.path.join(rundir, "bench.txt")
+        with open(current, "w") as f:
+            f.write(bench)
+        out = Run([sys.executable, os.path.join(ROOT, "scripts", "compare_bench.py"), bench_file, current,
+                   "--tolerance", str(args.timing_tolerance)], ROOT)
+        if out is None:
+            failed.append("timing")
+        else:
+            print(out, end="")
+
+    return failed
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build and run the regression tests for all flavours")
+    parser.add_argument("--build-dir", default=os.path.join(ROOT, "build", "test"),
+                        help="where to build and run the tests (default: %(default)s)")
+    # -fcommon because the headers define global variables, which GCC 10 and newer reject by default
+    parser.add_argument("--cc", default="gcc -O3 -fcommon",
+                        help="compiler and flags for the serial builds (default: %(default)s)")
+    parser.add_argument("--update", action="store_true",
+                        help="write new reference values instead of comparing against them")
+    parser.add_argument("--timing", action="store_true",
+                        help="compare bin/bench timings against the baseline in the build directory")
+    parser.add_argument("--tolerance", type=float, default=1e-9,
+                        help="relative precision of action and plaquette (default: %(default)s)")
+    parser.add_argument("--meas-tolerance", type=float, default=1e-4,
+                        help="relative precision of the measurements (default: %(default)s)")
+    parser.add_argument("--timing-tolerance", type=float, default=0.5,
+                        help="allowed relative slowdown per kernel (default: %(default)s)")
+    parser.add_argument("--bench-runs", type=int, default=5,
+                        help="runs of bin/bench, the best time of each kernel is used (default: %(default)s)")
+    parser.add_argument("--bench-passes", type=int, default=20,
+                        help="passes per run of bin/bench (default: %(default)s)")
+    parser.add_argument("flavours", nargs="*", help="flavours to test (default: all)")
+    args = parser.parse_args()
+
+    names = [name for name, flags, changes in FLAVOURS]
+    for name in args.flavours:
+        if name not in names:
+            eprint("!!! Unknown flavour %s, choose from: %s" % (name, " ".join(names)))
+            exit(2)
+
+    failed = []
+    for name, flags, changes in FLAVOURS:
+        if args.flavours and name not in args.flavours:
+            continue
+        failed += ["%s:%s" % (name, test) for test in TestFlavour(name, flags, changes, args)]
+
+    if failed:
+        eprint("!!! %d test(s) failed: %s" % (len(failed), " ".join(failed)))
+        exit(1)
+    print("All tests passed")
+
+
+if __name__ == "__main__":
+    main()
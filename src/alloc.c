@@ -292,6 +292,9 @@ void free_lattice(lattice *l) {
   free_comlist(&l->comlist);
 
   #ifdef BLOCKING
+    // persistent transfer buffers, see make_blocklists()
+    for (int k=0; k<l->blocklist.sends; k++) free(l->blocklist.send_to[k].buf);
+    for (int k=0; k<l->blocklist.recvs; k++) free(l->blocklist.recv_from[k].buf);
     free_comlist(&l->blocklist);
   #endif
 
@@ -0,0 +1,269 @@
+/** @file bench.c
+*
+* Micro-benchmarks for the most expensive kernels, built with 'make bench'
+* using the same PROGRAM_CFLAGS as the simulation program. Usage:
+*
+*   bin/bench <config file> [passes]
+*
+* Lattice size, MPI layout and action parameters are taken from the config file as in
+* a normal run, but lattice and weight files are not used. Instead the fields are set to
+* random values, so that the kernels see realistic (non-unit) data. Each benchmark applies
+* one kernel to every site (and direction) of my node; this is repeated 'passes' times
+* (default 10) after one untimed warmup pass. Kernels that update fields keep doing so,
+* so the configuration changes during the benchmark, but stays a valid one.
+*
+* Output is written to stdout by the root node, one line per kernel:
+*   kernel ns/site GB/s
+* where ns/site is the wall-clock time per pass (max over nodes) divided by the
+* number of sites on one node, and GB/s is the compulsory memory traffic of one pass:
+* the size of the field arrays that the kernel reads or writes, summed over nodes
+* and divided by the time. Reuse of neighbor data from cache is not counted, so this is
+* a lower bound for the actual traffic. Kernels not included in the build are not listed.
+*/
+
+#include "su2.h"
+#include "comms.h"
+
+#ifndef MPI
+	// No MPI, define global dummy
+	MPI_Comm MPI_COMM_WORLD = {};
+#endif
+
+#define BENCH_PASSES 10
+
+typedef struct {
+	lattice* l;
+	fields* f;
+	params* p;
+	weight* w;
+	results_buffer* results;
+} bench_data;
+
+typedef struct {
+	char* name;
+	void (*pass)(bench_data* b); // apply the kernel once to every site of my node
+	double bytes; // compulsory memory traffic per site, in bytes
+} bench_kernel;
+
+
+/* Size of all fields at one site, in bytes */
+static double field_bytes(lattice const* l) {
+	double res = l->dim * SU2LINK;
+	#ifdef U1
+		res += l->dim;
+	#endif
+	res += NHIGGS * SU2DB;
+	#ifdef TRIPLET
+		res += SU2TRIP;
+	#endif
+	#ifdef SINGLET
+		res += 1;
+	#endif
+	return res * sizeof(double);
+}
+
+
+/* ----- Kernels ----- */
+
+static void pass_su2trace4(bench_data* b) {
+	lattice* l = b->l;
+	fields* f = b->f;
+	for (long i=0; i<l->sites; i++) {
+		for (int d1=0; d1<l->dim; d1++) {
+			for (int d2=d1+1; d2<l->dim; d2++) {
+				su2trace4(f->su2link[i][d1], f->su2link[l->next[i][d1]][d2],
+							f->su2link[l->next[i][d2]][d1], f->su2link[i][d2]);
+			}
+		}
+	}
+}
+
+static void pass_su2staple_wilson(bench_data* b) {
+	lattice* l = b->l;
+	double V[SU2LINK];
+	for (long i=0; i<l->sites; i++) {
+		for (int dir=0; dir<l->dim; dir++) {
+			su2staple_wilson(l, b->f, i, dir, V);
+		}
+	}
+}
+
+static void pass_heatbath_su2link(bench_data* b) {
+	lattice* l = b->l;
+	for (long i=0; i<l->sites; i++) {
+		for (int dir=0; dir<l->dim; dir++) {
+			heatbath_su2link(l, b->f, b->p, i, dir);
+		}
+	}
+}
+
+#if (NHIGGS > 0)
+static void pass_metro_doublet(bench_data* b) {
+	for (long i=0; i<b->l->sites; i++) {
+		metro_doublet(b->l, b->f, b->p, i, 0);
+	}
+}
+
+static void pass_overrelax_doublet(bench_data* b) {
+	long max = b->l->sites;
+	for (long i=0; i<max; i+=OVERRELAX_BATCH) {
+		int n = (max - i < OVERRELAX_BATCH) ? max - i : OVERRELAX_BATCH;
+		#if (NHIGGS == 1)
+			overrelax_doublet(b->l, b->f, b->p, i, n);
+		#else
+			overrelax_higgs2(b->l, b->f, b->p, i, n, 0);
+		#endif
+	}
+}
+#endif
+
+#ifdef TRIPLET
+static void pass_overrelax_triplet(bench_data* b) {
+	long max = b->l->sites;
+	for (long i=0; i<max; i+=OVERRELAX_BATCH) {
+		int n = (max - i < OVERRELAX_BATCH) ? max - i : OVERRELAX_BATCH;
+		overrelax_triplet(b->l, b->f, b->p, i, n);
+	}
+}
+
+static void pass_magcharge_cube(bench_data* b) {
+	for (long i=0; i<b->l->sites; i++) {
+		magcharge_cube(b->l, b->f, b->p, i);
+	}
+}
+#endif
+
+#if (NHIGGS > 0) || defined(TRIPLET)
+static void pass_calc_orderparam(bench_data* b) {
+	calc_orderparam(b->l, b->f, b->p, b->w, EVEN);
+	calc_orderparam(b->l, b->f, b->p, b->w, ODD);
+}
+#endif
+
+#ifdef MPI
+// all halo exchanges, including packing and unpacking of the send/receive buffers
+static void pass_sync_halos(bench_data* b) {
+	sync_halos(b->l, b->f);
+}
+#endif
+
+static void pass_measure(bench_data* b) {
+	measure(b->results, b->l, b->f, b->p, b->w);
+}
+
+
+/* Run one benchmark and print the result from the root node */
+static void run_kernel(bench_data* b, bench_kernel const* k, int passes) {
+
+	lattice* l = b->l;
+	k->pass(b); // warmup
+
+	barrier(l->comm);
+	double start = wall_time();
+	for (int n=0; n<passes; n++) {
+		k->pass(b);
+	}
+	double time = allreduce_max(wall_time() - start, l->comm);
+
+	double ns_per_site = 1e9 * time / ((double) passes * l->sites);
+	double gbs = k->bytes * l->vol * passes / time / 1e9;
+	printf0("%-20s %12.3f %10.3f\n", k->name, ns_per_site, gbs);
+}
+
+
+int main(int argc, char *argv[]) {
+
+	lattice l;
+	params p;
+	fields f;
+	weight w;
+	results_buffer results;
+
+	#ifdef MPI
+		MPI_Init(&argc, &argv);
+		MPI_Comm_rank(MPI_COMM_WORLD, &l.rank);
+		MPI_Comm_size(MPI_COMM_WORLD, &l.size);
+		l.comm = MPI_COMM_WORLD;
+	#else
+		l.rank = 0;
+		l.size = 1;
+	#endif
+	myRank = l.rank;
+	MPISize = l.size;
+
+	if (argc < 2 || argc > 3) {
+		printf0("Usage: ./<program name> <config file> [passes]\n");
+		die(0);
+	}
+	int passes = (argc == 3) ? atoi(argv[2]) : BENCH_PASSES;
+	if (passes < 1) passes = 1;
+
+	// same seed on all runs, but different on each node
+	seed_mersenne(5489 + 1121*l.rank);
+
+	get_parameters(argv[1], &l, &p);
+	get_weight_parameters(argv[1], &p, &w);
+	// measurements go nowhere
+	p.resultsfile = fopen("/dev/null", "w");
+	init_results(&results, p.resultsfile, 0, 0);
+
+	int do_prints = 0;
+	layout(&l, do_prints, 0);
+	alloc_fields(&l, &f);
+	set_random_fields(&f, &l);
+
+	// calc_orderparam() needs an order parameter even without multicanonical
+	if (!p.multicanonical) {
+		#if (NHIGGS > 0)
+			w.orderparam = PHISQ;
+		#elif defined(TRIPLET)
+			w.orderparam = SIGMASQ;
+		#endif
+	}
+	w.param_value[EVEN] = w.param_value[ODD] = 0.0;
+
+	bench_data b = { &l, &f, &p, &w, &results };
+
+	int dim = l.dim;
+	double link = SU2LINK * sizeof(double); // one SU(2) link
+	bench_kernel kernels[] = {
+		{ "su2trace4", pass_su2trace4, dim * link },
+		{ "su2staple_wilson", pass_su2staple_wilson, dim * link },
+		{ "heatbath_su2link", pass_heatbath_su2link, 2 * dim * link },
+		#if (NHIGGS > 0)
+			{ "metro_doublet", pass_metro_doublet, 2 * SU2DB * sizeof(double) + dim * link },
+			{ "overrelax_doublet", pass_overrelax_doublet, 2 * SU2DB * sizeof(double) + dim * link },
+		#endif
+		#ifdef TRIPLET
+			{ "overrelax_triplet", pass_overrelax_triplet, 2 * SU2TRIP * sizeof(double) + dim * link },
+			{ "magcharge_cube", pass_magcharge_cube, SU2TRIP * sizeof(double) + dim * link },
+		#endif
+		#if (NHIGGS > 0) || defined(TRIPLET)
+			{ "calc_orderparam", pass_calc_orderparam, ((NHIGGS > 0) ? SU2DB : SU2TRIP) * sizeof(double) },
+		#endif
+		#ifdef MPI
+			// halo data per site of my node, sent and received
+			{ "sync_halos", pass_sync_halos, 2 * field_bytes(&l) * l.halos / l.sites },
+		#endif
+		{ "measure", pass_measure, field_bytes(&l) }
+	};
+	int n_kernels = sizeof(kernels) / sizeof(kernels[0]);
+
+	printf0("# Kernel benchmarks: L =");
+	for (int dir=0; dir<l.dim; dir++) printf0(" %d", l.L[dir]);
+	printf0(", %d nodes, %ld sites per node, %d passes\n", l.size, l.sites, passes);
+	printf0("# %-18s %12s %10s\n", "kernel", "ns/site", "GB/s");
+
+	for (int k=0; k<n_kernels; k++) {
+		run_kernel(&b, &kernels[k], passes);
+	}
+
+	free_fields(&l, &f);
+	free_lattice(&l);
+	if (p.resultsfile != NULL) fclose(p.resultsfile);
+
+	#ifdef MPI
+		MPI_Finalize();
+	#endif
+	return 0;
+}
@@ -12,6 +12,102 @@
 #include "su2.h"
 #include "comms.h"
 
+/* Number of doubles per site in the messages sent by make_blocked_fields() */
+static int block_site_dofs(lattice const* l) {
+  int dofs = l->dim * SU2LINK;
+  #ifdef U1
+    dofs += l->dim;
+  #endif
+  #if (NHIGGS > 0)
+    dofs += NHIGGS * SU2DB;
+  #endif
+  #ifdef TRIPLET
+    dofs += SU2TRIP;
+  #endif
+  #ifdef SINGLET
+    dofs += 1;
+  #endif
+  return dofs;
+}
+
+/* Write fields at site i into buf, smeared in the blocked directions if smear = 1 */
+static void pack_blocked_site(lattice const* l, fields const* f, int const* block_dir, int smear, long i, double* buf) {
+
+  int k = 0;
+  // gauge links. links pointing in non-blocked directions remain unchanged
+  for (int dir=0; dir<l->dim; dir++) {
+    if (smear && block_dir[dir]) {
+      smear_link(l, f, block_dir, &buf[k], i, dir);
+    } else {
+      memcpy(&buf[k], f->su2link[i][dir], SU2LINK * sizeof(*buf));
+    }
+    k += SU2LINK;
+  }
+  #ifdef U1
+    for (int dir=0; dir<l->dim; dir++) {
+      // no U(1) smearing; use the product of the two links that make up the blocked link
+      buf[k] = f->u1link[i][dir];
+      if (smear && block_dir[dir]) {
+        buf[k] += f->u1link[ l->next[i][dir] ][dir];
+      }
+      k++;
+    }
+  #endif
+  // scalars
+  #if (NHIGGS > 0)
+    for (int db=0; db<NHIGGS; db++) {
+      if (smear) {
+        smear_doublet(l, f, block_dir, &buf[k], i, db);
+      } else {
+        memcpy(&buf[k], f->su2doublet[db][i], SU2DB * sizeof(*buf));
+      }
+      k += SU2DB;
+    }
+  #endif
+  #ifdef TRIPLET
+    if (smear) {
+      smear_triplet(l, f, block_dir, &buf[k], i);
+    } else {
+      memcpy(&buf[k], f->su2triplet[i], SU2TRIP * sizeof(*buf));
+    }
+    k += SU2TRIP;
+  #endif
+  #ifdef SINGLET
+    buf[k] = smear ? smear_singlet(l, f, block_dir, i) : f->singlet[i][0];
+    k++;
+  #endif
+}
+
+/* Copy fields from buf to site i on the blocked lattice. Inverse of pack_blocked_site() */
+static void unpack_blocked_site(lattice const* b, fields* f_b, long i, double const* buf) {
+
+  int k = 0;
+  for (int dir=0; dir<b->dim; dir++) {
+    memcpy(f_b->su2link[i][dir], &buf[k], SU2LINK * sizeof(*buf));
+    k += SU2LINK;
+  }
+  #ifdef U1
+    for (int dir=0; dir<b->dim; dir++) {
+      f_b->u1link[i][dir] = buf[k];
+      k++;
+    }
+  #endif
+  #if (NHIGGS > 0)
+    for (int db=0; db<NHIGGS; db++) {
+      memcpy(f_b->su2doublet[db][i], &buf[k], SU2DB * sizeof(*buf));
+      k += SU2DB;
+    }
+  #endif
+  #ifdef TRIPLET
+    memcpy(f_b->su2triplet[i], &buf[k], SU2TRIP * sizeof(*buf));
+    k += SU2TRIP;
+  #endif
+  #ifdef SINGLET
+    f_b->singlet[i][0] = buf[k];
+    k++;
+  #endif
+}
+
 /* Calculate how many blocking levels we can create for a given lattice
 * Does not accept blocking that shrinks a dimension down to a point!
 * The current routines also do not behave well in situations where
@@ -73,53 +169,46 @@ void block_lattice(lattice* l, lattice* b, int const* block_dir) {
   }
 
 
-  /* need to figure out how to layout the blocked lattice
-  * on MPI nodes. Because the new lattice has less sites than the original,
-  * we may have to use LESS MPI nodes to get an even slicing. The 'extra' nodes
-  * will have to standby until the original lattice is used again */
-  while (b->vol % b->size != 0) {
-    b->size--;
+  /* need to figure out how to layout the blocked lattice on MPI nodes.
+  * If the blocked lattice can be split evenly, it uses ALL nodes of the original lattice.
+  * If not, every node holds a full copy of it (this happens only for small lattices).
+  * Further blocking of a replicated lattice then requires no communications at all. */
+  b->replicated = l->replicated;
+  if (!b->replicated && b->vol % b->size != 0) {
+    b->replicated = 1;
   }
-
-  if (b->rank < b->size) {
-    b->standby = 0;
-  } else {
-    b->standby = 1;
+  if (b->replicated) {
+    b->rank = 0;
+    b->size = 1;
   }
 
-  if (!l->rank) {
+  if (!myRank) {
     printf("Initializing blocked lattice of volume: ");
     for (int dir=0; dir<b->dim; dir++) {
       if (dir>0) printf(" x ");
       printf("%d", b->L[dir]);
     }
-    printf(" (MPI size = %d)\n", b->size);
+    if (b->replicated) {
+      printf(" (replicated on all nodes)\n");
+    } else {
+      printf(" (MPI size = %d)\n", b->size);
+    }
   }
 
   #ifdef MPI
     // create a new communicator for the blocked lattice
-    int color = 1;
-    if (b->standby) {
-      // do not include the 'extra' nodes in the new communicator
-      color = MPI_UNDEFINED;
+    if (b->replicated) {
+      MPI_Comm_dup(MPI_COMM_SELF, &b->comm);
+    } else {
+      MPI_Comm_dup(l->comm, &b->comm);
     }
-
-    // same ranks as in the original comm
-    MPI_Comm_split(l->comm, color, l->rank, &b->comm);
-
   #else
     // just give some value to l->comm
   #endif
 
   int do_prints = 0;
   int run_checks = 1;
-  if (!b->standby) {
-    layout(b, do_prints, run_checks);
-  } else {
-    // make dummy lattice that doesn't communicate with anyone.
-    standby_layout(b);
-  }
-
+  layout(b, do_prints, run_checks);
 
   /* Now we need a mapping that tells us how to relate fields on the original lattice
   * to those on the blocked lattice. This is stored in the "blocklist", which
@@ -127,8 +216,6 @@ void block_lattice(lattice* l, lattice* b, int const* block_dir) {
   * blocked lattice what they need to receive */
 
   make_blocklists(l, b, block_dir);
-  /* all nodes need to call this, because "standby" nodes still need to
-  * send their fields to non-standby nodes*/
 
   // finally, test
   test_blocking(l, b, block_dir);
@@ -146,6 +233,11 @@ void block_lattice(lattice* l, lattice* b, int const* block_dir) {
 * Specifically, this routine creates and fills in send_to structure
 * in 'l', and recv_from structure in 'b', and does not touch the other
 * sendrecv struct. Otherwise this is quite similar to the routine in comms.c.
+* Node indices in both lists refer to ranks in l->comm. If b is replicated,
+* every node receives the full blocked lattice from everyone.
+*
+* Also allocates the transfer buffers used by make_blocked_fields(). These are kept
+* in the sendrecv structs for the lifetime of the lattices and freed in free_lattice().
 *
 * Assumes that all blocked nodes have the same
 * number of sites and that halos come after real sites!
@@ -159,18 +251,9 @@ void make_blocklists(lattice* l, lattice* b, int const* block_dir) {
 
   #ifdef MPI
 
-    /* broadcast the number of sites in the blocked nodes.
-    * this is necessary because the nodes on standby really have 0 sites,
-    * but routines below are easier if we treat everyone more or less equally */
-
-    bcast_long(&block_sites, l->comm); // root node always operates on the new lattice
-
-    if (block_sites != b->sites && !b->standby) {
-      printf("Error in blocklist.c!! nodes have different number of sites \n");
-    }
-
-    /* For nodes NOT on standby on the blocked lattice,
-    * send the coordinate tables to all nodes that work on the original lattice */
+    /* If the blocked lattice is distributed, send the coordinate tables
+    * to all nodes that work on the original lattice. Replicated lattices
+    * have the same layout everywhere, so no need to send anything */
     long** coord_buf[l->size];
     MPI_Request coord_req[l->size];
     int coord_tag = 0;
@@ -192,8 +275,7 @@ void make_blocklists(lattice* l, lattice* b, int const* block_dir) {
       sites_req[r] = MPI_REQUEST_NULL;
     }
 
-    // if not on standby, send the coordinate table to everyone
-    if (!b->standby) {
+    if (!b->replicated) {
       for (int r=0; r<l->size; r++) {
 
         if (r == l->rank) {
@@ -211,7 +293,6 @@ void make_blocklists(lattice* l, lattice* b, int const* block_dir) {
         int size = b->dim * block_sites;
         // send to everyone in l->comm
         MPI_Isend(&coord_buf[r][0][0], size, MPI_LONG, r, coord_tag, l->comm, &coord_req[r]);
-        //printf("node %d: sent blocked coordinates to %d\n", l->rank, r);
       }
     }
 
@@ -220,18 +301,16 @@ void make_blocklists(lattice* l, lattice* b, int const* block_dir) {
   long tot = 0; // keep track of how many sites have been mapped
 
   /* For each node on the new lattice, collect their coordinate tables */
-
-  // needs to be block_sites instead of b->sites, the latter is 1 for standby nodes
   long** blocked_coords = alloc_latticetable(b->dim, block_sites);
 
-  // loop over MPI ranks on the blocked lattice
-  for (int r=0; r<b->size; r++) {
+  // loop over MPI ranks in l->comm. all of them have a part (or a copy) of the blocked lattice
+  for (int r=0; r<l->size; r++) {
 
     long sends = 0;
     long recvlist[l->sites];
 
-    if (r == b->rank) {
-      // own node and not on standby, just copy the coords table
+    if (r == l->rank || b->replicated) {
+      // own node or replicated lattice, just copy the coords table
       for (long j=0; j<block_sites; j++) {
         for (int dir=0; dir<b->dim; dir++) {
           blocked_coords[j][dir] = b->coords[j][dir];
@@ -293,10 +372,8 @@ void make_blocklists(lattice* l, lattice* b, int const* block_dir) {
             /* add to send blocklist in my node, store their site index */
             addto_comlist(&l->blocklist, r, i, SEND, l->parity[i], l->sites);
             recvlist[sends] = j;
-            #ifdef MPI
-              sites_buf[r][sends] = j;
-            #endif
             sends++;
+            break;
           }
 
         } // end j
@@ -329,7 +406,6 @@ void make_blocklists(lattice* l, lattice* b, int const* block_dir) {
             die(4221);
           }
           MPI_Isend(&sites_buf[r][0], sends, MPI_LONG, r, sites_tag, l->comm, &sites_req[r]);
-          //printf("Node %d: sent blocked sites to %d\n", l->rank, r);
         #else
           printf("Should not get here!! in blocking.c\n");
         #endif
@@ -338,32 +414,29 @@ void make_blocklists(lattice* l, lattice* b, int const* block_dir) {
 
   } // end rank loop
 
-  // send lists done, now fill in the receives for nodes using the blocked lattice
+  // send lists done, now fill in the receives for my part of the blocked lattice
   #ifdef MPI
 
-  if (!b->standby) {
+  while (sites_received < b->sites) {
 
-    while (sites_received < b->sites) {
+    // receive the site list from ANY node
+    MPI_Status status;
+    int count;
+    MPI_Probe(MPI_ANY_SOURCE, sites_tag, l->comm, &status);
+    MPI_Get_count(&status, MPI_LONG, &count);
 
-      // receive the site list from ANY node
-      MPI_Status status;
-      int count;
-      MPI_Probe(MPI_ANY_SOURCE, sites_tag, l->comm, &status);
-      MPI_Get_count(&status, MPI_LONG, &count);
+    long sitelist[count];
+    MPI_Recv(&sitelist[0], count, MPI_LONG, status.MPI_SOURCE, sites_tag, l->comm, MPI_STATUS_IGNORE);
 
-      long sitelist[count];
-      MPI_Recv(&sitelist[0], count, MPI_LONG, status.MPI_SOURCE, sites_tag, l->comm, MPI_STATUS_IGNORE);
-
-      for (int j=0; j<count; j++) {
-        addto_comlist(&b->blocklist, status.MPI_SOURCE, sitelist[j], RECV, b->parity[j], block_sites);
-      }
-      sites_received += count;
+    for (int j=0; j<count; j++) {
+      addto_comlist(&b->blocklist, status.MPI_SOURCE, sitelist[j], RECV, b->parity[sitelist[j]], block_sites);
+    }
+    sites_received += count;
 
-    } // end r
   }
   #endif
 
-  if (sites_received != b->sites && !b->standby) {
+  if (sites_received != b->sites) {
     printf("WARNING from node %d: did not map all blocked sites (in blocking.c)\n", l->rank);
   }
 
@@ -383,7 +456,8 @@ void make_blocklists(lattice* l, lattice* b, int const* block_dir) {
 
   // check that we didn't miss any sites on the blocked lattice
   tot = reduce_sum_long(tot, l->comm);
-  if (l->rank == 0 && tot != b->vol) {
+  long vol = b->replicated ? b->vol * l->size : b->vol;
+  if (l->rank == 0 && tot != vol) {
     printf("blocking.c: site mapping failed!! \n");
     die(-1921);
   }
@@ -392,271 +466,116 @@ void make_blocklists(lattice* l, lattice* b, int const* block_dir) {
   realloc_comlist(&l->blocklist, SEND);
   realloc_comlist(&b->blocklist, RECV);
 
-}
-
-/* Make a dummy lattice struct for nodes on standby. This allocs everything that
-* normal layout() does, so the lattice can be freed using free_lattice(),
-* but the resulting lattice is essentially empty. */
-void standby_layout(lattice* l) {
-
-  if (!l->standby) {
-    return;
-  }
-
-  l->sliceL = malloc(l->dim * sizeof(*(l->sliceL)));
-  l->nslices = malloc(l->dim * sizeof(*(l->nslices)));
-  l->offset = malloc(l->dim * sizeof(*(l->offset)));
-
-  l->sites = 1;
-	l->halos = 0;
-	l->sites_total = 1;
-  l->evensites = 1; l->oddsites = 0;
-  l->evenhalos = 1; l->oddhalos = 0;
-
-  alloc_lattice_arrays(l, l->sites_total);
-  l->parity[0] = EVEN;
-  for (int dir=0; dir<l->dim; dir++) {
-    l->coords[0][dir] = -1;
-    l->sliceL[dir] = 1;
-    l->nslices[dir] = 1;
-    l->offset[dir] = 0;
+  /* Transfer buffers. Sites sent to own node go directly to the blocked fields,
+  * so no buffers are needed for those */
+  int dofs = block_site_dofs(l);
+  for (int k=0; k<l->blocklist.sends; k++) {
+    sendrecv_struct* send = &l->blocklist.send_to[k];
+    send->buf = NULL;
+    if (send->node != l->rank) {
+      send->buf = malloc(send->sites * dofs * sizeof(*send->buf));
+    }
   }
-
-  l->longest_dir = 0;
-  l->sites_per_coord = malloc(l->dim * sizeof(*l->sites_per_coord));
-  l->sites_at_coord = malloc(l->dim * sizeof(*l->sites_at_coord));
-  // need to dummy alloc for all directions, otherwise free_latticetable() breaks
-  for (int dir=0; dir<l->dim; dir++) {
-    l->sites_per_coord[dir] = 1;
-    l->sites_at_coord[dir] = alloc_latticetable(l->sites_per_coord[dir], l->sliceL[dir]);
+  for (int k=0; k<b->blocklist.recvs; k++) {
+    sendrecv_struct* recv = &b->blocklist.recv_from[k];
+    recv->buf = NULL;
+    if (recv->node != l->rank) {
+      recv->buf = malloc(recv->sites * dofs * sizeof(*recv->buf));
+    }
   }
-  
-  #ifdef MEASURE_Z
-    l->sites_per_z = 1;
-    l->z_dir = 0;
-    l->site_at_z = alloc_latticetable(l->sites_per_z, l->sliceL[0]);
-  #endif
 
-  // no need to alloc dummy comlists
-  l->comlist.sends = 0; l->comlist.recvs = 0;
 }
 
-
-/* Copy a smeared field on the original lattice 'l' to a blocked field
-* on blocked lattice 'b'. Only does communications between distinct nodes,
-* for transfering blocked fields between the same node use block_fields_ownnode().
+/* Move fields on the original lattice 'l' to the blocked lattice 'b'.
+* If smear = 1, fields are smeared in the blocked directions on the fly, so that
+* only the sites that actually end up on the blocked lattice are smeared
+* and no temporary fields on the original lattice are needed.
+* If smear = 0, fields are just copied (used in test_blocking()).
+* Each node sends one message to each blocked node, containing all fields.
+* Halos on the blocked lattice are synced afterwards.
 */
-void transfer_blocked_field(lattice* l, lattice* b, double** field, double** field_b, int dofs) {
-
-  #ifdef MPI
-
-    int sends = l->blocklist.sends;
-    if (sends <= 0) {
-      return;
-    }
-
-    double start, end;
-	  start = clock();
-
-    // first nonblocking sends to everyone
-    MPI_Request req[sends];
-    for (int k=0; k<sends; k++) {
-      req[k] = MPI_REQUEST_NULL;
-
-      sendrecv_struct* send = &l->blocklist.send_to[k];
-      int rank = send->node;
-      if (rank == l->rank) {
-       // don't send to self. these are all done by block_fields_ownnode(),
-       // which is assumed to be called separately.
-       continue;
-      }
+void make_blocked_fields(lattice* l, lattice* b, fields const* f, fields* f_blocked, int const* block_dir, int smear) {
 
-      // allocates send buffer and does nonblocking send:
-      send_field(send, l->comm, &req[k], EVENODD, field, dofs);
-    }
+  int dofs = block_site_dofs(l);
 
-    // sends done, then blocking receives in the blocked nodes
-    if (!b->standby) {
-      int recvs = b->blocklist.recvs;
-      for (int m=0; m<recvs; m++) {
-        sendrecv_struct* recv = &b->blocklist.recv_from[m];
-        if (recv->node == b->rank) {
-          continue; // don't receive from self, call block_fields_ownnode() elsewhere
-        }
-        recv_field(recv, l->comm, EVENODD, field_b, dofs);
+  #ifdef MPI
+    int tag = 0;
+
+    // post receives for my part of the blocked lattice
+    int recvs = b->blocklist.recvs;
+    MPI_Request recv_req[recvs > 0 ? recvs : 1];
+    for (int m=0; m<recvs; m++) {
+      recv_req[m] = MPI_REQUEST_NULL;
+      sendrecv_struct* recv = &b->blocklist.recv_from[m];
+      if (recv->node == l->rank) {
+        continue; // sites from own node are handled below
       }
+      MPI_Irecv(recv->buf, recv->sites * dofs, MPI_DOUBLE, recv->node, tag, l->comm, &recv_req[m]);
     }
 
-    // recvs done, now wait and free send buffers
-    for (int k=0; k<sends; k++) {
-      sendrecv_struct* send = &l->blocklist.send_to[k];
-      if (send->node == l->rank) continue; // buffer for own node never allocated
-
-      MPI_Wait(&req[k], MPI_STATUS_IGNORE);
-      free(send->buf);
-    }
-
-    end = clock();
-    Global_comms_time += (double)(end - start) / CLOCKS_PER_SEC;
-
-    #endif
-    // do nothing in serial. Use block_fields_ownnode() instead.
-}
-
-
-/* Same as transfer_blocked_field(), but for a gauge field of type double***. */
-void transfer_blocked_gaugefield(lattice* l, lattice* b, double*** field, double*** field_b, int dofs, int dir) {
-
-  #ifdef MPI
-
+    // smear into the send buffers and send, one node at a time
     int sends = l->blocklist.sends;
-    if (sends <= 0) {
-      return;
-    }
-
-    double start, end;
-	  start = clock();
-
-    // first nonblocking sends to everyone
-    MPI_Request req[sends];
+    MPI_Request send_req[sends > 0 ? sends : 1];
     for (int k=0; k<sends; k++) {
-      req[k] = MPI_REQUEST_NULL;
-
+      send_req[k] = MPI_REQUEST_NULL;
       sendrecv_struct* send = &l->blocklist.send_to[k];
-      int rank = send->node;
-      if (rank == l->rank) {
-       // don't send to self. these are all done by block_fields_ownnode(),
-       // which is assumed to be called separately.
-       continue;
+      if (send->node == l->rank) {
+        continue;
       }
-
-      // allocates send buffer and does nonblocking send:
-      send_gaugefield(send, l->comm, &req[k], EVENODD, field, dofs, dir);
-    }
-
-    // sends done, then blocking receives in the blocked nodes
-    if (!b->standby) {
-      int recvs = b->blocklist.recvs;
-      for (int m=0; m<recvs; m++) {
-        sendrecv_struct* recv = &b->blocklist.recv_from[m];
-        if (recv->node == b->rank) {
-          continue; // don't receive from self, call block_fields_ownnode() elsewhere
-        }
-
-        recv_gaugefield(recv, l->comm, EVENODD, field_b, dofs, dir);
+      for (long i=0; i<send->sites; i++) {
+        pack_blocked_site(l, f, block_dir, smear, send->sitelist[i], &send->buf[i * dofs]);
       }
+      MPI_Isend(send->buf, send->sites * dofs, MPI_DOUBLE, send->node, tag, l->comm, &send_req[k]);
     }
+  #endif
 
-    // recvs done, now wait and free send buffers
-    for (int k=0; k<sends; k++) {
-      sendrecv_struct* send = &l->blocklist.send_to[k];
-      if (send->node == l->rank) continue;
-
-      MPI_Wait(&req[k], MPI_STATUS_IGNORE);
-      free(send->buf);
-    }
-
-    end = clock();
-    Global_comms_time += (double)(end - start) / CLOCKS_PER_SEC;
-
-    #endif
-    // do nothing in serial. Use block_fields_ownnode() instead.
-}
-
-/* Transfer smeared fields on the full lattice (f_smeared) to
-* fields on the blocked lattice with less sites (f_blocked).
-*/
-void make_blocked_fields(lattice* l, lattice* b, fields const* f_smeared, fields* f_blocked) {
-
-  // first do all "sends" within my own node
-  block_fields_ownnode(l, b, f_smeared, f_blocked);
-
-  #ifdef MPI
-    // then contributions from other nodes
-
-    for (int dir=0; dir<l->dim; dir++) {
-      transfer_blocked_gaugefield(l, b, f_smeared->su2link, f_blocked->su2link, SU2LINK, dir);
-    }
-    #ifdef U1
-      transfer_blocked_field(l, b, f_smeared->u1link, f_blocked->u1link, l->dim);
-    #endif
-
-    #if (NHIGGS > 0)
-      for (int db=0; db<NHIGGS; db++)
-        transfer_blocked_field(l, b, f_smeared->su2doublet[db], f_blocked->su2doublet[db], SU2DB);
-    #endif
-    #ifdef TRIPLET
-      transfer_blocked_field(l, b, f_smeared->su2triplet, f_blocked->su2triplet, SU2TRIP);
-    #endif
-
-  #endif // end MPI
-
-  // done, now just sync halos on the blocked lattice
-  sync_halos(b, f_blocked);
-}
-
-/* Copy smeared fields to the corresponding location on a blocked lattice,
-* but for own node only, without communications. Used by make_blocked_fields()
-* to avoid communicating with self (and in serial).
-*/
-void block_fields_ownnode(lattice const* l, lattice const* b, fields const* f_smeared, fields* f_blocked) {
-
-  if (b->standby) {
-    return;
-  }
-
-  // first find own node in the comlists
+  // own node: no communication needed, so write directly to the blocked fields
   sendrecv_struct* send = NULL;
   sendrecv_struct* recv = NULL;
-  int sends = l->blocklist.sends;
-  for (int k=0; k<sends; k++) {
+  for (int k=0; k<l->blocklist.sends; k++) {
     if (l->blocklist.send_to[k].node == l->rank) {
       send = &l->blocklist.send_to[k];
-      break;
     }
   }
-  if (send == NULL) {
-    return; // nothing to send to self
-  }
-
-  // same for receives
-  int recvs = b->blocklist.recvs;
-  for (int k=0; k<recvs; k++) {
-    if (b->blocklist.recv_from[k].node == b->rank) {
+  for (int k=0; k<b->blocklist.recvs; k++) {
+    if (b->blocklist.recv_from[k].node == l->rank) {
       recv = &b->blocklist.recv_from[k];
-      break;
     }
   }
-  if (recv == NULL) {
-    // should not get here, because above we found stuff to send to self
-    printf("Error (1) in block_fields_ownnode()! (blocking.c)\n");
+  if ((send == NULL) != (recv == NULL) || (send != NULL && send->sites != recv->sites)) {
+    printf("Error in make_blocked_fields()! (blocking.c)\n");
     die(1002);
   }
-
-  if (send->sites != recv->sites) {
-    printf("Error (2) in block_fields_ownnode()! (blocking.c)\n");
-    die(1003);
+  if (send != NULL) {
+    double buf[dofs];
+    for (long i=0; i<send->sites; i++) {
+      pack_blocked_site(l, f, block_dir, smear, send->sitelist[i], buf);
+      unpack_blocked_site(b, f_blocked, recv->sitelist[i], buf);
+    }
   }
 
-  for (long i=0; i<send->sites; i++) {
-    long site_l = send->sitelist[i]; // site on the original lattice
-    long site_b = recv->sitelist[i]; // site on the blocked lattice
-
-    // now copy the smeared fields into the right places in f_blocked
-    for (int dir=0; dir<l->dim; dir++) {
-      memcpy(f_blocked->su2link[site_b][dir], f_smeared->su2link[site_l][dir], SU2LINK * sizeof(f_blocked->su2link[site_b][dir][0]));
-      #ifdef U1
-        f_blocked->u1link[site_b][dir] = f_smeared->u1link[site_l][dir];
-      #endif
+  #ifdef MPI
+    // unpack other contributions as they arrive
+    double start = wall_time();
+    for (int n=0; n<recvs; n++) {
+      int m;
+      MPI_Waitany(recvs, recv_req, &m, MPI_STATUS_IGNORE);
+      if (m == MPI_UNDEFINED) {
+        break; // no more active requests
+      }
+      recv = &b->blocklist.recv_from[m];
+      for (long i=0; i<recv->sites; i++) {
+        unpack_blocked_site(b, f_blocked, recv->sitelist[i], &recv->buf[i * dofs]);
+      }
     }
-    #ifdef HIGGS
-      memcpy(f_blocked->su2doublet[site_b], f_smeared->su2doublet[site_l], SU2DB * sizeof(f_blocked->su2doublet[site_b][0]));
-    #endif
-    #ifdef TRIPLET
-      memcpy(f_blocked->su2triplet[site_b], f_smeared->su2triplet[site_l], SU2TRIP * sizeof(f_blocked->su2triplet[site_b][0]));
-    #endif
-  }
-  // self blocking done
+    // send buffers are reused in the next call, so wait here
+    MPI_Waitall(sends, send_req, MPI_STATUSES_IGNORE);
+
+    Global_comms_time += wall_time() - start;
+  #endif
+
+  // done, now just sync halos on the blocked lattice
+  sync_halos(b, f_blocked);
 }
 
 /* Test routine: checks that fields on the original lattice end up
@@ -699,58 +618,93 @@ void test_blocking(lattice* l, lattice* b, int const* block_dir) {
         }
       }
     #endif
+    #if (NHIGGS > 0)
+      for (int db=0; db<NHIGGS; db++) {
+        for (int k=0; k<SU2DB; k++) {
+          // different decimals for each doublet
+          f.su2doublet[db][i][k] = y + (double) (db*SU2DB + k) / (NHIGGS*SU2DB);
+          if (i < b->sites) {
+            f_b.su2doublet[db][i][k] = -1.0;
+          }
+        }
+      }
+    #endif
+    #ifdef SINGLET
+      f.singlet[i][0] = y;
+      if (i < b->sites) {
+        f_b.singlet[i][0] = -1.0;
+      }
+    #endif
   }
 
-  make_blocked_fields(l, b, &f, &f_b);
+  int smear = 0;
+  make_blocked_fields(l, b, &f, &f_b, block_dir, smear);
 
-  if (!b->standby) {
-    // check the new values in f_b
-    for (long i=0; i<b->sites; i++) {
+  // check the new values in f_b
+  for (long i=0; i<b->sites; i++) {
 
-      // what are the coords BEFORE blocking?
-      long coords[b->dim];
-      for (int dir=0; dir<b->dim; dir++) {
-        if (block_dir[dir]) {
-          coords[dir] = b->coords[i][dir] * 2;
-        } else {
-          coords[dir] = b->coords[i][dir];
+    // what are the coords BEFORE blocking?
+    long coords[b->dim];
+    for (int dir=0; dir<b->dim; dir++) {
+      if (block_dir[dir]) {
+        coords[dir] = b->coords[i][dir] * 2;
+      } else {
+        coords[dir] = b->coords[i][dir];
+      }
+    }
+
+    // repeat the Cantor pairing
+    y = coords[0];
+		for (int dir=1; dir<b->dim; dir++) {
+			x = coords[dir];
+			y = y + 0.5 * (x + y + 1) * (x + y);
+		}
+
+    for (int dir=0; dir<b->dim; dir++) {
+      for (int k=0; k<SU2LINK; k++) {
+        // predicted value:
+        double val = y + (double) k / SU2LINK;
+
+        if (fabs(f_b.su2link[i][dir][k] - val) > 0.0001) {
+          printf("Node %d: error in test_blocking at site %ld, dir %d!! field val is %lf; was supposed to be %lf (blocking.c)\n"
+              , b->rank, i, dir, f_b.su2link[i][dir][k], val);
         }
       }
+    }
 
-      // repeat the Cantor pairing
-      y = coords[0];
-  		for (int dir=1; dir<b->dim; dir++) {
-  			x = coords[dir];
-  			y = y + 0.5 * (x + y + 1) * (x + y);
-  		}
-
-      for (int dir=0; dir<b->dim; dir++) {
-        for (int k=0; k<SU2LINK; k++) {
-          // predicted value:
-          double val = y + (double) k / SU2LINK;
-
-          if (fabs(f_b.su2link[i][dir][k] - val) > 0.0001) {
-            printf("Node %d: error in test_blocking at site %ld, dir %d!! field val is %lf; was supposed to be %lf (blocking.c)\n"
-                , b->rank, i, dir, f_b.su2link[i][dir][k], val);
-          }
+    #ifdef TRIPLET
+      for (int k=0; k<SU2TRIP; k++) {
+        // predicted value:
+        double val = y + (double) k / SU2TRIP;
+
+        if (fabs(f_b.su2triplet[i][k] - val) > 0.0001) {
+          printf("Node %d: error in test_blocking at site %ld!! triplet val is %lf; was supposed to be %lf (blocking.c)\n"
+              , b->rank, i, f_b.su2triplet[i][k], val);
         }
       }
+    #endif
 
-      #ifdef TRIPLET
-        for (int k=0; k<SU2TRIP; k++) {
-          // predicted value:
-          double val = y + (double) k / SU2TRIP;
+    #if (NHIGGS > 0)
+      for (int db=0; db<NHIGGS; db++) {
+        for (int k=0; k<SU2DB; k++) {
+          double val = y + (double) (db*SU2DB + k) / (NHIGGS*SU2DB);
 
-          if (fabs(f_b.su2triplet[i][k] - val) > 0.0001) {
-            printf("Node %d: error in test_blocking at site %ld!! triplet val is %lf; was supposed to be %lf (blocking.c)\n"
-                , b->rank, i, f_b.su2triplet[i][k], val);
+          if (fabs(f_b.su2doublet[db][i][k] - val) > 0.0001) {
+            printf("Node %d: error in test_blocking at site %ld!! doublet %d val is %lf; was supposed to be %lf (blocking.c)\n"
+                , b->rank, i, db, f_b.su2doublet[db][i][k], val);
           }
         }
-      #endif
+      }
+    #endif
 
-    } // end i
+    #ifdef SINGLET
+      if (fabs(f_b.singlet[i][0] - y) > 0.0001) {
+        printf("Node %d: error in test_blocking at site %ld!! singlet val is %lf; was supposed to be %lf (blocking.c)\n"
+            , b->rank, i, f_b.singlet[i][0], (double) y);
+      }
+    #endif
 
-  }
+  } // end i
 
   free_fields(l, &f);
   free_fields(b, &f_b);
@@ -24,11 +24,19 @@ void print_acceptance(params p, counters c) {
 		printf("SU(2) link %.2lf%%, ",
 			100.0*c.accepted_su2link/c.total_su2link);
 	}
+	if (p.algorithm_su2link == OVERRELAX && print_gauge) {
+		printf("SU(2) link overrelax %.2lf%%, ",
+			100.0*c.acc_overrelax_su2link/c.total_overrelax_su2link);
+	}
 
 	#ifdef U1
-		if (p.algorithm_u1link == METROPOLIS) {
+		if (p.algorithm_u1link == METROPOLIS || (p.algorithm_u1link == HEATBATH && p.r_u1 != 1.0)) {
 			printf("U(1) link %.2lf%%, ",
 				100.0*c.accepted_u1link/c.total_u1link);
+		} else if (p.algorithm_u1link == OVERRELAX) {
+			printf("U(1) link overrelax %.2lf%%, U(1) link Metropolis %.2lf%%, ",
+				100.0*c.acc_overrelax_u1link/c.total_overrelax_u1link,
+				100.0*c.accepted_u1link/c.total_u1link);
 		}
 	#endif
 
@@ -69,6 +77,13 @@ void print_acceptance(params p, counters c) {
 	}
 	#endif
 
+	#ifdef HMC
+	if (p.hmc_trajectories > 0) {
+		printf("HMC %.2lf%%, ",
+			100.0*c.accepted_hmc/c.total_hmc);
+	}
+	#endif
+
 	if (p.multicanonical) {
 		printf("multicanonical %.2lf%%",
 				100.0*c.accepted_muca/c.total_muca);
@@ -77,11 +92,51 @@ void print_acceptance(params p, counters c) {
 
 }
 
+/* Collect pointers to the Metropolis step sizes of the fields in use,
+* in the order they are stored in the latticefile. Returns how many there are. */
+static int metro_steps(params* p, double** steps) {
+	int n = 0;
+	steps[n++] = &p->metro_step_su2link;
+	#ifdef U1
+		steps[n++] = &p->metro_step_u1link;
+	#endif
+	#if (NHIGGS > 0)
+		steps[n++] = &p->metro_step_doublet;
+	#endif
+	#ifdef TRIPLET
+		steps[n++] = &p->metro_step_triplet;
+	#endif
+	#ifdef SINGLET
+		steps[n++] = &p->metro_step_singlet;
+	#endif
+	return n;
+}
+
+/* Read-only version of metro_steps(): copies the step sizes to values, in the same order */
+static int metro_step_values(params const* p, double* values) {
+	int n = 0;
+	values[n++] = p->metro_step_su2link;
+	#ifdef U1
+		values[n++] = p->metro_step_u1link;
+	#endif
+	#if (NHIGGS > 0)
+		values[n++] = p->metro_step_doublet;
+	#endif
+	#ifdef TRIPLET
+		values[n++] = p->metro_step_triplet;
+	#endif
+	#ifdef SINGLET
+		values[n++] = p->metro_step_singlet;
+	#endif
+	return n;
+}
+
 /* Write all fields to a file.
-* Also stores lattice dimensions and current iteration number.
+* Also stores lattice dimensions and current iteration number,
+* and after the fields the Metropolis step sizes (possibly tuned during thermalization).
 * Theory parameters such as beta_G and masses are NOT stored!
 * Neither are model-specific acceptance rates. */
-void save_lattice(lattice const* l, fields f, counters c, char* fname) {
+void save_lattice(lattice const* l, fields f, counters c, params const* p, char* fname) {
 
 	FILE *file;
 	if (l->rank == 0) {
@@ -115,6 +170,11 @@ void save_lattice(lattice const* l, fields f, counters c, char* fname) {
 	#endif
 
 	if (l->rank == 0) {
+		// Metropolis steps
+		double steps[5];
+		int n = metro_step_values(p, steps);
+		fwrite(steps, sizeof(steps[0]), n, file);
+
 		fclose(file);
 		printf("Wrote fields to %s.\n", fname);
 	}
@@ -129,8 +189,10 @@ void save_lattice(lattice const* l, fields f, counters c, char* fname) {
 * ALL nodes read the first few lines of the latticefile so that
 * counters and iteration number can be kept in sync, while only the root node
 * reads fields and distributes them to others.
+* Metropolis step sizes are read from the end of the file if present;
+* files written before they were stored keep the values from the config.
 */
-void load_lattice(lattice* l, fields* f, counters* c, char* fname) {
+void load_lattice(lattice* l, fields* f, counters* c, params* p, char* fname) {
 
 	FILE *file;
 
@@ -208,9 +270,24 @@ void load_lattice(lattice* l, fields* f, counters* c, char* fname) {
 	// finally, sync all halo fields; these were not loaded from the file
 	sync_halos(l, f);
 
+	double* steps[5];
+	double stored[5];
+	int n = metro_steps(p, steps);
+	int found = 0;
 	if (l->rank == 0) {
+		found = (fread(stored, sizeof(stored[0]), n, file) == (size_t) n);
 		fclose(file);
 	}
+	bcast_int(&found, l->comm);
+
+	if (found) {
+		bcast_double_array(stored, n, l->comm);
+		for (int k=0; k<n; k++) {
+			*steps[k] = stored[k];
+		}
+	} else {
+		printf0("No Metropolis step sizes in %s, using the values from config\n", fname);
+	}
 }
 
 #ifdef MPI
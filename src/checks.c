@@ -0,0 +1,438 @@
+/** @file checks.c
+*
+* Consistency checks of the action, run at startup if run_checks is set in the config file.
+* These complement the layout and comms checks of layout.c and comms.c, and are meant to
+* catch errors introduced by changes to the action and update kernels.
+*
+* The checks use a random test configuration that is a function of the physical
+* coordinates only, so that it is the same for any number of nodes and any site ordering:
+*   1. Total action and average plaquette of the test configuration are printed.
+*      These should agree to rounding precision between builds with the same compiler
+*      flags and config file, for any number of nodes, so they can be compared against
+*      values obtained with a trusted version of the program.
+*   2. Gauge invariance: the total action must not change under a random SU(2)
+*      (and U(1), if present) gauge transformation.
+*   3. Locality: changing a single field at one site must change the total action by
+*      the same amount as the local action used in the Metropolis updates (localact_*()).
+*   4. Optimized kernels: the local actions in terms of precomputed staples
+*      (localact_*_staple(), u1link_action()) must change by the same amount as localact_*(),
+*      polysolve3_batch() must agree with polysolve3(), and with HMC the forces of
+*      hmc_forces() must agree with a finite difference of total_action().
+* A failed check stops the program. The fields used in the simulation are not touched.
+*/
+
+#include "su2.h"
+
+// relative precision required from the checks
+#define CHECKS_TOL 1e-10
+
+// offsets for the random numbers of different fields
+enum {
+	SALT_LINK, SALT_U1, SALT_DOUBLET, SALT_TRIPLET, SALT_SINGLET,
+	SALT_GAUGE, SALT_GAUGE_U1, SALT_NEW, N_SALTS
+};
+
+// step of the finite differences in check_forces() and their required relative precision
+#define FORCES_STEP 1e-4
+#define FORCES_TOL 1e-6
+
+/* Random number in [0,1) from a 64-bit integer (splitmix64 finalizer) */
+static double hash_ran(unsigned long long x) {
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	x ^= x >> 31;
+	return (x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Random number in [0,1) that depends only on the physical coordinates of site i
+* (which can be a halo site) and on the labels salt and k, 0 <= k < 64 */
+static double site_ran(lattice const* l, long i, int salt, int k) {
+	unsigned long long x = coordsToIndex(l->dim, l->L, l->coords[i]);
+	return hash_ran((x * N_SALTS + salt) * 64 + k);
+}
+
+/* Random SU(2) matrix at site i */
+static void site_su2(lattice const* l, long i, int salt, int k, double* u) {
+	double norm = 0.0;
+	for (int a=0; a<SU2LINK; a++) {
+		u[a] = 2.0 * site_ran(l, i, salt, SU2LINK*k + a) - 1.0;
+		norm += u[a]*u[a];
+	}
+	norm = 1.0 / sqrt(norm);
+	for (int a=0; a<SU2LINK; a++) u[a] *= norm;
+}
+
+/* Set all fields, including halos, to random values. No halo exchange is needed
+* since the values depend only on the coordinates. */
+static void set_test_fields(lattice const* l, fields* f) {
+
+	for (long i=0; i<l->sites_total; i++) {
+		for (int dir=0; dir<l->dim; dir++) {
+			site_su2(l, i, SALT_LINK, dir, f->su2link[i][dir]);
+			#ifdef U1
+				f->u1link[i][dir] = 2.0 * M_PI * site_ran(l, i, SALT_U1, dir);
+			#endif
+		}
+
+		#if (NHIGGS > 0)
+			for (int db=0; db<NHIGGS; db++) {
+				for (int a=0; a<SU2DB; a++) {
+					f->su2doublet[db][i][a] = site_ran(l, i, SALT_DOUBLET, SU2DB*db + a) - 0.5;
+				}
+			}
+		#endif
+
+		#ifdef TRIPLET
+			for (int a=0; a<SU2TRIP; a++) {
+				f->su2triplet[i][a] = site_ran(l, i, SALT_TRIPLET, a) - 0.5;
+			}
+		#endif
+
+		#ifdef SINGLET
+			f->singlet[i][0] = site_ran(l, i, SALT_SINGLET, 0) - 0.5;
+		#endif
+	}
+}
+
+/* Total action summed over all nodes */
+static double sum_action(lattice const* l, fields const* f, params const* p) {
+	double tot = 0.0;
+	for (long i=0; i<l->sites; i++) {
+		tot += action_local(l, f, p, i);
+	}
+	return allreduce(tot, l->comm);
+}
+
+/* Average of 0.5 Tr U_ij over all plaquettes */
+static double average_plaquette(lattice const* l, fields const* f) {
+	double tot = 0.0;
+	for (long i=0; i<l->sites; i++) {
+		for (int d1=0; d1<l->dim; d1++) {
+			for (int d2=d1+1; d2<l->dim; d2++) {
+				tot += 0.5 * su2ptrace(l, f, i, d1, d2);
+			}
+		}
+	}
+	return allreduce(tot, l->comm) / (l->vol * l->dim * (l->dim - 1) / 2);
+}
+
+/* Hermitian conjugate of an SU(2) matrix */
+static void su2conj(double const* u, double* res) {
+	res[0] = u[0];
+	for (int a=1; a<SU2LINK; a++) res[a] = -u[a];
+}
+
+/* Random gauge transformation of all fields at my sites, with a gauge function
+* that depends only on the coordinates. Halos need to be synced afterwards. Transformations:
+*	U_j(x) -> g(x) U_j(x) g(x+j)^+,  alpha_j(x) -> alpha_j(x) + lambda(x) - lambda(x+j),
+*	Phi(x) -> g(x) Phi(x) exp(-i lambda(x) sigma_3),  Sigma(x) -> g(x) Sigma(x) g(x)^+ */
+static void gauge_transform(lattice const* l, fields* f) {
+
+	double g[SU2LINK], gnext[SU2LINK], tmp[SU2LINK];
+
+	for (long i=0; i<l->sites; i++) {
+
+		site_su2(l, i, SALT_GAUGE, 0, g);
+
+		for (int dir=0; dir<l->dim; dir++) {
+			long next = l->next[i][dir];
+			site_su2(l, next, SALT_GAUGE, 0, tmp);
+			su2conj(tmp, gnext);
+
+			memcpy(tmp, g, SU2LINK * sizeof(*tmp));
+			su2rot(tmp, f->su2link[i][dir]);
+			su2rot(tmp, gnext);
+			memcpy(f->su2link[i][dir], tmp, SU2LINK * sizeof(*tmp));
+
+			#ifdef U1
+				f->u1link[i][dir] += 2.0 * M_PI * (site_ran(l, i, SALT_GAUGE_U1, 0) - site_ran(l, next, SALT_GAUGE_U1, 0));
+			#endif
+		}
+
+		#if (NHIGGS > 0)
+			double lam = 2.0 * M_PI * site_ran(l, i, SALT_GAUGE_U1, 0);
+			double h[SU2DB] = { cos(lam), 0.0, 0.0, -sin(lam) };
+			#ifndef U1
+				h[0] = 1.0; h[3] = 0.0;
+			#endif
+			for (int db=0; db<NHIGGS; db++) {
+				memcpy(tmp, g, SU2LINK * sizeof(*tmp));
+				su2rot(tmp, f->su2doublet[db][i]);
+				su2rot(tmp, h);
+				memcpy(f->su2doublet[db][i], tmp, SU2DB * sizeof(*tmp));
+			}
+		#endif
+
+		#ifdef TRIPLET
+			double s[SU2LINK] = { 0.0, f->su2triplet[i][0], f->su2triplet[i][1], f->su2triplet[i][2] };
+			su2conj(g, gnext);
+			memcpy(tmp, g, SU2LINK * sizeof(*tmp));
+			su2rot(tmp, s);
+			su2rot(tmp, gnext);
+			memcpy(f->su2triplet[i], &tmp[1], SU2TRIP * sizeof(*tmp));
+		#endif
+	}
+}
+
+/* Compare the change in total action to the change in local action
+* calculated in the root node, and die if they do not agree */
+static void compare_local(lattice const* l, char* name, double S_old, double S_new, double dS_local) {
+	bcast_double(&dS_local, l->comm);
+	double dS = S_new - S_old;
+	if (fabs(dS - dS_local) > CHECKS_TOL * (fabs(S_old) + 1.0)) {
+		printf0("Error in test_action! Change in total action %.12g does not match change in %s %.12g\n",
+					dS, name, dS_local);
+		die(-130);
+	}
+}
+
+/* Compare a change in local action from an optimized kernel, calculated in the root node,
+* to the change from the reference kernel, and die if they do not agree */
+static void compare_kernel(lattice const* l, char* name, char* ref_name, double dS_ref, double dS) {
+	bcast_double(&dS_ref, l->comm);
+	bcast_double(&dS, l->comm);
+	if (fabs(dS - dS_ref) > CHECKS_TOL * (fabs(dS_ref) + 1.0)) {
+		printf0("Error in test_action! Change in %s %.12g does not match change in %s %.12g\n",
+					name, dS, ref_name, dS_ref);
+		die(-132);
+	}
+}
+
+#if (NHIGGS > 0) || defined(TRIPLET) || defined(SINGLET)
+/* Solve random cubics with polysolve3_batch() and polysolve3() and die if the roots
+* do not agree. The cubics are a (x - r)(x^2 + b x + c) with b^2 < 4c, so that r is the only
+* real root, as in the overrelaxation updates. Same on all nodes. */
+static void check_polysolve(void) {
+
+	double a[OVERRELAX_BATCH], b[OVERRELAX_BATCH], c[OVERRELAX_BATCH], d[OVERRELAX_BATCH];
+	double x[OVERRELAX_BATCH];
+
+	for (int k=0; k<OVERRELAX_BATCH; k++) {
+		// any labels will do, the cubics only need to be generic
+		unsigned long long x0 = (N_SALTS * 64ULL + k) * 4;
+		double A = 0.1 + hash_ran(x0);
+		double r = 4.0 * hash_ran(x0 + 1) - 2.0;
+		double qb = 2.0 * hash_ran(x0 + 2) - 1.0;
+		double qc = 0.25*qb*qb + 0.01 + hash_ran(x0 + 3);
+		a[k] = A;
+		b[k] = A * (qb - r);
+		c[k] = A * (qc - r*qb);
+		d[k] = -A * r*qc;
+	}
+
+	polysolve3_batch(OVERRELAX_BATCH, a, b, c, d, x);
+
+	for (int k=0; k<OVERRELAX_BATCH; k++) {
+		double ref = polysolve3(a[k], b[k], c[k], d[k]);
+		if (fabs(x[k] - ref) > 1e-9 * (fabs(ref) + 1.0)) {
+			printf0("Error in test_action! Root %.12g from polysolve3_batch() does not match %.12g from polysolve3()\n",
+						x[k], ref);
+			die(-133);
+		}
+	}
+}
+#endif
+
+#ifdef HMC
+/* Set field component x to its original value x0 shifted by h. If a > 0, x is an SU(2) link
+* and is shifted as U -> exp(i h sigma_a) U, as in the HMC and gradient flow updates */
+static void shift_component(double* x, double const* x0, int a, double h) {
+	if (a > 0) {
+		double z[3] = {0.0, 0.0, 0.0};
+		double u[SU2LINK], tmp[SU2LINK];
+		z[a-1] = 1.0;
+		su2exp_algebra(z, h, u);
+		memcpy(tmp, x0, SU2LINK * sizeof(*tmp));
+		su2rot(u, tmp);
+		memcpy(x, u, SU2LINK * sizeof(*u));
+	} else {
+		x[0] = x0[0] + h;
+	}
+}
+
+/* Compare the force F on field component x at a site of the root node with the central
+* difference -dS/dx of total_action(), and die if they do not agree. x and F are only
+* used in the root node. See shift_component() for the meaning of a. */
+static void compare_force(lattice* l, fields* f, params const* p, char* name, double* x, int a, double F) {
+
+	double x0[SU2LINK] = {0.0};
+	if (!l->rank) memcpy(x0, x, (a > 0 ? SU2LINK : 1) * sizeof(*x0));
+
+	if (!l->rank) shift_component(x, x0, a, FORCES_STEP);
+	sync_halos(l, f);
+	double S_plus = total_action(l, f, p);
+	if (!l->rank) shift_component(x, x0, a, -FORCES_STEP);
+	sync_halos(l, f);
+	double S_minus = total_action(l, f, p);
+	if (!l->rank) memcpy(x, x0, (a > 0 ? SU2LINK : 1) * sizeof(*x0));
+	sync_halos(l, f);
+
+	bcast_double(&F, l->comm);
+	double F_diff = -(S_plus - S_minus) / (2.0 * FORCES_STEP);
+	if (fabs(F - F_diff) > FORCES_TOL * (fabs(F_diff) + 1.0)) {
+		printf0("Error in test_action! Force %.12g on %s from hmc_forces() does not match finite difference %.12g\n",
+					F, name, F_diff);
+		die(-134);
+	}
+}
+
+/* Check hmc_forces() for all fields at site i of the root node. Halos of f need to be up to date. */
+static void check_forces(lattice* l, fields* f, params const* p, long i) {
+
+	fields F;
+	alloc_fields(l, &F);
+	hmc_forces(l, f, p, &F);
+
+	for (int dir=0; dir<l->dim; dir++) {
+		for (int a=1; a<SU2LINK; a++) {
+			compare_force(l, f, p, "su2link", f->su2link[i][dir], a, F.su2link[i][dir][a]);
+		}
+		#ifdef U1
+			compare_force(l, f, p, "u1link", &f->u1link[i][dir], 0, F.u1link[i][dir]);
+		#endif
+	}
+
+	#if (NHIGGS > 0)
+		for (int db=0; db<NHIGGS; db++) {
+			for (int a=0; a<SU2DB; a++) {
+				compare_force(l, f, p, "su2doublet", &f->su2doublet[db][i][a], 0, F.su2doublet[db][i][a]);
+			}
+		}
+	#endif
+
+	#ifdef TRIPLET
+		for (int a=0; a<SU2TRIP; a++) {
+			compare_force(l, f, p, "su2triplet", &f->su2triplet[i][a], 0, F.su2triplet[i][a]);
+		}
+	#endif
+
+	#ifdef SINGLET
+		compare_force(l, f, p, "singlet", &f->singlet[i][0], 0, F.singlet[i][0]);
+	#endif
+
+	free_fields(l, &F);
+}
+#endif
+
+/* Run the checks described at the top of this file. Needs to be called from all nodes,
+* after layout(). Uses its own fields, so the actual simulation is not affected. */
+void test_action(lattice* l, params const* p) {
+
+	fields f;
+	alloc_fields(l, &f);
+	set_test_fields(l, &f);
+	sync_halos(l, &f);
+
+	// reference values
+	double S = sum_action(l, &f, p);
+	double plaq = average_plaquette(l, &f);
+	printf0("Test configuration: action %.12e, average plaquette %.12e\n", S, plaq);
+
+	// gauge invariance
+	gauge_transform(l, &f);
+	sync_halos(l, &f);
+	double S_gauge = sum_action(l, &f, p);
+	if (fabs(S_gauge - S) > CHECKS_TOL * fabs(S)) {
+		printf0("Error in test_action! Action not gauge invariant: %.12e before, %.12e after gauge transformation\n",
+					S, S_gauge);
+		die(-131);
+	}
+
+	// locality: modify fields at site 0 of the root node, one at a time
+	long i = 0;
+	double dS = 0.0, dS_kernel = 0.0;
+
+	for (int dir=0; dir<l->dim; dir++) {
+		S = sum_action(l, &f, p);
+		if (!l->rank) {
+			dS = -localact_su2link(l, &f, p, i, dir);
+			site_su2(l, i, SALT_NEW, dir, f.su2link[i][dir]);
+			dS += localact_su2link(l, &f, p, i, dir);
+		}
+		sync_halos(l, &f);
+		compare_local(l, "localact_su2link()", S, sum_action(l, &f, p), dS);
+
+		#ifdef U1
+			S = sum_action(l, &f, p);
+			if (!l->rank) {
+				// staple coefficients do not depend on the link itself
+				double k[4];
+				u1link_staple(l, &f, p, i, dir, k);
+				double a_old = f.u1link[i][dir];
+				dS = -localact_u1link(l, &f, p, i, dir);
+				f.u1link[i][dir] = 2.0 * M_PI * site_ran(l, i, SALT_NEW, 16 + dir);
+				dS += localact_u1link(l, &f, p, i, dir);
+				dS_kernel = u1link_action(k, p->r_u1, f.u1link[i][dir]) - u1link_action(k, p->r_u1, a_old);
+			}
+			sync_halos(l, &f);
+			compare_local(l, "localact_u1link()", S, sum_action(l, &f, p), dS);
+			compare_kernel(l, "u1link_action()", "localact_u1link()", dS, dS_kernel);
+		#endif
+	}
+
+	#if (NHIGGS > 0)
+		for (int db=0; db<NHIGGS; db++) {
+			S = sum_action(l, &f, p);
+			if (!l->rank) {
+				double s[SU2DB];
+				staple_doublet(s, l, &f, p, i, db);
+				dS = -localact_doublet(l, &f, p, i, db);
+				dS_kernel = -localact_doublet_staple(l, &f, p, s, i, db);
+				for (int a=0; a<SU2DB; a++) {
+					f.su2doublet[db][i][a] = site_ran(l, i, SALT_NEW, 32 + SU2DB*db + a) - 0.5;
+				}
+				dS += localact_doublet(l, &f, p, i, db);
+				dS_kernel += localact_doublet_staple(l, &f, p, s, i, db);
+			}
+			sync_halos(l, &f);
+			compare_local(l, "localact_doublet()", S, sum_action(l, &f, p), dS);
+			compare_kernel(l, "localact_doublet_staple()", "localact_doublet()", dS, dS_kernel);
+		}
+	#endif
+
+	#ifdef TRIPLET
+		S = sum_action(l, &f, p);
+		if (!l->rank) {
+			double s[SU2TRIP];
+			staple_triplet(s, l, &f, p, i);
+			dS = -localact_triplet(l, &f, p, i);
+			dS_kernel = -localact_triplet_staple(l, &f, p, s, i);
+			for (int a=0; a<SU2TRIP; a++) {
+				f.su2triplet[i][a] = site_ran(l, i, SALT_NEW, 48 + a) - 0.5;
+			}
+			dS += localact_triplet(l, &f, p, i);
+			dS_kernel += localact_triplet_staple(l, &f, p, s, i);
+		}
+		sync_halos(l, &f);
+		compare_local(l, "localact_triplet()", S, sum_action(l, &f, p), dS);
+		compare_kernel(l, "localact_triplet_staple()", "localact_triplet()", dS, dS_kernel);
+	#endif
+
+	#ifdef SINGLET
+		S = sum_action(l, &f, p);
+		if (!l->rank) {
+			double nn = staple_singlet(l, &f, i);
+			dS = -localact_singlet(l, &f, p, i);
+			dS_kernel = -localact_singlet_staple(l, &f, p, nn, i);
+			f.singlet[i][0] = site_ran(l, i, SALT_NEW, 56) - 0.5;
+			dS += localact_singlet(l, &f, p, i);
+			dS_kernel += localact_singlet_staple(l, &f, p, nn, i);
+		}
+		sync_halos(l, &f);
+		compare_local(l, "localact_singlet()", S, sum_action(l, &f, p), dS);
+		compare_kernel(l, "localact_singlet_staple()", "localact_singlet()", dS, dS_kernel);
+	#endif
+
+	#if (NHIGGS > 0) || defined(TRIPLET) || defined(SINGLET)
+		check_polysolve();
+	#endif
+
+	#ifdef HMC
+		check_forces(l, &f, p, i);
+	#endif
+
+	printf0("Action checks passed: gauge invariance, local actions and update kernels OK\n");
+
+	free_fields(l, &f);
+}
@@ -274,8 +274,6 @@ void make_comlists(lattice *l, comlist_struct *comlist) {
 * before starting receives, waiting for neighbors to send is significantly reduced. */
 void update_gaugehalo(lattice* l, char parity, double*** field, int dofs, int dir) {
 
-	double start, end, time = 0.0;
-	start = clock();
 	comlist_struct* comlist = &l->comlist;
 
 	int neighbors = comlist->sends;
@@ -283,6 +281,9 @@ void update_gaugehalo(lattice* l, char parity, double*** field, int dofs, int di
 		return;
 	}
 
+	timer_start(TIMER_GAUGEHALO);
+	double start = wall_time();
+
 	// first do a nonblocking send to all neighbors
 	MPI_Request send_req[neighbors];
 
@@ -297,21 +298,15 @@ void update_gaugehalo(lattice* l, char parity, double*** field, int dofs, int di
 	}
 
 	// finally, wait until my sends have been received and free the send buffers
-	double s, e;
-	s = clock();
+	double s = wall_time();
 	for (int k=0; k<neighbors; k++) {
 		MPI_Wait(&send_req[k], MPI_STATUS_IGNORE);
 		free(comlist->send_to[k].buf);
 	}
-	e = clock();
-	waittime += (e - s) /CLOCKS_PER_SEC;
-
-
-	end = clock();
-
-	time += (double)(end - start) / CLOCKS_PER_SEC;
-	Global_comms_time += time;
+	waittime += wall_time() - s;
 
+	Global_comms_time += wall_time() - start;
+	timer_stop(TIMER_GAUGEHALO);
 }
 
 
@@ -426,8 +421,6 @@ void recv_gaugefield(sendrecv_struct* recv, MPI_Comm comm, char parity, double**
 */
 void update_halo(lattice* l, char parity, double** field, int dofs) {
 
-	double start, end, time = 0.0;
-	start = clock();
 	comlist_struct* comlist = &l->comlist;
 
 	int neighbors = comlist->sends;
@@ -435,6 +428,9 @@ void update_halo(lattice* l, char parity, double** field, int dofs) {
 		return;
 	}
 
+	timer_start(TIMER_HALO);
+	double start = wall_time();
+
 	// first do a nonblocking send to all neighbors
 	MPI_Request send_req[neighbors];
 
@@ -449,20 +445,15 @@ void update_halo(lattice* l, char parity, double** field, int dofs) {
 	}
 
 	// finally, wait until my sends have been received and free the send buffers
-	double s, e;
-	s = clock();
+	double s = wall_time();
 	for (int k=0; k<neighbors; k++) {
 		MPI_Wait(&send_req[k], MPI_STATUS_IGNORE);
 		free(comlist->send_to[k].buf);
 	}
-	e = clock();
-	waittime += (e - s) /CLOCKS_PER_SEC;
+	waittime += wall_time() - s;
 
-
-	end = clock();
-
-	time += (double)(end - start) / CLOCKS_PER_SEC;
-	Global_comms_time += time;
+	Global_comms_time += wall_time() - start;
+	timer_stop(TIMER_HALO);
 }
 
 
@@ -858,6 +849,20 @@ double allreduce(double res, MPI_Comm comm) {
 	return total;
 }
 
+// Maximum of res over all nodes, distributed to all nodes
+double allreduce_max(double res, MPI_Comm comm) {
+	double max = 0.0;
+	MPI_Allreduce(&res, &max, 1, MPI_DOUBLE, MPI_MAX, comm);
+	return max;
+}
+
+// Minimum of res over all nodes, distributed to all nodes
+double allreduce_min(double res, MPI_Comm comm) {
+	double min = 0.0;
+	MPI_Allreduce(&res, &min, 1, MPI_DOUBLE, MPI_MIN, comm);
+	return min;
+}
+
 // Same as reduce_sum, but for a long type
 long reduce_sum_long(long res, MPI_Comm comm) {
 	long total = 0;
@@ -865,6 +870,32 @@ long reduce_sum_long(long res, MPI_Comm comm) {
 	return total;
 }
 
+/* Same as reduce_sum(), but for an array of doubles in one collective.
+* The sum is stored in arr in the root node, other nodes keep their own values. */
+void reduce_sum_array(double* arr, int size, MPI_Comm comm) {
+	int rank;
+	MPI_Comm_rank(comm, &rank);
+	if (rank == 0) {
+		MPI_Reduce(MPI_IN_PLACE, arr, size, MPI_DOUBLE, MPI_SUM, 0, comm);
+	} else {
+		MPI_Reduce(arr, NULL, size, MPI_DOUBLE, MPI_SUM, 0, comm);
+	}
+}
+
+// Same as reduce_sum_array(), but the sum is distributed to all nodes
+void allreduce_array(double* arr, int size, MPI_Comm comm) {
+	MPI_Allreduce(MPI_IN_PLACE, arr, size, MPI_DOUBLE, MPI_SUM, comm);
+}
+
+// Same as allreduce_max() and allreduce_min(), but elementwise for an array of doubles
+void allreduce_array_max(double* arr, int size, MPI_Comm comm) {
+	MPI_Allreduce(MPI_IN_PLACE, arr, size, MPI_DOUBLE, MPI_MAX, comm);
+}
+
+void allreduce_array_min(double* arr, int size, MPI_Comm comm) {
+	MPI_Allreduce(MPI_IN_PLACE, arr, size, MPI_DOUBLE, MPI_MIN, comm);
+}
+
 // Broadcast integer from root node (rank = 0) to all other nodes.
 void bcast_int(int *res, MPI_Comm comm) {
   MPI_Bcast(res, 1, MPI_INTEGER, 0, comm);
@@ -924,10 +955,34 @@ double allreduce(double res, MPI_Comm comm) {
 	return res;
 }
 
+double allreduce_max(double res, MPI_Comm comm) {
+	return res;
+}
+
+double allreduce_min(double res, MPI_Comm comm) {
+	return res;
+}
+
 long reduce_sum_long(long res, MPI_Comm comm) {
 	return res;
 }
 
+void reduce_sum_array(double* arr, int size, MPI_Comm comm) {
+	return;
+}
+
+void allreduce_array(double* arr, int size, MPI_Comm comm) {
+	return;
+}
+
+void allreduce_array_max(double* arr, int size, MPI_Comm comm) {
+	return;
+}
+
+void allreduce_array_min(double* arr, int size, MPI_Comm comm) {
+	return;
+}
+
 void bcast_int(int *res, MPI_Comm comm) {
 	return;
 }
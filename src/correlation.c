@@ -33,283 +33,159 @@ double plane_sum(double (*funct)(double*), double** field, lattice* l, long x, i
   return res;
 }
 
-#if (NHIGGS > 0)
-/* Calculate H(l) = (1/V) \sum_z h(z) h(z+l),
-* where h(z) = \sum_{x,y} Tr\he\Phi(z)\Phi(z).
-* Below the argument d = l and dir specifies which direction z lives in. */
-double higgs_correlator(lattice* l, fields const* f, int d, int dir, int higgs_id) {
-
-  double res = 0.0;
-  for (int z=0; z<l->L[dir]; z++) {
-
-    /* periodicity: need to find site at coordinate z + d.
-    * if x + d >= lattice length, we measure correlation in the "negative"
-    * direction instead. */
-    int zd = (z + d) % l->L[dir];
-
-    double h1 = plane_sum(doubletsq, f->su2doublet[higgs_id], l, z, dir); // h1 <- h(z)
-    double h2 = plane_sum(doubletsq, f->su2doublet[higgs_id], l, zd, dir); // h2 <- h(z+l)
-
-    res += h1 * h2;
-  }
+/* Plane operators needed for the correlators, stored as planes[op][z] where
+* 0 <= z < L[dir] is the physical coordinate in the correlator direction.
+* Complex photon operators take two consecutive slots (RE, IM). */
+typedef struct {
+  int n_ops;
+  #if (NHIGGS > 0)
+    int higgs; // h(z) = \sum_{x,y} Tr\he\Phi(z)\Phi(z)
+  #endif
+  #ifdef TRIPLET
+    int trip; // sig(z) = \sum_{x,y} Tr\Sigma(z)^2
+    int phot[2][2]; // photon operators [mode][transmom-1], see photon_correl_planes()
+  #endif
+} plane_ops;
 
-  // doubletsq measures 0.5 Tr Phi^+ Phi, so multiply by 4 to get H(l)
-  return 4.0*res / ((double) l->vol);
+static void set_plane_ops(plane_ops* ops) {
+  int k = 0;
+  #if (NHIGGS > 0)
+    ops->higgs = k; k++;
+  #endif
+  #ifdef TRIPLET
+    ops->trip = k; k++;
+    for (int mode=0; mode<2; mode++) {
+      for (int pp=0; pp<2; pp++) {
+        ops->phot[mode][pp] = k; k += 2;
+      }
+    }
+  #endif
+  ops->n_ops = k;
 }
 
-#endif // if NHIGGS > 0
-
-
-#ifdef TRIPLET
-
-/* Calculate (1/V) \sum_z sig(z) sig(z+l),
-* where sig(z) = \sum_{x,y} Tr\Sigma(z)^2.
-* Below the argument d = l and dir specifies which direction z lives in. */
-double triplet_correlator(lattice* l, fields const* f, int d, int dir) {
-
+/* Sum of a[z] b[z+d] over z, accounting for periodicity */
+static double plane_correlator(double const* a, double const* b, int L, int d) {
   double res = 0.0;
-
-  for (int z=0; z<l->L[dir]; z++) {
-
-    // coordinate at distance d, accounting for periodicity
-    int zd = (z + d) % l->L[dir];
-
-    double s1 = plane_sum(tripletsq, f->su2triplet, l, z, dir);
-    double s2 = plane_sum(tripletsq, f->su2triplet, l, zd, dir);
-
-    res += s1 * s2;
+  for (int z=0; z<L; z++) {
+    res += a[z] * b[(z + d) % L];
   }
-
-  return res / ((double) l->vol);
-
+  return res;
 }
 
-/* Calculate  sum_{x1,x2} Tr Sigma * F_{12}, which goes over
-* to 2 / sqrt(beta) * \int d^2x Tr Sigma F_{12}
-* in the cont. limit. Here F_{12} is calculated from the clover-improved plaquette.
-* Should give better continuum limit. */
-complex projected_photon_operator(lattice* l, fields const* f, int z, int dir, int* mom) {
-
-  // momentum is quantized in all directions, (k1, k2, k3) = 2pi(n1/L1, n2/L2, n3/L3)
-  // with n_i being integers. the input mom[i] = n_i
 
-  complex res;
-  res.re = 0.0; res.im = 0.0;
+#ifdef TRIPLET
 
-  // pre-calculate the sines and cosines??
+/* Calculate Tr Sigma * F_{12} at a site, with 1,2 being the directions perpendicular to dir.
+* Summed over a plane this goes over to 2 / sqrt(beta) * \int d^2x Tr Sigma F_{12}
+* in the cont. limit. Here F_{12} is calculated from the clover-improved plaquette.
+* Should give better continuum limit. Only sensible in 3 dimensions. */
+double photon_clover_op(lattice const* l, fields const* f, long site, int dir) {
 
   int dir1, dir2;
   if (dir == 0) {
     dir1 = 1; dir2 = 2;
   } else if (dir == 1) {
     dir1 = 0; dir2 = 2;
-  } else if (dir == 2) {
+  } else {
     dir1 = 0; dir2 = 1;
   }
 
-  long z_node = z - l->offset[dir]; // coordinate on my node
-  int skip = 0;
+  // calculate plaquette clover in dir1, dir2
+  double clov[SU2LINK];
+  clover_su2(l, f, site, dir1, dir2, clov);
 
-  if (z_node < 0 || z_node >= l->sliceL[dir]) {
-    skip = 1; // out of bounds, so my node does not contribute
+  /* calculate field strength from clover O_munu:
+  * g F_munu(x) = -i/8 [(O_munu - O^+_munu) - 1/N Tr(O_munu - O^+_munu) ],
+  * but the trace vanishes for SU(2). */
+  for (int k=1; k<SU2LINK; k++) {
+    clov[k] /= 4.0; // now clov = i g F_munu
   }
-  if (!skip) {
-    for (long xy=0; xy<l->sites_per_coord[dir]; xy++) {
-      long site = l->sites_at_coord[dir][z_node][xy];
-
-      // calculate plaquette clover in dir1, dir2
-      double clov[SU2LINK];
-      clover_su2(l, f, site, dir1, dir2, clov);
-
-      /* calculate field strength from clover O_munu:
-      * g F_munu(x) = -i/8 [(O_munu - O^+_munu) - 1/N Tr(O_munu - O^+_munu) ],
-      * but the trace vanishes for SU(2). */
-
-      clov[0] = 0;
-      for (int k=1; k<SU2LINK; k++) {
-        clov[k] /= 4.0; // now clov = i g F_munu
-      }
-
-      double* a = f->su2triplet[site];
-      // tr <- g Tr Sigma * F_munu, which is real:
-      double tr = a[0]*clov[1] + a[1]*clov[2] + a[2]*clov[3];
-
-      // multiply by exp(ip.k):
-      double px = 0.0;
-      for (int momdir=0; momdir<l->dim; momdir++) {
-        if (mom[momdir] != 0) {
-          px += ((double) (mom[momdir] * l->coords[site][momdir])) / ( (double)(l->L[momdir]) );
-        }
-      }
-      /* note that blocked lattices use their own L[dir] and coords here.
-      * For blocking level k, L_k = L / 2^k; x_k = x / 2^k,
-      * so the ratio x / L is the same for all k. */
-
-      res.re += tr * cos(2.0*M_PI * px);
-      res.im += tr * sin(2.0*M_PI * px);
-    }
-  } // end else
 
-  // normalize by area
-  // double area = (double) (l->vol / l->L[dir]);
-
-  res.re = allreduce(res.re, l->comm);
-  res.im = allreduce(res.im, l->comm);
-  return res;
+  double* a = f->su2triplet[site];
+  // g Tr Sigma * F_munu, which is real:
+  return a[0]*clov[1] + a[1]*clov[2] + a[2]*clov[3];
 }
 
-/* Calculate correlation of the projected photon operator above, at distance d. */
-complex projected_photon_correlator(lattice* l, fields const* f, int d, int dir) {
-
-  complex res; res.re = 0.0; res.im = 0.0;
-
-  // dunno how to generalize this to n. dimensions
-  if (l->dim != 3 && l->rank) {
-    printf("Warning: photon correlation function only sensible in 3 dimensions!!\n");
-    return res;
-  }
-
-  // use first nonzero transverse momentum channel
-  int mom[l->dim];
-  if (dir == 0) {
-    mom[1] = 1; mom[0] = 0; mom[2] = 0;
-  } else if (dir == 1 || dir == 2) {
-    mom[0] = 1; mom[1] = 0; mom[2] = 0;
-  }
-
-  for (int z=0; z<l->L[dir]; z++) {
-
-    // coordinate at distance d, accounting for periodicity
-    int zd = (z + d) % l->L[dir];
-
-    complex op1 = projected_photon_operator(l, f, z, dir, mom);
-    complex op2 = projected_photon_operator(l, f, zd, dir, mom);
-
-    // O1.O2*
-    op2.im = -1.0*op2.im;
-    complex prod = cmult(op1, op2);
-    res.re += prod.re;
-    res.im += prod.im;
-  }
-
-  res.re /= (double) (l->vol);
-  res.im /= (double) (l->vol);
-  // imag part should be zero because the correlator is symmetric wrt. z <-> z+d
-
-  return res;
-}
-
-/* Calculate the "full" photon operator in a plane. I use t'Hooft's gauge-invariant operator
+/* Calculate the "full" photon operator at a site. I use t'Hooft's gauge-invariant operator
 * gamma_{ij} = Sigma^a F^a_{ij} - 1/g \eps_{abc} Sigma^a (D_i Sigma)^b (D_j Sigma)^c,
 * where the adjoint scalar Sigma is normalized to unit length (note: gamma_{ij} is antisymmetric).
-* This is calculated in all directions PERPENDICULAR to 'dir' at fixed x_dir = z and averaged.
-* So in practice this routine calculates \sum_{x} \delta_{x_dir, z} \eps_{dir,ij} gamma_{ij}. */
-complex photon_projection_full(lattice* l, fields const* f, params const* p, int z, int dir, int* mom) {
-
+* This is calculated in all directions PERPENDICULAR to 'dir' and summed,
+* so in practice this is \eps_{dir,ij} gamma_{ij}. */
+double photon_alpha_op(lattice const* l, fields const* f, params const* p, long site, int dir) {
 
   /** TEMP: calculate Arttu's lattice alpha_munu instead **/
-
-  complex res;
-  res.re = 0.0; res.im = 0.0;
-
-  long z_node = z - l->offset[dir]; // coordinate on my node
-  int skip = 0;
-
-  if (z_node < 0 || z_node >= l->sliceL[dir]) {
-    skip = 1; // out of bounds, so my node does not contribute
+  double alpha = 0.0;
+  /* loop over all directions except the input 'dir'; calculate
+  * the projected U(1) field strengths and add them without any epsilon tensors */
+  for (int d1=0; d1<l->dim; d1++) {
+    for (int d2=d1+1; d2<l->dim; d2++) {
+      if (d1 == dir || d2 == dir) continue;
+      alpha += alpha_proj(l, f, p, site, d1, d2);
+    }
   }
-  if (!skip) {
-
-    for (long xy=0; xy<l->sites_per_coord[dir]; xy++) {
-      long site = l->sites_at_coord[dir][z_node][xy];
-
-      // momentum (p.x) at this site?
-      double px = 0.0;
-      for (int momdir=0; momdir<l->dim; momdir++) {
-        if (mom[momdir] != 0) {
-          px += ((double) (mom[momdir] * l->coords[site][momdir])) / ( (double)(l->L[momdir]) );
-        }
-      }
-
-      double alpha = 0.0;
-      /* loop over all directions except the input 'dir'; calculate
-      * the projected U(1) field strengths and add them without any epsilon tensors */
-      for (int d1=0; d1<l->dim; d1++) {
-        for (int d2=d1+1; d2<l->dim; d2++) {
-          if (d1 == dir || d2 == dir) continue;
-
-          // remember that alpha_ij is antisymmetric in ij, so multiply by 2 later
-          alpha += alpha_proj(l, f, p, site, d1, d2);
-        }
-      }
-
-      // multiply by exp(ip.k):
-      res.re += 2.0*alpha * cos(2.0*M_PI * px);
-      res.im += 2.0*alpha * sin(2.0*M_PI * px);
-    } // end xy loop
-
-  } // end if (!skip)
-
-  res.re = allreduce(res.re, l->comm);
-  res.im = allreduce(res.im, l->comm);
-  return res;
-
+  // remember that alpha_ij is antisymmetric in ij
+  return 2.0*alpha;
 }
 
+#endif // end if TRIPLET
 
-/* Calculate correlation of the photon at distance d. (more general than the above routine) */
-complex photon_correl(lattice* l, fields const* f, params const* p, int d, int dir, int transmom, int mode) {
 
-  complex res; res.re = 0.0; res.im = 0.0;
+/* Calculate the plane operators for all z = 0, ..., L[dir]-1 in a single pass over my sites
+* and sum them over nodes with one collective. Only the root node gets the result.
+* Photon operators are projected to transverse momentum k = 2pi n / L in the first direction
+* other than dir, with n = 1, 2: O(z) = \sum_{x,y} O(x,y,z) exp(ik.x). */
+static void measure_planes(lattice const* l, fields const* f, params const* p, int dir,
+      plane_ops const* ops, double** planes) {
 
-  // mode == 0 operator requires dim = 3, mode == 1 always works
-  if (l->dim != 3 && l->rank) {
-    printf("Warning: photon correlation function only sensible in 3 dimensions!!\n");
-    return res;
+  int L = l->L[dir];
+  for (int op=0; op<ops->n_ops; op++) {
+    for (int z=0; z<L; z++) planes[op][z] = 0.0;
   }
 
-  // use a momentum channel in the first transverse direction
-  int mom[l->dim];
-  for (int dir0=0; dir0<l->dim; dir0++) mom[dir0] = 0;
+  #ifdef TRIPLET
+    // momentum direction. Note that blocked lattices use their own L and coords here,
+    // but the ratio x / L is the same on all blocking levels
+    int momdir = (dir == 0) ? 1 : 0;
+  #endif
 
-  for (int dir0=0; dir0<l->dim; dir0++) {
-    if (dir0 != dir) mom[dir0] = transmom;
-    break;
-  }
+  for (long z_node=0; z_node<l->sliceL[dir]; z_node++) {
+    int z = z_node + l->offset[dir];
 
-  for (int z=0; z<l->L[dir]; z++) {
+    for (long xy=0; xy<l->sites_per_coord[dir]; xy++) {
+      long site = l->sites_at_coord[dir][z_node][xy];
 
-    // coordinate at distance d, accounting for periodicity
-    int zd = (z + d) % l->L[dir];
+      #if (NHIGGS > 0)
+        planes[ops->higgs][z] += doubletsq(f->su2doublet[0][site]);
+      #endif
 
-    complex op1, op2;
-    if (mode==0) {
-      op1 = projected_photon_operator(l, f, z, dir, mom);
-      op2 = projected_photon_operator(l, f, zd, dir, mom);
-    } else {
-      op1 = photon_projection_full(l, f, p, z, dir, mom);
-      op2 = photon_projection_full(l, f, p, zd, dir, mom);
-    }
+      #ifdef TRIPLET
+        planes[ops->trip][z] += tripletsq(f->su2triplet[site]);
+
+        double op[2];
+        // mode == 0 operator requires dim = 3, mode == 1 always works
+        op[0] = (l->dim == 3) ? photon_clover_op(l, f, site, dir) : 0.0;
+        op[1] = photon_alpha_op(l, f, p, site, dir);
+
+        double px = 2.0*M_PI * ((double) l->coords[site][momdir]) / ((double) l->L[momdir]);
+        for (int pp=0; pp<2; pp++) {
+          double c = cos((pp+1) * px);
+          double s = sin((pp+1) * px);
+          for (int mode=0; mode<2; mode++) {
+            planes[ops->phot[mode][pp]][z] += op[mode] * c;
+            planes[ops->phot[mode][pp] + 1][z] += op[mode] * s;
+          }
+        }
+      #endif
+    } // end xy
+  } // end z_node
 
-    // O1.O2*
-    op2.im = -1.0*op2.im;
-    complex prod = cmult(op1, op2);
-    res.re += prod.re;
-    res.im += prod.im;
+  // planes were allocated with make_field, so they are contiguous
+  if (ops->n_ops > 0) {
+    reduce_sum_array(planes[0], ops->n_ops * L, l->comm);
   }
-
-  res.re /= (double) (l->vol);
-  res.im /= (double) (l->vol);
-  // imag part should be zero because the correlator is symmetric wrt. z <-> z+d
-
-  return res;
 }
 
 
-
-#endif // end if TRIPLET
-
-
 void print_labels_correlators() {
 
   int k = 1;
@@ -336,87 +212,86 @@ void print_labels_correlators() {
 
 }
 
+/* Measure correlators along direction dir for all distances d < L[dir]/2.
+* The plane operators are calculated once for each z and combined on the root node,
+* so this costs one pass over the lattice and one reduction regardless of L[dir]. */
 void measure_correlators(char* fname, lattice* l, fields const* f, params const* p, int dir, int meas_id) {
 
-  FILE* file;
+  plane_ops ops;
+  set_plane_ops(&ops);
+
+  #ifdef TRIPLET
+    if (l->dim != 3) {
+      printf0("Warning: photon correlation function only sensible in 3 dimensions!!\n");
+    }
+  #endif
+
+  int L = l->L[dir];
+  double** planes = make_field(ops.n_ops > 0 ? ops.n_ops : 1, L);
+  measure_planes(l, f, p, dir, &ops, planes);
 
   if (!l->rank) {
-		file = fopen(fname, "a");
+    FILE* file = fopen(fname, "a");
     // write header for the current set of measurements
     fprintf(file, "\n =========== Measurement id: %d ===========\n", meas_id);
-	}
-
-  // no point measuring along the full length on a periodic lattice
-  int max_distance = l->L[dir] / 2;
-
-  for (int d=0; d<max_distance; d++) {
-    #if (NHIGGS > 0)
-      double hcorr = higgs_correlator(l, f, d, dir, 0);
-    #endif
-    #ifdef TRIPLET
-      double tripcorr = triplet_correlator(l, f, d, dir);
-      // complex photoncorr = projected_photon_correlator(l, f, d, dir);
-      int mode = 0;
-      complex phot01 = photon_correl(l, f, p, d, dir, 1, mode);
-      complex phot02 = photon_correl(l, f, p, d, dir, 2, mode);
-      mode = 1;
-      complex phot11 = photon_correl(l, f, p, d, dir, 1, mode);
-      complex phot12 = photon_correl(l, f, p, d, dir, 2, mode);
-    #endif
-
-    // write
-    if (!l->rank) {
+
+    double vol = (double) l->vol;
+    // no point measuring along the full length on a periodic lattice
+    int max_distance = L / 2;
+
+    for (int d=0; d<max_distance; d++) {
       fprintf(file, "%d ", d);
       #if (NHIGGS > 0)
-        fprintf(file, "%g ", hcorr);
+        // doubletsq measures 0.5 Tr Phi^+ Phi, so multiply by 4 to get H(l)
+        double* h = planes[ops.higgs];
+        fprintf(file, "%g ", 4.0 * plane_correlator(h, h, L, d) / vol);
       #endif
       #ifdef TRIPLET
-        fprintf(file, "%g ", tripcorr);
-        // fprintf(file, "%g %g ", photoncorr.re, photoncorr.im);
-        fprintf(file, "%g %g %g %g ", phot01.re, phot01.im, phot02.re, phot02.im);
-        fprintf(file, "%g %g %g %g ", phot11.re, phot11.im, phot12.re, phot12.im);
+        double* s = planes[ops.trip];
+        fprintf(file, "%g ", plane_correlator(s, s, L, d) / vol);
+        for (int mode=0; mode<2; mode++) {
+          for (int pp=0; pp<2; pp++) {
+            double* re = planes[ops.phot[mode][pp]];
+            double* im = planes[ops.phot[mode][pp] + 1];
+            // O(z) O(z+d)^*. Imag part should be zero because the correlator is symmetric wrt. z <-> z+d
+            double corr_re = plane_correlator(re, re, L, d) + plane_correlator(im, im, L, d);
+            double corr_im = plane_correlator(im, re, L, d) - plane_correlator(re, im, L, d);
+            fprintf(file, "%g %g ", corr_re / vol, corr_im / vol);
+          }
+        }
       #endif
 
       fprintf(file, "\n");
-    }
-  } // end d
+    } // end d
 
-  if (!l->rank) {
     fclose(file);
   }
 
+  free_field(planes);
 }
 
 
 #ifdef BLOCKING
-/* Smear fields and calculate the correlators on a blocked lattice 'b' */
+/* Smear fields and calculate the correlators on a blocked lattice 'b'.
+* Smearing is done while transferring the fields to the blocked lattice, see make_blocked_fields().
+* Replicated blocked lattices are measured on the root node only. */
 void measure_blocked_correlators(lattice* l, lattice* b, fields const* f, fields* f_b, params const* p,
       int const* block_dir, int dir, int id) {
 
   if (block_dir[dir] && !l->rank) {
     printf("Warning: calculating correlation lengths in a blocked direction\n");
   }
-  fields f_smear;
-  alloc_fields(l, &f_smear);
 
-  #if (NHIGGS > 0)
-    printf("Error in correlation.c: Higgs smearing not yet implemented!!!\n");
-    free_fields(l, &f_smear);
-    return;
-  #endif
-
-  smear_fields(l, f, &f_smear, block_dir);
-  // transfer the smeared fields on the blocked lattice:
-  make_blocked_fields(l, b, &f_smear, f_b);
+  // smear and transfer the fields to the blocked lattice:
+  int smear = 1;
+  make_blocked_fields(l, b, f, f_b, block_dir, smear);
   // then measure correlators along dir
   char fname[100];
   sprintf(fname, "correl%d", b->blocking_level);
-  if (!b->standby) {
+  if (!b->replicated || !myRank) {
     measure_correlators(fname, b, f_b, p, dir, id);
   }
 
-  free_fields(l, &f_smear);
-
 }
 #endif
 
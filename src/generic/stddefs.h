@@ -23,10 +23,6 @@ int MPISize; // also 'l.size'
 	#warning !!! TRIPLET with N>1 Higgs doublets not implemented !!!
 #elif (NHIGGS > 1) && defined (SINGLET)
 	#warning !!! SINGLET with N>1 Higgs doublets not implemented !!!
-#elif ( (NHIGGS > 0) || defined (SINGLET)) && defined (GRADFLOW)
-	#warning !!! Gradient flow not implemented for all fields !!!
-#elif ( (NHIGGS > 0) || defined (SINGLET)) && defined (BLOCKING)
-	#warning !!! Blocking not implemented for all fields !!!
 #endif
 
 /* If using blocking, need larger halos because of link smearing in su2u1.c */
@@ -48,6 +44,14 @@ int MPISize; // also 'l.size'
 #define HEATBATH 2 // Heatbath
 #define OVERRELAX 3 // Overrelaxation
 
+// gradient flow integrators
+#define FLOW_EULER 0
+#define FLOW_RK3 1 // third order Runge-Kutta
+
+// molecular dynamics integrators for hybrid Monte Carlo
+#define HMC_LEAPFROG 0
+#define HMC_OMELYAN 1 // second order minimum norm
+
 // parity identifiers
 #define EVEN 0
 #define ODD 1
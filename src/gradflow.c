@@ -5,7 +5,8 @@
 * References: 0907.5491, 1006.4518.
 *
 * Measurements are are stored in "measure_flow". First column is the (dimensionless)
-* time and the other columns follow the same pattern as in "labels".
+* time and the other columns follow the same pattern as in "labels", or "labels_flow"
+* if flow_observables is not "full".
 *
 * Plan is to first calculate the gradient force at time t on all fields everywhere,
 * then update all fields to time t + dt. This way the ordering of updates does not matter.
@@ -14,8 +15,10 @@
 *   (d/dt) V_t(x,mu) = -g^2 [\partial_{x,mu} S(V_t)] V_t(x,mu)
 * with V_t(x,mu) = U_mu(x) at t=0. Here S(V_t) is the action due to the gauge
 * link V_t(x,mu), and the derivative can be calculated as a projection as in
-* 0907.5491. Here I use the "Euler" scheme for integrating the flow, so the derivative
-* is assumed to be a constant in the interval [t, t+dt]
+* 0907.5491. The flow is integrated either with the "Euler" scheme, where the derivative
+* is assumed to be a constant in the interval [t, t+dt], or with the third order
+* Runge-Kutta scheme of 1006.4518, optionally with adaptive step size (flow_integrator
+* and flow_tolerance in the config).
 *
 * Note: the time \tau here is dimensionless, while the "physical" time is t
 * (smoothing happens in a radius of \sqrt{2*d*t} in d dimensions ). For these to be
@@ -27,152 +30,560 @@
 *   d\phi^a / d\tau = - dS/d\phi^a
 * gives the correct continuum limit for \tau = a^{-2} t.
 *
-* TODO: Add Higgs!!
+* All fields are flowed: SU(2) and U(1) links, doublets, triplet and singlet.
+* UV counterterms are removed from the scalar masses during the flow, see remove_counterterms().
 *
 */
 
-#ifdef GRADFLOW // do nothing if compiler flag is not set
+/* The gradient forces and the field update routines are also used by
+* hybrid Monte Carlo (hmc.c), so compile those if either flag is set */
+#if defined(GRADFLOW) || defined(HMC) // do nothing if compiler flags are not set
 
 #include "su2.h"
 
+#ifdef GRADFLOW
+
+
+/* Lightweight observables measured along the flow. Each returns the value at site i,
+* and the volume average is taken in measure_flow_observables(). To add a new observable,
+* write a function of this type and add it to flow_registry below.
+* Energy densities are E = 1/4 G^a_ij G^a_ij with G = gF, in lattice units,
+* so that t^2 <E> is dimensionless in units of the flow time t. */
+
+/* Plaquette discretization: E = 2 \sum_{i<j} Re Tr (1 - P_ij) */
+static double flowobs_plaq(lattice const* l, fields const* f, params const* p, long i) {
+  double res = 0.0;
+  for (int d1=0; d1<l->dim; d1++) {
+    for (int d2=d1+1; d2<l->dim; d2++) {
+      res += 2.0 - su2ptrace(l, f, i, d1, d2);
+    }
+  }
+  return 2.0 * res;
+}
+
+/* Clover discretization: G^a_ij = clov^a_ij / 2, see clover_su2() */
+static double flowobs_clover(lattice const* l, fields const* f, params const* p, long i) {
+  double res = 0.0;
+  double clov[SU2LINK];
+  for (int d1=0; d1<l->dim; d1++) {
+    for (int d2=d1+1; d2<l->dim; d2++) {
+      clover_su2(l, f, i, d1, d2, clov);
+      res += clov[1]*clov[1] + clov[2]*clov[2] + clov[3]*clov[3];
+    }
+  }
+  return 0.125 * res;
+}
+
+#ifdef U1
+static double flowobs_u1plaq(lattice const* l, fields const* f, params const* p, long i) {
+  return local_u1wilson(l, f, p, i) / p->betau1;
+}
+#endif
+
+#if (NHIGGS > 0)
+static double flowobs_phisq(lattice const* l, fields const* f, params const* p, long i) {
+  return doubletsq(f->su2doublet[0][i]);
+}
+#endif
+
+#if (NHIGGS == 2)
+static double flowobs_phi2sq(lattice const* l, fields const* f, params const* p, long i) {
+  return doubletsq(f->su2doublet[1][i]);
+}
+#endif
+
+#ifdef TRIPLET
+static double flowobs_Sigmasq(lattice const* l, fields const* f, params const* p, long i) {
+  return tripletsq(f->su2triplet[i]);
+}
+#endif
+
+#ifdef SINGLET
+static double flowobs_S(lattice const* l, fields const* f, params const* p, long i) {
+  return f->singlet[i][0];
+}
+
+static double flowobs_Ssq(lattice const* l, fields const* f, params const* p, long i) {
+  return f->singlet[i][0] * f->singlet[i][0];
+}
+#endif
+
+typedef struct {
+  char* name; // name used in the config file
+  char* label; // label in labels_flow
+  double (*funct)(lattice const* l, fields const* f, params const* p, long i);
+  int is_default; // measured with "flow_observables default"
+} flow_observable;
+
+// flowobs_plaq must stay first, it is also used for the t^2 <E> stopping criterion
+static flow_observable flow_registry[] = {
+  {"plaq", "E (plaquette)", flowobs_plaq, 1},
+  {"clover", "E (clover)", flowobs_clover, 1},
+  #ifdef U1
+    {"u1plaq", "U(1) Wilson (divided by beta)", flowobs_u1plaq, 0},
+  #endif
+  #if (NHIGGS > 0)
+    {"phisq", "phi^2", flowobs_phisq, 1},
+  #endif
+  #if (NHIGGS == 2)
+    {"phi2sq", "phi2^2", flowobs_phi2sq, 1},
+  #endif
+  #ifdef TRIPLET
+    {"Sigmasq", "Sigma^2", flowobs_Sigmasq, 1},
+  #endif
+  #ifdef SINGLET
+    {"S", "S", flowobs_S, 1},
+    {"Ssq", "S^2", flowobs_Ssq, 0},
+  #endif
+};
+
+static const int n_flow_registry = sizeof(flow_registry) / sizeof(flow_registry[0]);
+
+
+/* Choose what to measure along the flow, based on p->flow_observables which is
+* "full" (everything in measure(), labels as in 'labels'), "default", or a comma
+* separated list of names in flow_registry. Writes labels_flow for the latter two. */
+static void init_flow_observables(lattice const* l, params const* p, flow_context* ctx) {
+
+  ctx->n_obs = 0;
+  ctx->obs = malloc(n_flow_registry * sizeof(*(ctx->obs)));
+  ctx->full_meas = !strcasecmp(p->flow_observables, "full");
+  if (ctx->full_meas) return;
+
+  if (!strcasecmp(p->flow_observables, "default")) {
+    for (int j=0; j<n_flow_registry; j++) {
+      if (flow_registry[j].is_default) {
+        ctx->obs[ctx->n_obs] = j;
+        ctx->n_obs++;
+      }
+    }
+  } else {
+    char list[200];
+    strncpy(list, p->flow_observables, sizeof(list)-1);
+    list[sizeof(list)-1] = '\0';
+
+    for (char* name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+      int found = 0;
+      for (int j=0; j<n_flow_registry; j++) {
+        if (!strcasecmp(name, flow_registry[j].name)) {
+          if (ctx->n_obs < n_flow_registry) {
+            ctx->obs[ctx->n_obs] = j;
+            ctx->n_obs++;
+          }
+          found = 1;
+          break;
+        }
+      }
+      if (!found) {
+        printf0("WARNING: Unknown observable '%s' in flow_observables, ignoring. Available: full", name);
+        for (int j=0; j<n_flow_registry; j++) printf0(" %s", flow_registry[j].name);
+        printf0("\n");
+      }
+    }
+  }
+
+  if (!l->rank) {
+    FILE* f = fopen("labels_flow", "w");
+    int k = 1;
+    fprintf(f, "%d flow time\n", k); k++;
+    for (int m=0; m<ctx->n_obs; m++) {
+      fprintf(f, "%d %s\n", k, flow_registry[ctx->obs[m]].label); k++;
+    }
+    fclose(f);
+  }
+}
+
+/* Volume averages of the selected flow observables in one pass over the lattice
+* and one reduction. res[m] is observable ctx->obs[m], and res[n_obs] is always
+* the plaquette energy density. All nodes get the result. */
+static void measure_flow_observables(lattice const* l, fields const* f, params const* p,
+      flow_context const* ctx, double* res) {
+
+  int n = ctx->n_obs;
+  for (int m=0; m<=n; m++) res[m] = 0.0;
+
+  for (long i=0; i<l->sites; i++) {
+    for (int m=0; m<n; m++) {
+      res[m] += flow_registry[ctx->obs[m]].funct(l, f, p, i);
+    }
+    res[n] += flowobs_plaq(l, f, p, i);
+  }
+
+  allreduce_array(res, n+1, l->comm);
+  for (int m=0; m<=n; m++) res[m] /= l->vol;
+}
+
+
+/* Measure the flowed fields at flow time t. Local measurements are numbered with *local_id.
+* Returns the plaquette energy density <E>. */
+static double measure_flowed(lattice* l, flow_context* ctx, params* p, weight* w, results_buffer* out,
+      FILE* file, double t, int flow_id, int* local_id) {
+
+  fields const* flow = &ctx->flow;
+  double res[n_flow_registry + 1];
+
+  if (!l->rank) {
+    fprintf(file, "%.6lf ", t); // first column is time, rest come from measure() or flow_registry
+  }
+
+  if (ctx->full_meas) {
+    measure(out, l, flow, p, w);
+    if (p->flow_t2E_max > 0.0) {
+      measure_flow_observables(l, flow, p, ctx, res); // only E
+    } else {
+      res[0] = 0.0;
+    }
+  } else {
+    measure_flow_observables(l, flow, p, ctx, res);
+    if (!l->rank) {
+      for (int m=0; m<ctx->n_obs; m++) fprintf(file, "%.12g ", res[m]);
+      fprintf(file, "\n");
+    }
+  }
+
+  if (p->do_local_meas) {
+    char fname[200];
+    sprintf(fname, "measure_local_%d_%d", flow_id, *local_id); // append id to fname
+
+    measure_local(fname, l, flow, p);
+    (*local_id)++;
+  }
+  return res[ctx->n_obs];
+}
+
+
+/* Allocate work fields for gradient flow. Only the fields needed by
+* the integrator chosen in the config are allocated. */
+void init_flow(lattice const* l, params const* p, flow_context* ctx) {
+
+  ctx->rk3 = (p->flow_integrator == FLOW_RK3);
+  ctx->adaptive = ctx->rk3 && (p->flow_tolerance > 0.0);
+
+  alloc_fields(l, &ctx->flow);
+  alloc_fields(l, &ctx->forces);
+  if (ctx->rk3) alloc_fields(l, &ctx->acc);
+  if (ctx->adaptive) {
+    alloc_fields(l, &ctx->err);
+    alloc_fields(l, &ctx->start);
+  }
+
+  init_flow_observables(l, p, ctx);
+
+  #if (NHIGGS == 2)
+    printf0("WARNING: gradient flow keeps the lattice mass counterterms of the doublets, see remove_counterterms()\n");
+  #elif (NHIGGS == 1) && defined(TRIPLET) && defined(U1)
+    printf0("WARNING: U(1) contributions to doublet-triplet counterterms are not removed in gradient flow\n");
+  #endif
+}
+
+void free_flow(lattice const* l, flow_context* ctx) {
+
+  if (ctx->adaptive) {
+    free_fields(l, &ctx->start);
+    free_fields(l, &ctx->err);
+  }
+  if (ctx->rk3) free_fields(l, &ctx->acc);
+  free_fields(l, &ctx->forces);
+  free_fields(l, &ctx->flow);
+  free(ctx->obs);
+}
+
 
 /* Do a "real time" gradient flow of the fields and measure stuff
 * as a function of the time.
 * flow_id is an identifier for the current flow and is used as a "header"
 * in the measurement file.
 * Requires a "weight" struct to be compatible with measure().
-* This does not modify the original field config.
+* This does not modify the original field config. All work fields are taken from
+* 'ctx', so consecutive flows (of the same or different configurations) reuse the same memory.
+*
+* Measurements are done at times t = n * flow_meas_interval * dt and at t_max.
+* Either the full measure() or a cheaper set of observables is used, see init_flow_observables().
+* If flow_t2E_max > 0, the flow stops at the first measurement with t^2 <E> >= flow_t2E_max.
+* With the RK3 integrator and flow_tolerance > 0 the step size is adapted (see flow_step_rk3()),
+* starting from dt, but steps are always cut short to land exactly on the measurement times.
 */
 void grad_flow(lattice* l, fields const* f, params* p,
-                  weight* w, double t_max, double dt, int flow_id) {
-
-  fields flow; // flowing fields
-  fields forces; // gradient forces for each field
+                  weight* w, flow_context* ctx, double t_max, double dt, int flow_id) {
 
-  alloc_fields(l, &flow);
-  alloc_fields(l, &forces);
+  fields* flow = &ctx->flow;
+  int rk3 = ctx->rk3;
+  int adaptive = ctx->adaptive;
 
   // copy starting configuration to "flow"
-  copy_fields(l, f, &flow);
-  sync_halos(l, &flow); // initialize halos in "flow"
+  copy_fields(l, f, flow);
+  sync_halos(l, flow); // initialize halos in "flow"
 
+  /* Backup lattice masses and remove UV counterterms */
+  #if (NHIGGS == 1)
+    double msq_phi = p->msq_phi;
+  #endif
   #ifdef TRIPLET
-    /* Backup lattice masses and remove UV counterterms */
     double msq = p->msq_triplet;
-    remove_counterterms(p);
   #endif
+  #ifdef SINGLET
+    double msq_s = p->msq_s, b1_s = p->b1_s;
+  #endif
+  remove_counterterms(p);
 
 
-  FILE* file;
+  FILE* file = NULL;
   if (!l->rank) {
     file = fopen("measure_flow", "a");
     // write header for the current set of measurements
     fprintf(file, "\n =========== Flow id: %d ===========\n", flow_id);
   }
+  // flow measurements are always written as text
+  results_buffer out;
+  init_results(&out, file, 0, 0);
 
   int local_id = 1;
 
   double t = 0.0;
   // initial measurements at flow time t = 0
-  if (!l->rank) {
-    fprintf(file, "%.6lf ", t); // first column is time, rest come from measure()
-  }
-  measure(file, l, &flow, p, w);
-  if (p->do_local_meas) {
-    char fname[200];
-    sprintf(fname, "measure_local_%d_%d", flow_id, local_id); // append id to fname
+  measure_flowed(l, ctx, p, w, &out, file, t, flow_id, &local_id);
 
-    measure_local(fname, l, &flow, p);
-    local_id++;
-  }
+  double meas_dt = p->flow_meas_interval * dt;
+  // steps shorter than this are rounding errors from accumulating t
+  double t_eps = 1e-9 * dt;
+  double step = dt;
 
-  /* "time" loop */
-  int iter = 1;
-  while (t < t_max) {
+  /* "time" loop, measure at the end of each pass */
+  for (int n_meas=1; t < t_max - t_eps; n_meas++) {
 
+    double t_target = n_meas * meas_dt;
     // if time after updating surpasses t_max, calculate only up to t_max
-    if (t + dt > t_max) {
-      dt = t_max - t;
+    if (t_target > t_max) t_target = t_max;
+
+    while (t < t_target - t_eps) {
+
+      double h = step;
+      int truncated = 0;
+      if (t + h > t_target - t_eps) {
+        h = t_target - t;
+        truncated = 1;
+      }
+
+      if (!rk3) {
+        flow_step_euler(l, flow, p, &ctx->forces, h);
+        t += h;
+        continue;
+      }
+
+      if (!adaptive) {
+        flow_step_rk3(l, flow, p, &ctx->forces, &ctx->acc, NULL, NULL, h);
+        t += h;
+        continue;
+      }
+
+      copy_fields(l, flow, &ctx->start);
+      double dist = flow_step_rk3(l, flow, p, &ctx->forces, &ctx->acc, &ctx->err, &ctx->start, h);
+
+      /* new step size from the third order error estimate dist ~ h^3,
+      * with a safety factor and limits to avoid wild oscillations */
+      double scale = (dist > 0.0) ? 0.95 * cbrt(p->flow_tolerance / dist) : 2.0;
+      if (scale > 2.0) scale = 2.0;
+      if (scale < 0.2) scale = 0.2;
+
+      if (dist > p->flow_tolerance) {
+        // reject and retry from the same time with smaller step. start includes halos
+        copy_fields(l, &ctx->start, flow);
+        step = h * scale;
+        continue;
+      }
+
+      t += h;
+      // a step cut short to hit a measurement time tells little about the optimal step size
+      if (!truncated || h * scale > step) {
+        step = h * scale;
+      }
+    } // end step loop
+
+    t = t_target;
+    double oldact = Global_current_action;
+    double E = measure_flowed(l, ctx, p, w, &out, file, t, flow_id, &local_id);
+
+    // debug. Global_current_action is only updated by the full measure()
+    if (ctx->full_meas && Global_current_action > oldact) {
+      printf0("WARNING: gradient flow did not reduce action!! old act = %lf, new act = %lf\n", oldact, Global_current_action);
     }
 
-    calc_gradient(l, &flow, p, &forces);
+    // stop once the reference scale t^2 <E> = flow_t2E_max has been passed
+    if (p->flow_t2E_max > 0.0 && t*t*E >= p->flow_t2E_max) {
+      break;
+    }
 
-    /* update everything. Halos can be synced afterwards,
-     * because the force is known already. */
-    flow_gauge(l, &flow, &forces, dt); // SU(2) gauge links
+  } // end t loop
 
-    #if (NHIGGS > 0)
 
-    #endif
+  if (!l->rank) {
+    fclose(file);
+  }
 
-    #ifdef TRIPLET
-      flow_triplet(l, &flow, &forces, dt);
-    #endif
+  // restore the UV counterterms
+  #if (NHIGGS == 1)
+    p->msq_phi = msq_phi;
+  #endif
+  #ifdef TRIPLET
+    p->msq_triplet = msq;
+  #endif
+  #ifdef SINGLET
+    p->msq_s = msq_s;
+    p->b1_s = b1_s;
+  #endif
+
+}
+
+
+/* Flow all fields one step forward with the first order Euler scheme,
+* i.e. the force is assumed to be a constant in the interval [t, t+dt]. */
+void flow_step_euler(lattice* l, fields* flow, params const* p, fields* forces, double dt) {
 
+  calc_gradient(l, flow, p, forces);
 
-    sync_halos(l, &flow);
+  /* update everything. Halos can be synced afterwards,
+   * because the force is known already. */
+  flow_fields(l, flow, forces, dt);
 
-    t += dt;
+  sync_halos(l, flow);
+}
+
+
+/* acc <- a*acc + b*forces for all flowing fields (not halos).
+* a = 0 overwrites acc, so it does not need to be initialized. */
+static void flow_accumulate(lattice const* l, fields* acc, fields const* forces, double a, double b) {
 
-    if (iter % p->flow_meas_interval == 0) {
-      // measure
-      if (!l->rank) {
-        fprintf(file, "%.6lf ", t);
+  for (long i=0; i<l->sites; i++) {
+    for (int dir=0; dir<l->dim; dir++) {
+      // link forces are adjoint vectors in components 1,2,3
+      for (int k=1; k<SU2LINK; k++) {
+        acc->su2link[i][dir][k] = (a == 0.0 ? 0.0 : a * acc->su2link[i][dir][k]) + b * forces->su2link[i][dir][k];
       }
-      double oldact = Global_current_action;
-      measure(file, l, &flow, p, w);
-      if (p->do_local_meas) {
-        char fname[200];
-        sprintf(fname, "measure_local_%d_%d", flow_id, local_id); // append id to fname
-
-        measure_local(fname, l, &flow, p);
-        local_id++;
+    }
+
+    #ifdef U1
+      for (int dir=0; dir<l->dim; dir++) {
+        acc->u1link[i][dir] = (a == 0.0 ? 0.0 : a * acc->u1link[i][dir]) + b * forces->u1link[i][dir];
       }
+    #endif
 
-      // debug
-      if (Global_current_action > oldact) {
-        printf0("WARNING: gradient flow did not reduce action!! old act = %lf, new act = %lf\n", oldact, Global_current_action);
+    #if (NHIGGS > 0)
+      for (int db=0; db<NHIGGS; db++) {
+        for (int k=0; k<SU2DB; k++) {
+          acc->su2doublet[db][i][k] = (a == 0.0 ? 0.0 : a * acc->su2doublet[db][i][k]) + b * forces->su2doublet[db][i][k];
+        }
       }
+    #endif
 
-    }
+    #ifdef TRIPLET
+      for (int k=0; k<SU2TRIP; k++) {
+        acc->su2triplet[i][k] = (a == 0.0 ? 0.0 : a * acc->su2triplet[i][k]) + b * forces->su2triplet[i][k];
+      }
+    #endif
 
-    iter++;
+    #ifdef SINGLET
+      acc->singlet[i][0] = (a == 0.0 ? 0.0 : a * acc->singlet[i][0]) + b * forces->singlet[i][0];
+    #endif
+  }
+}
 
-  } // end t loop
+/* Distance between the flowed fields and the fields obtained by flowing 'start' with
+* the increments in 'incr' (as in flow_gauge() with dt = 1). Returns the maximum over all links
+* and scalars, using the Euclidean norm of the link (as a 4-vector) or scalar components. */
+static double flow_distance(lattice* l, fields const* flow, fields const* start, fields const* incr) {
 
-  /* if no measurement of the final configuration was done (because the interval
-  * didn't add up), do it here */
-  if ((iter-1) % p->flow_meas_interval != 0) {
-    // measure
-    if (!l->rank) {
-      fprintf(file, "%g ", t);
-    }
-    measure(file, l, &flow, p, w);
-    if (p->do_local_meas) {
-      char fname[200];
-      sprintf(fname, "measure_local_%d_%d", flow_id, local_id); // append id to fname
+  double dist = 0.0;
+  for (long i=0; i<l->sites; i++) {
+    for (int dir=0; dir<l->dim; dir++) {
+      double u[SU2LINK];
+      su2exp_algebra(&incr->su2link[i][dir][1], 1.0, u);
+      su2rot(u, start->su2link[i][dir]);
 
-      measure_local(fname, l, &flow, p);
-      local_id++;
+      double d = 0.0;
+      for (int k=0; k<SU2LINK; k++) {
+        double diff = u[k] - flow->su2link[i][dir][k];
+        d += diff*diff;
+      }
+      if (d > dist) dist = d;
+
+      #ifdef U1
+        // compare U(1) links as complex numbers, so that the distance is periodic
+        double diff = 2.0*sin(0.5*(start->u1link[i][dir] + incr->u1link[i][dir] - flow->u1link[i][dir]));
+        if (diff*diff > dist) dist = diff*diff;
+      #endif
     }
-  }
 
+    #if (NHIGGS > 0)
+      for (int db=0; db<NHIGGS; db++) {
+        double d = 0.0;
+        for (int k=0; k<SU2DB; k++) {
+          double diff = start->su2doublet[db][i][k] + incr->su2doublet[db][i][k] - flow->su2doublet[db][i][k];
+          d += diff*diff;
+        }
+        if (d > dist) dist = d;
+      }
+    #endif
+
+    #ifdef TRIPLET
+      double d = 0.0;
+      for (int k=0; k<SU2TRIP; k++) {
+        double diff = start->su2triplet[i][k] + incr->su2triplet[i][k] - flow->su2triplet[i][k];
+        d += diff*diff;
+      }
+      if (d > dist) dist = d;
+    #endif
 
-  if (!l->rank) {
-    fclose(file);
+    #ifdef SINGLET
+      double diff_s = start->singlet[i][0] + incr->singlet[i][0] - flow->singlet[i][0];
+      if (diff_s*diff_s > dist) dist = diff_s*diff_s;
+    #endif
   }
 
-  free_fields(l, &forces);
-  free_fields(l, &flow);
+  return allreduce_max(sqrt(dist), l->comm);
+}
 
-  #ifdef TRIPLET
-    // restore the UV counterterms
-    p->msq_triplet = msq;
-  #endif
+/* Flow all fields one step forward with the low-storage third order Runge-Kutta scheme of 1006.4518:
+*   W_1 = exp(1/4 Z_0) W_0,
+*   W_2 = exp(8/9 Z_1 - 17/36 Z_0) W_1,
+*   W_3 = exp(3/4 Z_2 - 8/9 Z_1 + 17/36 Z_0) W_2,
+* where Z_i = dt * Z(W_i) and exp acts additively on the scalars. The exponents are built
+* in a single accumulator 'acc', so the cost is three force evaluations and halo syncs per step.
+*
+* If 'err' is not NULL, also builds the second order estimate exp(2 Z_1 - Z_0) W_0
+* as in 1301.4388 and returns its maximal distance from W_3. 'start' must then hold W_0.
+* Otherwise returns 0.
+*/
+double flow_step_rk3(lattice* l, fields* flow, params const* p, fields* forces, fields* acc,
+      fields* err, fields const* start, double dt) {
+
+  /* coefficients for acc <- a_k acc + b_k dt Z(W_k), and the same for the
+  * second order estimate in 'err' */
+  const double a[3] = {0.0, -17.0/9.0, -1.0};
+  const double b[3] = {0.25, 8.0/9.0, 0.75};
+  const double a_err[2] = {0.0, -1.0};
+  const double b_err[2] = {1.0, 2.0};
+
+  for (int k=0; k<3; k++) {
+    calc_gradient(l, flow, p, forces);
+    if (err != NULL && k < 2) {
+      flow_accumulate(l, err, forces, a_err[k], b_err[k] * dt);
+    }
+    flow_accumulate(l, acc, forces, a[k], b[k] * dt);
+
+    flow_fields(l, flow, acc, 1.0);
+    sync_halos(l, flow);
+  }
 
+  if (err != NULL) {
+    return flow_distance(l, flow, start, err);
+  }
+  return 0.0;
 }
 
 
+#endif // GRADFLOW
+
+
 /* Calculate gradient force for the SU(2) link at a given site and direction
 * and store in "force". "f" contains the field configuration at current flow time.
 *
@@ -197,12 +608,14 @@ void grad_force_link(lattice const* l, fields const* f, params const* p, double*
   *
   * which just projects a "staple" onto su(n) algebra.
   * For Wilson action, S is just the staple given by su2staple_wilson().
+  * su2link_staple() also includes the doublet hopping terms, with the Wilson part
+  * normalized as -0.5*beta*su2staple_wilson(), so rescale by 1/4 here.
   */
 
   double s[SU2LINK];
-  su2staple_wilson(l, f, i, dir, s);
+  su2link_staple(l, f, p, i, dir, s);
   for (int a=0; a<SU2LINK; a++) {
-    s[a] *= - p->betasu2 / (8.0);
+    s[a] *= 0.25;
   }
 
 
@@ -329,6 +742,135 @@ void grad_force_triplet(lattice const* l, fields const* f, params const* p, doub
 
 }
 
+#if (NHIGGS > 0)
+/* Calculate gradient force for an SU(2) doublet at a given site.
+* Specifically, calculate components F^a(x) = -(dS)/(d phi^a(x)) and store in "force".
+* The flow is   (d/dt) phi^a(x,t) = F^a(x,t).
+* Hopping terms come from staple_doublet(), which is exactly their derivative
+* because the action is linear in phi(x) there. */
+void grad_force_doublet(lattice const* l, fields const* f, params const* p, double* force, long i, int higgs_id) {
+
+  double res[SU2DB];
+  staple_doublet(res, l, f, p, i, higgs_id);
+
+  double* h = f->su2doublet[higgs_id][i];
+
+  /* local part of the covariant derivative, 2 dim * 0.5 Tr Phi^+ Phi,
+  * and terms in the potential that depend on phi^+ phi only */
+  double dVdmod = 2.0*l->dim;
+
+  #if (NHIGGS == 1)
+    double mod = doubletsq(h);
+    dVdmod += p->msq_phi + 2.0*p->lambda_phi * mod;
+    #ifdef TRIPLET
+      dVdmod += p->a2 * tripletsq(f->su2triplet[i]);
+    #endif
+    #ifdef SINGLET
+      double S = f->singlet[i][0];
+      dVdmod += 0.5*p->a1_s * S + 0.5*p->a2_s * S*S;
+    #endif
+
+    for (int a=0; a<SU2DB; a++) {
+      res[a] += dVdmod * h[a];
+    }
+
+  #elif (NHIGGS == 2)
+    /* 2HDM potential, see higgspotential(). Write it in terms of f11, f22 and
+    * R = Re phi1^+ phi2, I = Im phi1^+ phi2 and use the chain rule */
+    double* h1 = f->su2doublet[0][i];
+    double* h2 = f->su2doublet[1][i];
+    double f11 = doubletsq(h1);
+    double f22 = doubletsq(h2);
+    complex f12 = get_phi12(h1, h2);
+    double R = f12.re; double I = f12.im;
+
+    double dVdR = p->m12sq.re + 2.0*(p->lam4 + p->lam5.re)*R - 2.0*p->lam5.im*I
+                + f11*p->lam6.re + f22*p->lam7.re;
+    double dVdI = -p->m12sq.im + 2.0*(p->lam4 - p->lam5.re)*I - 2.0*p->lam5.im*R
+                - f11*p->lam6.im + f22*p->lam7.im;
+
+    // derivatives of R and I wrt. the components of this doublet
+    double dR[SU2DB], dI[SU2DB];
+    if (higgs_id == 0) {
+      dVdmod += p->msq_phi + 2.0*p->lambda_phi*f11 + p->lam3*f22 + p->lam6.re*R - p->lam6.im*I;
+      dR[0] = 0.5*h2[0]; dR[1] = 0.5*h2[1]; dR[2] = 0.5*h2[2]; dR[3] = 0.5*h2[3];
+      dI[0] = -0.5*h2[3]; dI[1] = -0.5*h2[2]; dI[2] = 0.5*h2[1]; dI[3] = 0.5*h2[0];
+    } else {
+      dVdmod += p->msq_phi2 + 2.0*p->lam2*f22 + p->lam3*f11 + p->lam7.re*R + p->lam7.im*I;
+      dR[0] = 0.5*h1[0]; dR[1] = 0.5*h1[1]; dR[2] = 0.5*h1[2]; dR[3] = 0.5*h1[3];
+      dI[0] = 0.5*h1[3]; dI[1] = 0.5*h1[2]; dI[2] = -0.5*h1[1]; dI[3] = -0.5*h1[0];
+    }
+
+    for (int a=0; a<SU2DB; a++) {
+      res[a] += dVdmod * h[a] + dVdR * dR[a] + dVdI * dI[a];
+    }
+  #endif
+
+  // res[a] is now (dS)/(d phi^a(x)). flip the sign to get "force"
+  for (int a=0; a<SU2DB; a++) {
+    force[a] = -1.0*res[a];
+  }
+}
+#endif // NHIGGS > 0
+
+
+#ifdef SINGLET
+/* Calculate gradient force F(x) = -(dS)/(dS(x)) for the singlet at a given site. */
+double grad_force_singlet(lattice const* l, fields const* f, params const* p, long i) {
+
+  double S = f->singlet[i][0];
+
+  // kinetic term \sum_{x,i} [S(x)^2 - S(x)S(x+i)]
+  double res = 2.0*l->dim * S;
+  for (int dir=0; dir<l->dim; dir++) {
+    res -= f->singlet[ l->next[i][dir] ][0] + f->singlet[ l->prev[i][dir] ][0];
+  }
+
+  // potential, see potential_singlet()
+  res += p->b1_s + p->msq_s * S + p->b3_s * S*S + p->b4_s * S*S*S;
+  #if (NHIGGS == 1)
+    double mod = doubletsq(f->su2doublet[0][i]);
+    res += 0.5*p->a1_s * mod + p->a2_s * S * mod;
+  #endif
+
+  return -1.0*res;
+}
+#endif
+
+
+#ifdef U1
+/* Calculate gradient force for the U(1) link alpha_mu(x) at a given site.
+* For U = exp(i alpha), the Wilson action beta_U1 (1 - cos(r * plaq)) goes over to
+* 1/4 \int F^2 with alpha = a g' B and g'^2 a = 1 / (beta_U1 r^2), so in units of the
+* dimensionless flow time the flow is
+*   (d/dt) alpha_mu(x) = -1/(beta_U1 r^2) dS/d alpha_mu(x).
+* This routine returns the right-hand side. */
+double grad_force_u1link(lattice const* l, fields const* f, params const* p, long i, int dir) {
+
+  double res = 0.0;
+  for (int dir2=0; dir2<l->dim; dir2++) {
+    if (dir2 == dir) continue;
+    // the link enters the plaquette at x with + sign and the one at x - dir2 with - sign
+    res += sin(p->r_u1 * u1ptrace(l, f, i, dir, dir2));
+    res -= sin(p->r_u1 * u1ptrace(l, f, l->prev[i][dir2], dir, dir2));
+  }
+  res *= p->betau1 * p->r_u1;
+
+  #if (NHIGGS > 0)
+    /* hopping terms. These depend on alpha through cos(alpha) and sin(alpha)
+    * so the derivative is obtained by shifting alpha by pi/2 */
+    double** higgs;
+    for (int db=0; db<NHIGGS; db++) {
+      higgs = f->su2doublet[db];
+      res -= hopping_trace_su2u1(higgs[i], f->su2link[i][dir], higgs[l->next[i][dir]],
+              f->u1link[i][dir] + 0.5*M_PI);
+    }
+  #endif
+
+  return -1.0*res / (p->betau1 * p->r_u1 * p->r_u1);
+}
+#endif
+
 /* Calculate gradient force for each field at all sites (not halos)
 * and store in the "fields" array "forces".
 */
@@ -340,20 +882,53 @@ void calc_gradient(lattice const* l, fields const* f, params const* p, fields* f
       /* store force as a "link" matrix. In reality it is an adjoint vector,
       * so the 0. component is not used */
       grad_force_link(l, f, p, forces->su2link[i][dir], i, dir);
+
+      #ifdef U1
+        forces->u1link[i][dir] = grad_force_u1link(l, f, p, i, dir);
+      #endif
     }
 
   #if (NHIGGS > 0)
-
+    for (int db=0; db<NHIGGS; db++) {
+      grad_force_doublet(l, f, p, forces->su2doublet[db][i], i, db);
+    }
   #endif
 
   #ifdef TRIPLET
     grad_force_triplet(l, f, p, forces->su2triplet[i], i);
   #endif
+
+  #ifdef SINGLET
+    forces->singlet[i][0] = grad_force_singlet(l, f, p, i);
+  #endif
   } // end site loop
 
 }
 
 
+/* Calculate u = exp(i dt z_a sigma^a) for an adjoint vector z with 3 components. */
+void su2exp_algebra(double const* z, double dt, double* u) {
+
+  double mod = 0.0;
+  for (int a=0; a<SU2TRIP; a++) {
+    mod += z[a]*z[a];
+  }
+  mod = fabs(dt) * sqrt(mod); // length of the vector dt*z
+
+  if (mod <= 0.0) {
+    u[0] = 1.0; u[1] = 0.0; u[2] = 0.0; u[3] = 0.0;
+    return;
+  }
+
+  /* exp[i dt z_a sigma^a] = exp[i mod n_a sigma^a ]
+  *  with unit vector n_a = dt z_a / mod */
+  u[0] = cos(mod);
+  double s = sin(mod) * dt / mod;
+  for (int a=0; a<SU2TRIP; a++) {
+    u[a+1] = s * z[a];
+  }
+}
+
 /* Flow the SU(2) gauge field one step forward in time.
 * force[i][mu] should give the gradient force on the link U_mu at site i.
 * Here again force[i][mu] is assumed to have 4 components, with the 0. component not used.
@@ -365,31 +940,13 @@ void flow_gauge(lattice const* l, fields* flow, fields const* forces, double dt)
     for (int dir=0; dir<l->dim; dir++) {
       /* d/dt V = (i z_a sigma^a) V
       * => approximate V(t+dt) = exp[i dt*z_a sigma^a ] V(t)
-      * and z_a are in force[i][mu]
+      * and z_a are in force[i][mu]. If the force is zero, exp[...] = 1.
+      * This happens if the matrix U_mu(x).S_mu(x) is Hermitian, or if dt=0.
       */
-      double z[SU2TRIP];
-      double mod = 0.0;
-      for (int a=0; a<SU2TRIP; a++) {
-        z[a] = dt * forces->su2link[i][dir][a+1]; // offset force by 1 since 0-component is placeholder
-        mod += z[a]*z[a];
-      }
-
-      if (mod <= 0.0) {
-        /* force is zero, so the update does nothing.
-        This happens if the matrix U_mu(x).S_mu(x) is Hermitian, or if dt=0 */
-        return;
-      }
-
-      mod = sqrt(mod); // length of the force vector
-
-      /* exp[i z_a sigma^a] = exp[i mod n_a sigma^a ]
-      *  with unit vector n_a = z_a / mod */
       double u[SU2LINK];
-      u[0] = cos(mod);
-      for (int a=0; a<SU2TRIP; a++) {
-        u[a+1] = sin(mod) * z[a] / mod;
-      }
-      // now u = exp[i dt*z_a sigma^a]
+      // offset force by 1 since 0-component is placeholder
+      su2exp_algebra(&forces->su2link[i][dir][1], dt, u);
+
       su2rot(u, flow->su2link[i][dir]); // u <- exp[...].U_mu(x)
 
       memcpy(flow->su2link[i][dir], u, SU2LINK*sizeof(u[0])); // update the flow link
@@ -400,8 +957,9 @@ void flow_gauge(lattice const* l, fields* flow, fields const* forces, double dt)
   // gauge update done
 }
 
-/* Flow the triplet everywhere by one timestep.
-*/
+/* Flow the scalars and U(1) links everywhere by one timestep.
+* These are all additive updates. */
+#ifdef TRIPLET
 void flow_triplet(lattice const* l, fields* flow, fields const* forces, double dt) {
 
   for (long i=0; i<l->sites; i++) {
@@ -412,14 +970,75 @@ void flow_triplet(lattice const* l, fields* flow, fields const* forces, double d
   }
 
 }
+#endif
+
+#if (NHIGGS > 0)
+void flow_doublet(lattice const* l, fields* flow, fields const* forces, double dt) {
+
+  for (int db=0; db<NHIGGS; db++) {
+    for (long i=0; i<l->sites; i++) {
+      for (int a=0; a<SU2DB; a++) {
+        flow->su2doublet[db][i][a] += dt * forces->su2doublet[db][i][a];
+      }
+    }
+  }
+}
+#endif
+
+#ifdef SINGLET
+void flow_singlet(lattice const* l, fields* flow, fields const* forces, double dt) {
+
+  for (long i=0; i<l->sites; i++) {
+    flow->singlet[i][0] += dt * forces->singlet[i][0];
+  }
+}
+#endif
+
+#ifdef U1
+void flow_u1link(lattice const* l, fields* flow, fields const* forces, double dt) {
+
+  for (long i=0; i<l->sites; i++) {
+    for (int dir=0; dir<l->dim; dir++) {
+      flow->u1link[i][dir] += dt * forces->u1link[i][dir];
+    }
+  }
+}
+#endif
+
+/* Flow all fields by one timestep using the forces in 'forces'. Does not sync halos. */
+void flow_fields(lattice const* l, fields* flow, fields const* forces, double dt) {
+
+  flow_gauge(l, flow, forces, dt); // SU(2) gauge links
+
+  #ifdef U1
+    flow_u1link(l, flow, forces, dt);
+  #endif
+
+  #if (NHIGGS > 0)
+    flow_doublet(l, flow, forces, dt);
+  #endif
+
+  #ifdef TRIPLET
+    flow_triplet(l, flow, forces, dt);
+  #endif
+
+  #ifdef SINGLET
+    flow_singlet(l, flow, forces, dt);
+  #endif
+}
 
 
+#ifdef GRADFLOW
 /* Routine for undoing the mass counterterms.
 * Normally the simulation uses action where the mass c.t. are included
 * as necessary to produce the correct probability distributions.
 * But for the flow, we need to use the tree-level masses instead, otherwise
 * there is a double counting of divergences.
 * Assumes input MSbar scale of g_3^2 !
+* The counterterms are those of the appendix of the documentation, see also
+* scripts/params_singlet.py. The U(1) coupling is in Y = 1/2 normalization.
+* Not included are the counterterms of the two-doublet model and the U(1) contributions
+* to the mixed doublet-triplet terms, which are not known; init_flow() warns about these.
 */
 void remove_counterterms(params* p) {
 
@@ -436,6 +1055,71 @@ void remove_counterterms(params* p) {
   /* parameters in units of a */
   double gsq = 4.0 / p->betasu2;
   double RGscale = gsq;
+  double logz = log(6.0/(RGscale)) + zeta;
+
+  #if (NHIGGS == 1) || defined(SINGLET)
+    double gpsq = 0.0;
+    #ifdef U1
+      gpsq = 4.0 / (p->betau1 * p->r_u1 * p->r_u1);
+    #endif
+
+    // singlet portal coupling
+    double a2s = 0.0;
+    #if defined(SINGLET) && (NHIGGS == 1)
+      a2s = p->a2_s;
+    #endif
+  #endif
+
+  #if (NHIGGS == 1)
+    double lam = p->lambda_phi;
+    double r_u1 = 0.0;
+    #ifdef U1
+      r_u1 = p->r_u1;
+    #endif
+
+    /* mass counterterm for the doublet, in a^2 units */
+    // 1-loop:
+    double ct_phi = -Sigma/(8.0*M_PI) * (3.0*gsq + gpsq + 12.0*lam + a2s);
+    // 2-loop:
+    ct_phi += 1.0/(16.0*M_PI*M_PI) * ( (-51.0/16.0*gsq*gsq + 9.0/8.0*gsq*gpsq + 5.0/16.0*gpsq*gpsq
+              - 3.0*lam*(3.0*gsq + gpsq) + 12.0*lam*lam + 0.5*a2s*a2s) * logz
+              + 3.0*lam*(3.0*gsq + gpsq)*(delta - 0.25*Sigma*Sigma)
+              + gsq*gsq * (-15.0/16.0 - 45.0/64.0*Sigma*Sigma - M_PI/4.0*Sigma
+              + 33.0/8.0*delta + 4.5*rho - 3.0*k1 + 1.5*k4)
+              + gpsq*gpsq * (1.0/16.0 - 1.0/64.0*Sigma*Sigma - M_PI*Sigma*r_u1*r_u1/6.0
+              + 1.0/8.0*delta + 0.5*rho)
+              + gsq*gpsq * (3.0/8.0 - 3.0/32.0*Sigma*Sigma + 0.75*delta) );
+
+    #ifdef TRIPLET
+      // contributions from the triplet
+      ct_phi += -1.5*p->a2*Sigma/(4.0*M_PI);
+      ct_phi += -1.0/(16.0*M_PI*M_PI) * ( (-0.75*gsq*gsq + 6.0*p->a2*gsq - 1.5*p->a2*p->a2) * logz
+              + 6.0*p->a2*gsq*(0.25*Sigma*Sigma - delta) - 3.0*gsq*gsq*rho );
+    #endif
+
+    p->msq_phi = p->msq_phi - ct_phi;
+  #endif
+
+  #ifdef SINGLET
+    double b3 = p->b3_s;
+    double b4_s = p->b4_s;
+    double a1s = 0.0;
+    #if (NHIGGS == 1)
+      a1s = p->a1_s;
+    #endif
+
+    /* tadpole and mass counterterms for the singlet, in a^{5/2} and a^2 units */
+    double ct_b1 = -Sigma/(4.0*M_PI) * (b3 + a1s);
+    ct_b1 += 1.0/(16.0*M_PI*M_PI) * ( (2.0*b3*b4_s + a1s*a2s - 0.5*a1s*(3.0*gsq + gpsq)) * logz
+              + 0.5*a1s*(3.0*gsq + gpsq)*(delta - 0.25*Sigma*Sigma) );
+
+    double ct_S = -Sigma/(4.0*M_PI) * (2.0*a2s + 3.0*b4_s);
+    ct_S += 1.0/(16.0*M_PI*M_PI) * ( (2.0*a2s*a2s + 6.0*b4_s*b4_s - a2s*(3.0*gsq + gpsq)) * logz
+              + a2s*(3.0*gsq + gpsq)*(delta - 0.25*Sigma*Sigma) );
+
+    p->b1_s = p->b1_s - ct_b1;
+    p->msq_s = p->msq_s - ct_S;
+  #endif
 
   #ifdef TRIPLET
     double b4 = p->b4;
@@ -445,10 +1129,17 @@ void remove_counterterms(params* p) {
     double ct_Sigma = -(4.0*gsq + 5.0*b4)*Sigma/(4.0*M_PI);
     // 2-loop:
     ct_Sigma += -1.0/(16.0*M_PI*M_PI) * ( (20.0*b4*gsq - 10.0*b4*b4)
-              * (log(6.0/(RGscale)) + zeta) + 20.0*b4*gsq * (0.25*Sigma*Sigma - delta)
+              * logz + 20.0*b4*gsq * (0.25*Sigma*Sigma - delta)
               + 2.0*gsq*gsq *(1.25*Sigma*Sigma + M_PI/3.0 * Sigma - 6.0*delta - 6.0*rho
               + 4.0*k1 - k2 - k3 - 3.0*k4) );
 
+    #if (NHIGGS == 1)
+      // contributions from the doublet
+      ct_Sigma += -2.0*p->a2*Sigma/(4.0*M_PI);
+      ct_Sigma += -1.0/(16.0*M_PI*M_PI) * ( (-gsq*gsq + 3.0*p->a2*gsq - 2.0*p->a2*p->a2) * logz
+              + 3.0*p->a2*gsq*(0.25*Sigma*Sigma - delta) - 4.0*gsq*gsq*rho );
+    #endif
+
     // calculate continuum mass in units a^2
     p->msq_triplet = p->msq_triplet - ct_Sigma;
 
@@ -458,4 +1149,6 @@ void remove_counterterms(params* p) {
 
 }
 
-#endif // end #ifdef GRADFLOW
+#endif // GRADFLOW
+
+#endif // end #if defined(GRADFLOW) || defined(HMC)
@@ -6,8 +6,174 @@
 
 #include "su2.h"
 
+#ifdef MPI
+/* Order in which sites are listed in replica comlists: natural ordering
+* on the full lattice. Both the sending and receiving node can construct this
+* independently, so no site lists need to be communicated. */
+typedef struct {
+  long key;
+  long site;
+} site_key;
+
+static int compare_keys(const void* a, const void* b) {
+  long ka = ((site_key const*) a)->key;
+  long kb = ((site_key const*) b)->key;
+  return (ka > kb) - (ka < kb);
+}
+
+static void natural_order(lattice const* l, long* order) {
+  site_key* keys = malloc(l->sites * sizeof(*keys));
+  for (long i=0; i<l->sites; i++) {
+    keys[i].key = coordsToIndex(l->dim, l->L, l->coords[i]);
+    keys[i].site = i;
+  }
+  qsort(keys, l->sites, sizeof(*keys), compare_keys);
+  for (long i=0; i<l->sites; i++) {
+    order[i] = keys[i].site;
+  }
+  free(keys);
+}
+#endif
+
+/* Set up concurrent trajectory replicas. The nodes are split into traj->replicas groups,
+* each of which lays out its own copy of the lattice (traj->rl) in a sub-communicator
+* and runs a share of the trajectories independently. Each node uses its own RNG stream
+* anyway, so the replicas are statistically independent.
+* Also constructs traj->scatter: send_to lists sites on the full lattice 'l' that go
+* to each replica node, recv_from lists sites on my replica. Node indices refer to l->comm. */
+void init_replicas(lattice* l, trajectory* traj, int run_checks) {
+
+  traj->replica_id = 0;
+  traj->scatter.sends = 0; traj->scatter.recvs = 0;
+  if (traj->replicas <= 1) {
+    traj->replicas = 1;
+    return;
+  }
+
+  #ifndef MPI
+    printf0("WARNING: trajectory replicas need MPI, running all trajectories on a single lattice.\n");
+    traj->replicas = 1;
+    return;
+  #else
+
+  int R = traj->replicas;
+  if (l->size % R != 0 || l->vol % (l->size / R) != 0) {
+    printf0("Cannot split %d MPI nodes into %d trajectory replicas! Exiting...\n", l->size, R);
+    die(-45);
+  }
+
+  lattice* rl = &traj->rl;
+  rl->dim = l->dim;
+  rl->L = malloc(rl->dim * sizeof(*rl->L));
+  memcpy(rl->L, l->L, rl->dim * sizeof(*rl->L));
+  rl->vol = l->vol;
+  rl->size = l->size / R;
+  rl->rank = l->rank % rl->size;
+  traj->replica_id = l->rank / rl->size;
+
+  // replica c consists of ranks c*size, ..., (c+1)*size - 1 in l->comm
+  MPI_Comm_split(l->comm, traj->replica_id, l->rank, &rl->comm);
+  #ifdef BLOCKING
+    rl->blocklist.sends = 0; rl->blocklist.recvs = 0;
+  #endif
+  int do_prints = 0;
+  layout(rl, do_prints, run_checks);
+
+  // sends from my part of the full lattice to every replica
+  long* order = malloc(l->sites * sizeof(*order));
+  natural_order(l, order);
+  for (long n=0; n<l->sites; n++) {
+    long i = order[n];
+    int node = coordsToRank(rl, l->coords[i]);
+    for (int c=0; c<R; c++) {
+      addto_comlist(&traj->scatter, c * rl->size + node, i, SEND, l->parity[i], l->sites);
+    }
+  }
+
+  free(order);
+
+  // receives on my replica, from nodes of the full lattice
+  order = malloc(rl->sites * sizeof(*order));
+  natural_order(rl, order);
+  for (long n=0; n<rl->sites; n++) {
+    long j = order[n];
+    addto_comlist(&traj->scatter, coordsToRank(l, rl->coords[j]), j, RECV, rl->parity[j], rl->sites);
+  }
+  free(order);
+
+  realloc_comlist(&traj->scatter, SEND);
+  realloc_comlist(&traj->scatter, RECV);
+
+  printf0("Running trajectories in %d concurrent replicas of %d nodes each\n", R, rl->size);
+
+  #endif
+}
+
+void free_replicas(trajectory* traj) {
+  if (traj->replicas > 1) {
+    free_comlist(&traj->scatter);
+    free_lattice(&traj->rl);
+  }
+}
+
+#ifdef MPI
+/* Copy a field from the full lattice to my replica, using traj->scatter. dir < 0 means a non-gauge field */
+static void scatter_field(lattice const* l, trajectory* traj, double** field, double** field_r,
+      double*** gfield, double*** gfield_r, int dofs, int dir) {
+
+  int sends = traj->scatter.sends;
+  MPI_Request req[sends];
+  for (int k=0; k<sends; k++) {
+    if (dir < 0) {
+      send_field(&traj->scatter.send_to[k], l->comm, &req[k], EVENODD, field, dofs);
+    } else {
+      send_gaugefield(&traj->scatter.send_to[k], l->comm, &req[k], EVENODD, gfield, dofs, dir);
+    }
+  }
+
+  for (int m=0; m<traj->scatter.recvs; m++) {
+    if (dir < 0) {
+      recv_field(&traj->scatter.recv_from[m], l->comm, EVENODD, field_r, dofs);
+    } else {
+      recv_gaugefield(&traj->scatter.recv_from[m], l->comm, EVENODD, gfield_r, dofs, dir);
+    }
+  }
+
+  for (int k=0; k<sends; k++) {
+    MPI_Wait(&req[k], MPI_STATUS_IGNORE);
+    free(traj->scatter.send_to[k].buf);
+  }
+}
+
+/* Copy all fields from the full lattice to my replica and sync halos there */
+static void scatter_fields(lattice const* l, fields const* f, trajectory* traj, fields* f_r) {
+
+  for (int dir=0; dir<l->dim; dir++) {
+    scatter_field(l, traj, NULL, NULL, f->su2link, f_r->su2link, SU2LINK, dir);
+  }
+  #ifdef U1
+    scatter_field(l, traj, f->u1link, f_r->u1link, NULL, NULL, l->dim, -1);
+  #endif
+  #if (NHIGGS > 0)
+    for (int db=0; db<NHIGGS; db++) {
+      scatter_field(l, traj, f->su2doublet[db], f_r->su2doublet[db], NULL, NULL, SU2DB, -1);
+    }
+  #endif
+  #ifdef TRIPLET
+    scatter_field(l, traj, f->su2triplet, f_r->su2triplet, NULL, NULL, SU2TRIP, -1);
+  #endif
+  #ifdef SINGLET
+    scatter_field(l, traj, f->singlet, f_r->singlet, NULL, NULL, 1, -1);
+  #endif
+
+  sync_halos(&traj->rl, f_r);
+}
+#endif
+
 /* Do a set of realtime trajectories. 'weight' struct is used only for calculating the order parameter;
-* otherwise multicanonical is turned off. 'id' is the identifier for current set of trajectories */
+* otherwise multicanonical is turned off. 'id' is the identifier for current set of trajectories.
+* With traj->replicas > 1, trajectory number t runs on replica (t-1) % replicas,
+* and each replica writes to its own file trajectory_<replica>. */
 void make_realtime_trajectories(lattice* l, fields const* f, params* p, counters* c,
       weight* w, trajectory* traj, int id) {
 
@@ -16,23 +182,49 @@ void make_realtime_trajectories(lattice* l, fields const* f, params* p, counters
   int do_acc = w->do_acceptance;
   int rand_sweeps = p->random_sweeps;
   w->do_acceptance = 0;
+  w->track_orderparam = 1;
   p->random_sweeps = 1;
 
   int iter = 1;
-  int current_traj = 1;
+  int current_traj = 1 + traj->replica_id;
   double muca_param = w->param_value[EVEN] + w->param_value[ODD];
 
+  // lattice and starting configuration for my trajectories
+  lattice* lt = l;
+  fields const* f_start = f;
+  #ifdef MPI
+    fields f_replica;
+    if (traj->replicas > 1) {
+      lt = &traj->rl;
+      alloc_fields(lt, &f_replica);
+      scatter_fields(l, f, traj, &f_replica);
+      f_start = &f_replica;
+    }
+  #endif
+
   // copy field configuration to a new struct
   fields f_traj;
-  alloc_fields(l, &f_traj);
-  copy_fields(l, f, &f_traj);
-  sync_halos(l, &f_traj);
+  alloc_fields(lt, &f_traj);
+  copy_fields(lt, f_start, &f_traj);
+  sync_halos(lt, &f_traj);
+  // local order parameter at the start of a trajectory. Afterwards the update sweeps keep track of it
+  double start_param[2] = { local_orderparam(lt, f_start, w, EVEN), local_orderparam(lt, f_start, w, ODD) };
+  w->local_param[EVEN] = start_param[EVEN];
+  w->local_param[ODD] = start_param[ODD];
 
   // open trajectory file in root node and write header
-  if (!l->rank) {
-    traj->trajectoryfile = fopen("trajectory", "a");
+  if (!lt->rank) {
+    char fname[100];
+    if (traj->replicas > 1) {
+      sprintf(fname, "trajectory_%d", traj->replica_id);
+    } else {
+      sprintf(fname, "trajectory");
+    }
+    traj->trajectoryfile = fopen(fname, "a");
     fprintf(traj->trajectoryfile, "\n----- Begin set %d, start value %lf ----- \n", id, muca_param);
-    fprintf(traj->trajectoryfile, "\n--- Trajectory %d --- \n", current_traj);
+    if (current_traj <= traj->n_traj) {
+      fprintf(traj->trajectoryfile, "\n--- Trajectory %d --- \n", current_traj);
+    }
   }
 
   while (current_traj <= traj->n_traj) {
@@ -40,28 +232,30 @@ void make_realtime_trajectories(lattice* l, fields const* f, params* p, counters
     // perform measurements every traj.interval iterations.
     if (iter % traj->interval == 0 || iter == 1) {
 
-      /* recalculate order parameter for measure() and to check if the trajectory completed
-      * Need to do this here because all multicanonical calls are skipped in update_lattice() */
-      calc_orderparam(l, &f_traj, p, w, EVEN); // updates EVEN contribution only
-      muca_param = calc_orderparam(l, &f_traj, p, w, ODD); // updates ODD and returns the full value
+      /* collect the order parameter to check if the trajectory completed. All multicanonical
+      * calls are skipped in update_lattice(), but the sweeps keep track of the local sums
+      * so that only one reduction is needed here */
+      muca_param = allreduce(w->local_param[EVEN] + w->local_param[ODD], lt->comm) / lt->vol;
 
       // measure(traj->trajectoryfile, l, &f_traj, p, w);
 
       /* 'iter' counts the time: one full update on the gauge fields per update_lattice() call */
-      if (!l->rank) {
+      if (!lt->rank) {
         fprintf(traj->trajectoryfile, "%d %.8lf\n", iter-1, muca_param);
       }
 
       if (muca_param > traj->max || muca_param < traj->min) {
-        current_traj++;
+        current_traj += traj->replicas;
         // trajectory done, revert back to the initial configuration and repeat
 
         if (current_traj <= traj->n_traj) {
-          copy_fields(l, f, &f_traj);
-          sync_halos(l, &f_traj);
+          copy_fields(lt, f_start, &f_traj);
+          sync_halos(lt, &f_traj);
+          w->local_param[EVEN] = start_param[EVEN];
+          w->local_param[ODD] = start_param[ODD];
 
           // write header for the next trajectory
-          if (!l->rank) {
+          if (!lt->rank) {
             fflush(traj->trajectoryfile);
             fprintf(traj->trajectoryfile, "\n--- Trajectory %d --- \n", current_traj);
           }
@@ -73,10 +267,10 @@ void make_realtime_trajectories(lattice* l, fields const* f, params* p, counters
     } // end measure if
 
     /* update fields as usual, but now there is no multicanonical weighting */
-    update_lattice(l, &f_traj, p, c, w);
+    update_lattice(lt, &f_traj, p, c, w);
 
     // additional fflush every so often, so we see if the trajectory gets stuck
-    if (iter % 1000 == 0 && !l->rank) {
+    if (iter % 1000 == 0 && !lt->rank) {
       fflush(traj->trajectoryfile);
     }
     iter++;
@@ -85,13 +279,27 @@ void make_realtime_trajectories(lattice* l, fields const* f, params* p, counters
   // trajectories done, exit "heatbath trajectory mode".
   // lattice loaded already when exiting trajectory loop
   w->do_acceptance = do_acc;
+  w->track_orderparam = 0;
   p->random_sweeps = rand_sweeps;
 
-  if (!l->rank)	{
+  if (!lt->rank)	{
     fclose(traj->trajectoryfile);
   }
-  free_fields(l, &f_traj);
+  free_fields(lt, &f_traj);
+  #ifdef MPI
+    if (traj->replicas > 1) {
+      free_fields(lt, &f_replica);
+    }
+  #endif
+
+}
 
+/* Make sure that a required parameter was found in the realtime config */
+static void check_set(int set, char* name) {
+  if (!set) {
+    printf0("Parameter '%s' not found in realtime config! Exiting...\n", name);
+    die(-3);
+  }
 }
 
 /* Read input for the realtime simulation.
@@ -108,6 +316,8 @@ void read_realtime_config(char *filename, trajectory* traj) {
   int set_min = 0, set_max = 0;
   int set_interval = 0, set_mode_interval = 0;
 
+  traj->replicas = 1; // optional
+
 	if(access(filename,R_OK) == 0) {
 		config = fopen(filename, "r");
 
@@ -145,6 +355,9 @@ void read_realtime_config(char *filename, trajectory* traj) {
 				traj->max = strtod(value,NULL);
 				set_max = 1;
 			}
+      else if(!strcasecmp(key,"replicas")) {
+				traj->replicas = strtol(value,NULL,10);
+			}
 
 		}
 		fclose(config);
@@ -165,6 +378,9 @@ void print_realtime_params(params p, trajectory traj) {
 
   printf("Heatbath trajectory mode every %d iterations, %d trajectories each\n", traj.mode_interval, traj.n_traj);
   printf("--- min %lf, max %lf, measure interval %d ---\n", traj.min, traj.max, traj.interval);
+  if (traj.replicas > 1) {
+    printf("--- %d concurrent replicas, writing to files trajectory_<replica> ---\n", traj.replicas);
+  }
 
   if (p.algorithm_su2link != HEATBATH) {
     printf("\n--- WARNING: SU(2) update not using heatbath!\n");
@@ -1,7 +1,8 @@
 /** @file heatbath.c
 *
 * Routines for implementing Kennedy-Pendleton heatbath algorithm
-*	for gauge links (Phys.Lett. 156B (1985) 393-399).
+*	for gauge links (Phys.Lett. 156B (1985) 393-399),
+* and heatbath for U(1) links.
 *
 */
 
@@ -122,3 +123,85 @@ int heatbath_su2link(lattice const* l, fields* f, params const* p, long i, int d
 	return 1;
 
 }
+
+
+#ifdef U1
+/* Generate an angle in (-pi, pi] from the von Mises distribution exp(kappa cos(x)), kappa >= 0.
+* Uses the rejection method of Best and Fisher (Appl. Statist. 28 (1979) 152-157),
+* which accepts at least 65% of the candidates for any kappa. */
+static double von_mises(double kappa) {
+
+	if (kappa < 1e-8) {
+		// practically flat distribution
+		return M_PI * (2.0*dran() - 1.0);
+	}
+
+	double tau = 1.0 + sqrt(1.0 + 4.0*kappa*kappa);
+	double rho = (tau - sqrt(2.0*tau)) / (2.0*kappa);
+	double s = (1.0 + rho*rho) / (2.0*rho);
+
+	double w, v;
+	int loop = 0;
+	int maxloops = 200;
+	while (1) {
+		// cos is even, so the sign of v is free to use for the sign of the result
+		v = 2.0*dran() - 1.0;
+		double z = cos(M_PI * v);
+		w = (1.0 + s*z) / (s + z);
+		double c = kappa * (s - w);
+		double u = 1.0 - dran(); // in (0, 1]
+
+		loop++;
+		if (c*(2.0 - c) > u || log(c/u) + 1.0 >= c || loop > maxloops) break;
+	}
+
+	if (loop > maxloops) {
+		fprintf(stderr, "Exceeded loop limit in U(1) heatbath update! Was %d\n", maxloops);
+	}
+
+	// w = cos(x) but can be slightly out of range due to rounding
+	if (w > 1.0) w = 1.0;
+	if (w < -1.0) w = -1.0;
+	double x = acos(w);
+	return (v < 0.0) ? -x : x;
+}
+
+/* Update a single U(1) link using heatbath.
+* With coefficients k from u1link_staple(), the plaquette part of the local action is
+*		-A cos(r a) + B sin(r a) = -R cos(r a + c),		R cos(c) = A, R sin(c) = B,
+* so r a + c is drawn from the von Mises distribution exp(R cos(x)).
+* For r = 1 the doublet hopping terms are of the same form and are included in R, c,
+* so the update is exact and always accepted. For r > 1 (must be an integer) one of the
+* r solutions for a is picked at random and the hopping terms are accepted/rejected
+* with Metropolis, which keeps detailed balance since the proposal is independent of the old link.
+* Returns 1 if update was accepted and 0 if rejected. */
+int heatbath_u1link(lattice const* l, fields* f, params const* p, long i, int dir) {
+
+	double* a = &f->u1link[i][dir];
+	double r = p->r_u1;
+
+	double k[4];
+	u1link_staple(l, f, p, i, dir, k);
+
+	if (r == 1.0) {
+		double A = k[0] + k[2];
+		double B = k[1] - k[3];
+		*a = von_mises(sqrt(A*A + B*B)) - atan2(B, A);
+		return 1;
+	}
+
+	double A = k[0], B = k[1];
+	double x = von_mises(sqrt(A*A + B*B)) - atan2(B, A);
+	// choose one of the r branches of a = (x + 2 pi n) / r
+	int n = (int) (r * dran());
+	double newlink = (x + 2.0*M_PI*n) / r;
+
+	// hopping part of the action
+	double diff = -k[2]*(cos(newlink) - cos(*a)) - k[3]*(sin(newlink) - sin(*a));
+	if (diff > 0 && exp(-diff) < dran()) {
+		return 0;
+	}
+	*a = newlink;
+	return 1;
+}
+#endif
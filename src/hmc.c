@@ -0,0 +1,272 @@
+/** @file hmc.c
+*
+* Hybrid Monte Carlo (HMC) update for all fields at once.
+*
+* Each field q gets a Gaussian conjugate momentum pi, and the system is evolved
+* in molecular dynamics time with the Hamiltonian H = \sum pi^2 / 2 + S.
+* The trajectory is then accepted with probability min(1, exp(-dH)).
+* In multicanonical runs the weight is included in the same accept/reject step,
+* see multicanonical_acceptance(), so there is only one global check per trajectory.
+*
+* Forces are the gradient forces of gradflow.c, rescaled from flow time
+* normalization to -dS/dq. SU(2) links are parametrized as U -> exp(i w_a sigma^a) U
+* so that links are evolved with flow_gauge() using the momenta conjugate to w_a.
+* All other fields, including U(1) links, are additive.
+*
+* Integrators (hmc_integrator in config), with step size e = hmc_length / hmc_steps:
+*   leapfrog:  pi(e/2) q(e) pi(e/2)
+*   Omelyan:   pi(lambda e) q(e/2) pi((1-2 lambda) e) q(e/2) pi(lambda e)
+* Both have O(e^2) errors in H, but for Omelyan's second order minimum norm
+* scheme (cond-mat/0110585) the error coefficient is typically an order of magnitude
+* smaller at the cost of two force evaluations per step. Momentum updates at
+* the boundaries of consecutive steps are merged.
+*
+*/
+
+#ifdef HMC // do nothing if compiler flag is not set
+
+#include "su2.h"
+
+// Omelyan parameter that minimizes the norm of the leading error term
+#define OMELYAN_LAMBDA 0.1931833275037836
+
+/* Allocate work space for HMC. Called once before the first trajectory. */
+void init_hmc(lattice const* l, hmc_context* ctx) {
+  alloc_fields(l, &ctx->mom);
+  alloc_fields(l, &ctx->forces);
+  alloc_fields(l, &ctx->backup);
+}
+
+void free_hmc(lattice const* l, hmc_context* ctx) {
+  free_fields(l, &ctx->mom);
+  free_fields(l, &ctx->forces);
+  free_fields(l, &ctx->backup);
+}
+
+/* Gaussian random number with unit variance (Box-Muller) */
+static double gaussian_ran() {
+  double r = sqrt(-2.0 * log(1.0 - dran())); // dran() is in [0,1), so the log is finite
+  return r * cos(2.0 * M_PI * dran());
+}
+
+/* Total action summed over all nodes */
+double total_action(lattice const* l, fields const* f, params const* p) {
+  double tot = 0.0;
+  for (long i=0; i<l->sites; i++) {
+    tot += action_local(l, f, p, i);
+  }
+  return allreduce(tot, l->comm);
+}
+
+/* Calculate HMC forces -dS/dq for all fields at all sites (not halos).
+* The gradient flow forces are -dS/dq for scalars but have extra
+* normalization factors for gauge links, see grad_force_link() and grad_force_u1link(). */
+void hmc_forces(lattice const* l, fields const* f, params const* p, fields* forces) {
+
+  calc_gradient(l, f, p, forces);
+
+  // SU(2): flow force on link is -1/beta dS/dw_a
+  for (long i=0; i<l->sites; i++) {
+    for (int dir=0; dir<l->dim; dir++) {
+      for (int a=1; a<SU2LINK; a++) {
+        forces->su2link[i][dir][a] *= p->betasu2;
+      }
+      #ifdef U1
+        forces->u1link[i][dir] *= p->betau1 * p->r_u1 * p->r_u1;
+      #endif
+    }
+  }
+}
+
+/* Draw new momenta from the distribution exp(-pi^2 / 2). */
+static void refresh_momenta(lattice const* l, fields* mom) {
+
+  for (long i=0; i<l->sites; i++) {
+    for (int dir=0; dir<l->dim; dir++) {
+      mom->su2link[i][dir][0] = 0.0; // not used
+      for (int a=1; a<SU2LINK; a++) {
+        mom->su2link[i][dir][a] = gaussian_ran();
+      }
+      #ifdef U1
+        mom->u1link[i][dir] = gaussian_ran();
+      #endif
+    }
+
+    #if (NHIGGS > 0)
+      for (int db=0; db<NHIGGS; db++) {
+        for (int a=0; a<SU2DB; a++) {
+          mom->su2doublet[db][i][a] = gaussian_ran();
+        }
+      }
+    #endif
+
+    #ifdef TRIPLET
+      for (int a=0; a<SU2TRIP; a++) {
+        mom->su2triplet[i][a] = gaussian_ran();
+      }
+    #endif
+
+    #ifdef SINGLET
+      mom->singlet[i][0] = gaussian_ran();
+    #endif
+  }
+}
+
+/* Kinetic term \sum pi^2 / 2 summed over all nodes */
+static double kinetic_energy(lattice const* l, fields const* mom) {
+
+  double tot = 0.0;
+  for (long i=0; i<l->sites; i++) {
+    for (int dir=0; dir<l->dim; dir++) {
+      for (int a=1; a<SU2LINK; a++) {
+        tot += mom->su2link[i][dir][a] * mom->su2link[i][dir][a];
+      }
+      #ifdef U1
+        tot += mom->u1link[i][dir] * mom->u1link[i][dir];
+      #endif
+    }
+
+    #if (NHIGGS > 0)
+      for (int db=0; db<NHIGGS; db++) {
+        for (int a=0; a<SU2DB; a++) {
+          tot += mom->su2doublet[db][i][a] * mom->su2doublet[db][i][a];
+        }
+      }
+    #endif
+
+    #ifdef TRIPLET
+      for (int a=0; a<SU2TRIP; a++) {
+        tot += mom->su2triplet[i][a] * mom->su2triplet[i][a];
+      }
+    #endif
+
+    #ifdef SINGLET
+      tot += mom->singlet[i][0] * mom->singlet[i][0];
+    #endif
+  }
+
+  return 0.5 * allreduce(tot, l->comm);
+}
+
+/* Momentum update pi <- pi + dt * F, with forces calculated from the current fields.
+* Halos of the fields need to be up to date. */
+static void update_momenta(lattice const* l, fields const* f, params const* p, hmc_context* ctx, double dt) {
+
+  fields* mom = &ctx->mom;
+  fields* F = &ctx->forces;
+  hmc_forces(l, f, p, F);
+
+  for (long i=0; i<l->sites; i++) {
+    for (int dir=0; dir<l->dim; dir++) {
+      for (int a=1; a<SU2LINK; a++) {
+        mom->su2link[i][dir][a] += dt * F->su2link[i][dir][a];
+      }
+      #ifdef U1
+        mom->u1link[i][dir] += dt * F->u1link[i][dir];
+      #endif
+    }
+
+    #if (NHIGGS > 0)
+      for (int db=0; db<NHIGGS; db++) {
+        for (int a=0; a<SU2DB; a++) {
+          mom->su2doublet[db][i][a] += dt * F->su2doublet[db][i][a];
+        }
+      }
+    #endif
+
+    #ifdef TRIPLET
+      for (int a=0; a<SU2TRIP; a++) {
+        mom->su2triplet[i][a] += dt * F->su2triplet[i][a];
+      }
+    #endif
+
+    #ifdef SINGLET
+      mom->singlet[i][0] += dt * F->singlet[i][0];
+    #endif
+  }
+}
+
+/* Field update q <- q + dt * pi, or U <- exp(i dt pi_a sigma^a) U for SU(2) links.
+* This is exactly a flow step with the momenta in place of the forces. */
+static void update_coords(lattice* l, fields* f, hmc_context* ctx, double dt) {
+  flow_fields(l, f, &ctx->mom, dt);
+  sync_halos(l, f);
+}
+
+/* Integrate the equations of motion over one trajectory */
+static void md_evolve(lattice* l, fields* f, params const* p, hmc_context* ctx) {
+
+  int n = p->hmc_steps;
+  double eps = p->hmc_length / n;
+
+  if (p->hmc_integrator == HMC_LEAPFROG) {
+
+    update_momenta(l, f, p, ctx, 0.5*eps);
+    for (int k=0; k<n; k++) {
+      update_coords(l, f, ctx, eps);
+      // merge the final half step with the first half step of the next step
+      update_momenta(l, f, p, ctx, (k < n-1) ? eps : 0.5*eps);
+    }
+
+  } else {
+
+    double lam = OMELYAN_LAMBDA;
+    update_momenta(l, f, p, ctx, lam*eps);
+    for (int k=0; k<n; k++) {
+      update_coords(l, f, ctx, 0.5*eps);
+      update_momenta(l, f, p, ctx, (1.0 - 2.0*lam)*eps);
+      update_coords(l, f, ctx, 0.5*eps);
+      update_momenta(l, f, p, ctx, (k < n-1) ? 2.0*lam*eps : lam*eps);
+    }
+  }
+}
+
+
+/* Perform one HMC trajectory on all fields and do the global accept/reject,
+* combined with the multicanonical check if w->do_acceptance is set.
+* Halos need to be up to date on input and are kept up to date.
+* Return value is 1 if the trajectory was accepted, 0 otherwise. */
+int hmc_trajectory(lattice* l, fields* f, params const* p, counters* c, weight* w, hmc_context* ctx) {
+
+  copy_fields(l, f, &ctx->backup); // includes halos
+
+  refresh_momenta(l, &ctx->mom);
+  double H_old = kinetic_energy(l, &ctx->mom) + total_action(l, f, p);
+
+  md_evolve(l, f, p, ctx);
+
+  double H_new = kinetic_energy(l, &ctx->mom) + total_action(l, f, p);
+  double dH = H_new - H_old;
+
+  int accept;
+  if (w->do_acceptance) {
+    // all fields changed, so recalculate both parities
+    double param_old[2] = { w->param_value[EVEN], w->param_value[ODD] };
+    calc_orderparam(l, f, p, w, EVEN);
+    double param_new = calc_orderparam(l, f, p, w, ODD);
+
+    accept = multicanonical_acceptance(l, w, param_old[EVEN] + param_old[ODD], param_new, dH);
+    if (!accept) {
+      w->param_value[EVEN] = param_old[EVEN];
+      w->param_value[ODD] = param_old[ODD];
+    }
+
+  } else {
+    // acc/rej only in root node
+    if (!l->rank) {
+      accept = (exp(-dH) > dran());
+    }
+    bcast_int(&accept, l->comm);
+  }
+
+  if (!accept) {
+    copy_fields(l, &ctx->backup, f);
+  }
+
+  c->accepted_hmc += accept;
+  c->total_hmc++;
+
+  return accept;
+}
+
+#endif // HMC
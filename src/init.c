@@ -39,15 +39,18 @@ void setu1(fields* f, lattice const* l) {
 }
 #endif
 
-/* generate a random SU(2) matrix and store it in the argument */
-void random_su2link(double *su2) {
+/* generate a random SU(2) matrix and store it in the argument.
+* step controls the spread of the su(2) components relative to the unit component,
+* so smaller step gives matrices closer to 1 (used by Metropolis).
+* The unit component is kept positive: proposals near -1 would be rejected anyway,
+* and the distribution is still symmetric under U -> U^+ */
+void random_su2link(double *su2, double step) {
 
 	double u[4];
-	// this number can be adjusted for e.g. metro update
-	u[0] = 10.0 * (dran() - 0.5);
-	u[1] = 1.0 * (dran() - 0.5);
-	u[2] = 1.0 * (dran() - 0.5);
-	u[3] = 1.0 * (dran() - 0.5);
+	u[0] = 5.0 * dran();
+	u[1] = step * (dran() - 0.5);
+	u[2] = step * (dran() - 0.5);
+	u[3] = step * (dran() - 0.5);
 
 	double norm = sqrt(u[0]*u[0] + u[1]*u[1] + u[2]*u[2] + u[3]*u[3]);
 
@@ -111,6 +114,41 @@ void setfields(fields* f, lattice* l, params const* p) {
 	sync_halos(l, f);
 }
 
+/* Set all fields to random values, for benchmarking with realistic (non-unit) data.
+* Links are uniformly distributed on the unit 3-sphere only approximately,
+* which does not matter for this purpose. */
+void set_random_fields(fields* f, lattice* l) {
+
+	for (long i=0; i<l->sites; i++) {
+		for (int dir=0; dir<l->dim; dir++) {
+			double* u = f->su2link[i][dir];
+			double norm = 0.0;
+			for (int a=0; a<SU2LINK; a++) {
+				u[a] = 2.0*dran() - 1.0;
+				norm += u[a]*u[a];
+			}
+			for (int a=0; a<SU2LINK; a++) u[a] /= sqrt(norm);
+			#ifdef U1
+				f->u1link[i][dir] = 2.0*M_PI*dran();
+			#endif
+		}
+
+		#if (NHIGGS > 0)
+			for (int db=0; db<NHIGGS; db++) {
+				for (int a=0; a<SU2DB; a++) f->su2doublet[db][i][a] = dran() - 0.5;
+			}
+		#endif
+		#ifdef TRIPLET
+			for (int a=0; a<SU2TRIP; a++) f->su2triplet[i][a] = dran() - 0.5;
+		#endif
+		#ifdef SINGLET
+			f->singlet[i][0] = dran() - 0.5;
+		#endif
+	}
+
+	sync_halos(l, f);
+}
+
 
 /* Copy all fields from "fields" struct f_old to f_new.
 * Used when e.g. performing Wilson flow for renormalization
@@ -192,8 +230,14 @@ void init_counters(counters* c) {
 
 	c->total_su2link = 0;
 	c->total_u1link = 0;
+	c->total_overrelax_su2link = 0;
+	c->acc_overrelax_su2link = 0;
+	c->total_overrelax_u1link = 0;
+	c->acc_overrelax_u1link = 0;
 	c->total_triplet = 0;
 	c->total_overrelax_triplet = 0;
 	c->accepted_muca = 0;
 	c->total_muca = 0;
+	c->accepted_hmc = 0;
+	c->total_hmc = 0;
 }
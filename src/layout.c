@@ -15,7 +15,7 @@
 * initialize lookup tables and comlists. */
 void layout(lattice *l, int do_prints, int run_checks) {
 
-	clock_t start, end;
+	double start, end;
 	double time;
 
 	// these are needed for make_slices():
@@ -83,15 +83,15 @@ void layout(lattice *l, int do_prints, int run_checks) {
 	barrier(l->comm);
 	if (run_checks) {
 
-		start = clock();
+		start = wall_time();
 
 		test_coords(l);
 		test_neighbors(l);
 		test_comms(l);
 		test_comms_individual(l);
 
-		end = clock();
-		time = ((double) (end - start)) / CLOCKS_PER_SEC;
+		end = wall_time();
+		time = end - start;
 
 		if (do_prints) {
 			printf0("All tests OK! Time taken: %lf seconds.\n", time);
@@ -22,11 +22,18 @@ int main(int argc, char *argv[]) {
 	fields f;
 	counters c;
 	weight w;
+	results_buffer results;
 	#ifdef HB_TRAJECTORY
 		trajectory traj;
 	#endif
+	#ifdef GRADFLOW
+		flow_context flow;
+	#endif
+	#ifdef HMC
+		hmc_context hmc;
+	#endif
 
-	clock_t start_time, end_time;
+	double start_time, end_time;
 	double timing = 0.0;
 
 
@@ -51,19 +58,26 @@ int main(int argc, char *argv[]) {
 	MPISize = l.size;
 
 	// print usage if the arguments are invalid
-	if (argc != 2) {
+	int scaling = (argc == 4 && !strcmp(argv[2], "scaling"));
+	if (argc != 2 && !scaling) {
 		printf0("Usage: ./<program name> <config file>\n");
+		printf0("   or: ./<program name> <config file> scaling <iterations>   (see scaling.c)\n");
 		die(0);
 	}
 
-	/* Initialize RNG. The base seed is obtained from time(), which is then shuffled
+	// read in the config file.
+	// This needs to be done before allocating anything since we don't know the dimensions otherwise
+	get_parameters(argv[1], &l, &p); // also allocs p.L and calculates volume
+
+	/* Initialize RNG. The base seed is obtained from time(), or from the config file
+	* if random_seed is nonzero (for reproducible runs), which is then shuffled
 	* around to produce different seeds for each node. Strictly speaking this does
 	* not guarantee independent RNG for the nodes though (should use proper parallel RNG).
 	* The magic numbers for shuffling are adapted from lattice code by Kari Rummukainen (setup_basic.c).
 	*/
 	long seed = 0;
 	if (l.rank == 0) {
-		seed = time(NULL);
+		seed = p.random_seed ? p.random_seed : time(NULL);
 		seed = seed^(seed<<26)^(seed<<9);
 		printf("Seed in root node: %ld\n", seed);
 	}
@@ -76,10 +90,6 @@ int main(int argc, char *argv[]) {
 	}
 
   	seed_mersenne(seed); // seeding done
-
-	// read in the config file.
-	// This needs to be done before allocating anything since we don't know the dimensions otherwise
-	get_parameters(argv[1], &l, &p); // also allocs p.L and calculates volume
 	// print parameters from root node only
 	if (!l.rank) {
 		print_parameters(l, p);
@@ -88,8 +98,19 @@ int main(int argc, char *argv[]) {
 	// read stuff for multicanonical. if non-multicanonical run, just sets dummy weight
 	get_weight_parameters(argv[1], &p, &w);
 
+	if (scaling) {
+		// benchmark mode: no layout for the config lattice and no file I/O
+		scaling_benchmark(&l, &p, &w, atoi(argv[3]));
+		#ifdef MPI
+			MPI_Finalize();
+		#endif
+		return 0;
+	}
+
+	open_resultsfile(&l, &p);
+
 	// initialize parallel layout and lookup tables
-	start_time = clock();
+	start_time = wall_time();
 
 	int do_prints = 1;
   	layout(&l, do_prints, p.run_checks); // allocs all tables and comlist
@@ -109,7 +130,7 @@ int main(int argc, char *argv[]) {
 
 		l.blocklist.sends = 0; l.blocklist.recvs = 0;
 		realloc_comlist(&l.blocklist, RECV);
-		l.standby = 0;
+		l.replicated = 0;
 		l.blocking_level = 0;
 
 		// block which directions? default: everything except the longest direction
@@ -156,8 +177,8 @@ int main(int argc, char *argv[]) {
 		printf0("--- Blocking structs ready ---\n\n");
 	#endif
 
-	end_time = clock();
-	timing = ((double) (end_time - start_time)) / CLOCKS_PER_SEC;
+	end_time = wall_time();
+	timing = end_time - start_time;
 
 	// initialize accept/reject/etc counters
 	init_counters(&c);
@@ -170,11 +191,16 @@ int main(int argc, char *argv[]) {
 	if (!l.rank)
 		printf("Allocated memory for fields.\n");
 
+	if (p.run_checks) {
+		// consistency checks of the action, on separate test fields
+		test_action(&l, &p);
+	}
+
 	// check if p.latticefile exists and load it; if not, call setfields()
 	if (access(p.latticefile,R_OK) == 0) {
 		// ok
 		printf0("\nLoading latticefile: %s\n", p.latticefile);
-		load_lattice(&l, &f, &c, p.latticefile); // also calls sync_halos()
+		load_lattice(&l, &f, &c, &p, p.latticefile); // also calls sync_halos()
 		printf0("Fields loaded succesfully.\n");
 	} else {
 		printf0("No latticefile found; starting with cold configuration.\n");
@@ -208,6 +234,8 @@ int main(int argc, char *argv[]) {
 
 		}
 	}
+	// in binary mode, keep measurements in memory until the next checkpoint
+	init_results(&results, p.resultsfile, p.binary_results, p.checkpoint / p.interval + 1);
 
 	if (p.multicanonical) {
 		// initialize multicanonical. Needs to come after field initializations
@@ -229,6 +257,7 @@ int main(int argc, char *argv[]) {
 				printf0("\nError: Need multicanonical for heatbath trajectories!! Exiting...\n");
 				die(-44);
 			}
+			init_replicas(&l, &traj, p.run_checks);
 			// write header
 			if (!l.rank) {
 				traj.trajectoryfile = fopen("trajectory", "a");
@@ -243,6 +272,23 @@ int main(int argc, char *argv[]) {
 		if (p.do_flow) {
 			printf0("\n----- Gradient flow every %d iterations -----\n", p.flow_interval);
 			printf0("dt %lf	t_max %lf		meas_interval %d \n", p.flow_dt, p.flow_t_max, p.flow_meas_interval);
+			if (p.flow_integrator == FLOW_RK3) {
+				printf0("Using RK3 integrator");
+				if (p.flow_tolerance > 0.0) printf0(" with adaptive step, tolerance %lg", p.flow_tolerance);
+				printf0("\n");
+			} else {
+				printf0("Using Euler integrator\n");
+			}
+			init_flow(&l, &p, &flow);
+		}
+	#endif
+
+	#ifdef HMC
+		if (p.hmc_trajectories > 0) {
+			printf0("\n----- Hybrid Monte Carlo: %d trajectories per iteration -----\n", p.hmc_trajectories);
+			printf0("%d steps, length %lf, %s integrator\n", p.hmc_steps, p.hmc_length,
+						(p.hmc_integrator == HMC_OMELYAN) ? "Omelyan" : "leapfrog");
+			init_hmc(&l, &hmc);
 		}
 	#endif
 
@@ -259,15 +305,40 @@ int main(int argc, char *argv[]) {
 
 		printf0("\nThermalizing %ld iterations\n", p.n_thermalize);
 		fflush(stdout);
-		start_time = clock();
+		start_time = wall_time();
+		counters c_tune = c; // counters at the previous Metropolis tuning
 		while (iter <= p.n_thermalize) {
 			barrier(l.comm);
 			update_lattice(&l, &f, &p, &c, &w);
+			#ifdef HMC
+				for (int k=0; k<p.hmc_trajectories; k++) {
+					hmc_trajectory(&l, &f, &p, &c, &w, &hmc);
+				}
+			#endif
+			if (p.metro_target > 0) {
+				tune_metropolis(&l, &p, &c, &c_tune);
+			}
 			iter++;
 		}
+		if (p.metro_target > 0) {
+			printf0("Tuned Metropolis steps: SU(2) link %lf", p.metro_step_su2link);
+			#ifdef U1
+				printf0(", U(1) link %lf", p.metro_step_u1link);
+			#endif
+			#if (NHIGGS > 0)
+				printf0(", doublet %lf", p.metro_step_doublet);
+			#endif
+			#ifdef TRIPLET
+				printf0(", triplet %lf", p.metro_step_triplet);
+			#endif
+			#ifdef SINGLET
+				printf0(", singlet %lf", p.metro_step_singlet);
+			#endif
+			printf0("\n");
+		}
 
-		end_time = clock();
-		timing = ((double) (end_time - start_time)) / CLOCKS_PER_SEC;
+		end_time = wall_time();
+		timing = end_time - start_time;
 		printf0("Thermalization done, took %lf seconds.\n", timing);
 		Global_total_time += timing;
 
@@ -292,7 +363,12 @@ int main(int argc, char *argv[]) {
 	// reset total time before starting the main loop
 	Global_total_time = 0.0;
 	Global_comms_time = 0.0;
-	start_time = clock();
+	#ifdef PERF_COUNTERS
+		init_perf_counters(&l);
+	#endif
+	start_time = wall_time();
+	reset_timers();
+	long timings_iter = iter - 1; // iteration at the last performance report
 
 	int flow_id = 1; // only used for gradient flows
 	int correlator_id = 1; // only used for correlators
@@ -303,17 +379,23 @@ int main(int argc, char *argv[]) {
 
 		// measure & update fields first, then checkpoint if needed
 		if (iter % p.interval == 0) {
-			measure(p.resultsfile, &l, &f, &p, &w);
+			timer_start(TIMER_MEASURE);
+			measure(&results, &l, &f, &p, &w);
+			timer_stop(TIMER_MEASURE);
 		}
 		#ifdef MEASURE_Z
 			if (p.do_z_meas && iter % p.meas_interval_z == 0) {
+				timer_start(TIMER_MEASURE_Z);
 				measure_along_z(&l, &f, &p, iter / p.meas_interval_z);
+				timer_stop(TIMER_MEASURE_Z);
 			}
 		#endif
 
 		#ifdef GRADFLOW
 			if (p.do_flow && iter % p.flow_interval == 0) {
-				grad_flow(&l, &f, &p, &w, p.flow_t_max, p.flow_dt, flow_id);
+				timer_start(TIMER_FLOW);
+				grad_flow(&l, &f, &p, &w, &flow, p.flow_t_max, p.flow_dt, flow_id);
+				timer_stop(TIMER_FLOW);
 				flow_id++;
 			}
 		#endif
@@ -321,7 +403,9 @@ int main(int argc, char *argv[]) {
 		#ifdef HB_TRAJECTORY
 			if (p.do_trajectory) {
 				if (iter % traj.mode_interval == 0) {
+					timer_start(TIMER_TRAJECTORY);
 					make_realtime_trajectories(&l, &f, &p, &c, &w, &traj, traj_id);
+					timer_stop(TIMER_TRAJECTORY);
 					traj_id++;
 				}
 			}
@@ -329,6 +413,7 @@ int main(int argc, char *argv[]) {
 
 		#ifdef CORRELATORS
 			if (p.do_correlators && iter % p.correlator_interval == 0) {
+				timer_start(TIMER_CORRELATORS);
 				measure_correlators("correl0", &l, &f, &p, corr_dir, correlator_id);
 
 				#ifdef BLOCKING // repeat with blocked lattices
@@ -345,23 +430,33 @@ int main(int argc, char *argv[]) {
 						measure_blocked_correlators(base, &b[k], f_base, &f_block[k], &p, block_dir, corr_dir, correlator_id);
 					}
 				#endif
+				timer_stop(TIMER_CORRELATORS);
 				correlator_id++;
 			}
 		#endif
 
 		// update all fields. multicanonical checks are contained in sweep routines
 		update_lattice(&l, &f, &p, &c, &w);
+		#ifdef HMC
+			timer_start(TIMER_HMC);
+			for (int k=0; k<p.hmc_trajectories; k++) {
+				hmc_trajectory(&l, &f, &p, &c, &w, &hmc);
+			}
+			timer_stop(TIMER_HMC);
+		#endif
 
 
 		if (iter % p.checkpoint == 0) {
 			// Checkpoint time; print acceptance and save fields to latticefile
-			end_time = clock();
-			timing = ((double) (end_time - start_time)) / CLOCKS_PER_SEC;
+			timer_start(TIMER_CHECKPOINT);
+			end_time = wall_time();
+			timing = end_time - start_time;
 
-			start_time = clock(); // restart timer
+			start_time = wall_time(); // restart timer
 
 			Global_total_time += timing;
 			c.iter = iter; // store for I/O
+			flush_results(&results);
 			if (!l.rank) {
 				printf("\nCheckpointing at iteration %lu. Total time: %.1lfs, %.2lf%% comms.\n",
 							iter, Global_total_time, 100.0*Global_comms_time/Global_total_time);
@@ -369,28 +464,44 @@ int main(int argc, char *argv[]) {
 				fflush(stdout);
 			}
 
-			save_lattice(&l, f, c, p.latticefile);
+			save_lattice(&l, f, c, &p, p.latticefile);
 			// update max iterations etc if the config file has been changed by the user
 			read_updated_parameters(argv[1], &l, &p);
+			timer_stop(TIMER_CHECKPOINT);
+
+			// wall-clock times per iteration since the last checkpoint
+			write_timings(&l, "timings", iter, iter - timings_iter);
+			timings_iter = iter;
 		} // end checkpoint
 
 		iter++;
 
 	} // end main loop
 
+	free_results(&results);
 	if (p.resultsfile != NULL)	{
 		fclose(p.resultsfile);
 	}
 
-	end_time = clock();
-	timing = ((double) (end_time - start_time)) / CLOCKS_PER_SEC;
+	end_time = wall_time();
+	timing = end_time - start_time;
 
 	Global_total_time += timing;
 	c.iter = iter;
 	// save final configuration
-	save_lattice(&l, f, c, p.latticefile);
+	save_lattice(&l, f, c, &p, p.latticefile);
 
 	// free memory and finish
+	#ifdef GRADFLOW
+		if (p.do_flow) {
+			free_flow(&l, &flow);
+		}
+	#endif
+	#ifdef HMC
+		if (p.hmc_trajectories > 0) {
+			free_hmc(&l, &hmc);
+		}
+	#endif
 	free_fields(&l, &f);
 	if (!l.rank)
 		printf("Freed memory allocated for fields.\n");
@@ -399,6 +510,14 @@ int main(int argc, char *argv[]) {
 		free_muca_arrays(&f, &w);
 	}
 
+	#ifdef HB_TRAJECTORY
+		if (p.do_trajectory) free_replicas(&traj);
+	#endif
+
+	#ifdef MEASURE_Z
+		if (p.do_z_meas) free(p.z_obs);
+	#endif
+
 	free_lattice(&l);
 	#ifdef BLOCKING
 		for (int k=0; k<block_levels; k++) {
@@ -10,67 +10,90 @@
 
 #include "su2.h"
 
-/* Print data labels for measurements (into a separate label file)
+// max number of doubles kept in the binary results buffer before it is written to file
+#define MAX_RESULTS_BUFFER (1 << 22)
+
+/* Write a single column label and advance the column counter k.
+* If f is NULL, only counts the columns. */
+static void add_label(FILE* f, int* k, char* label) {
+	if (f != NULL) fprintf(f, "%d %s\n", *k, label);
+	(*k)++;
+}
+
+/* Write data labels for measurements into the given file, one column per line.
+* With f = NULL nothing is written, so this can be used to count the columns in any node.
+* Return value is the number of columns produced by measure().
 */
-void print_labels() {
-	FILE* f = fopen("labels", "w+");
+int write_labels(FILE* f) {
 
 	int k = 1;
-	fprintf(f, "%d weight\n", k); k++; // multicanonical weight
-	fprintf(f, "%d muca param\n", k); k++; // multicanonical order parameter value
-	fprintf(f, "%d action\n", k); k++;
-	fprintf(f, "%d SU(2) Wilson (divided by beta)\n", k); k++;
+	add_label(f, &k, "weight"); // multicanonical weight
+	add_label(f, &k, "muca param"); // multicanonical order parameter value
+	add_label(f, &k, "action");
+	add_label(f, &k, "SU(2) Wilson (divided by beta)");
 	#ifdef U1
-		fprintf(f, "%d U(1) Wilson (divided by beta)\n", k); k++;
+		add_label(f, &k, "U(1) Wilson (divided by beta)");
 	#endif
 	#if (NHIGGS > 0)
-		fprintf(f, "%d 2*(phi^2 - phi^+(x) U_i(x) phi(x+i)) (avg over directions)\n", k); k++;
-		fprintf(f, "%d phi^2\n", k); k++;
-		fprintf(f, "%d phi^4\n", k); k++;
+		add_label(f, &k, "2*(phi^2 - phi^+(x) U_i(x) phi(x+i)) (avg over directions)");
+		add_label(f, &k, "phi^2");
+		add_label(f, &k, "phi^4");
 	#endif
 	#if (NHIGGS == 2)
-		fprintf(f, "%d 2*(phi^2 - phi^+(x) U_i(x) phi(x+i)) for phi_2 (avg over directions)\n", k); k++;
-		fprintf(f, "%d phi2^2\n", k); k++;
-		fprintf(f, "%d phi2^4\n", k); k++;
-		fprintf(f, "%d R = Re phi1^+ phi2\n", k); k++;
-		fprintf(f, "%d I = Im phi1^+ phi2\n", k); k++;
+		add_label(f, &k, "2*(phi^2 - phi^+(x) U_i(x) phi(x+i)) for phi_2 (avg over directions)");
+		add_label(f, &k, "phi2^2");
+		add_label(f, &k, "phi2^4");
+		add_label(f, &k, "R = Re phi1^+ phi2");
+		add_label(f, &k, "I = Im phi1^+ phi2");
 	#endif
 	#ifdef TRIPLET
-		fprintf(f, "%d hopping_Sigma (avg over directions)\n", k); k++;
-		fprintf(f, "%d Sigma^2\n", k); k++;
-		fprintf(f, "%d Sigma^4\n", k); k++;
+		add_label(f, &k, "hopping_Sigma (avg over directions)");
+		add_label(f, &k, "Sigma^2");
+		add_label(f, &k, "Sigma^4");
 	#endif
 	#if (NHIGGS > 0) && defined TRIPLET
-		fprintf(f, "%d phi^2 Sigma^2\n", k); k++;
+		add_label(f, &k, "phi^2 Sigma^2");
 	#endif
 	#ifdef TRIPLET
-		fprintf(f, "%d total magnetic charge density\n", k); k++;
-		fprintf(f, "%d number of magnetic monopoles\n", k); k++;
+		add_label(f, &k, "total magnetic charge density");
+		add_label(f, &k, "number of magnetic monopoles");
 	#endif
 	#ifdef SINGLET
-		fprintf(f, "%d S^2 - S(x)S(x+i) (avg over directions)\n", k); k++;
-		fprintf(f, "%d S\n", k); k++;
-		fprintf(f, "%d S^2\n", k); k++;
-		fprintf(f, "%d S^3\n", k); k++;
-		fprintf(f, "%d S^4\n", k); k++;
+		add_label(f, &k, "S^2 - S(x)S(x+i) (avg over directions)");
+		add_label(f, &k, "S");
+		add_label(f, &k, "S^2");
+		add_label(f, &k, "S^3");
+		add_label(f, &k, "S^4");
 		#if (NHIGGS==1)
-			fprintf(f, "%d S phi^2\n", k); k++;
-			fprintf(f, "%d S^2 phi^2\n", k); k++;
+			add_label(f, &k, "S phi^2");
+			add_label(f, &k, "S^2 phi^2");
 		#endif
 	#endif
 
 
+	return k-1;
+}
+
+/* Print data labels for measurements (into a separate label file).
+* Returns the number of columns. */
+int print_labels() {
+	FILE* f = fopen("labels", "w+");
+	int columns = write_labels(f);
 	fclose(f);
+	return columns;
 }
 
 
-/* Measure observables and write them to file.
-* Argument file is typically l->resultsfile, but is anyway specified here in case
-* we want to use the same function for writing different files (e.g. for realtime trajectories)
+/* Measure observables and write them to the results buffer 'out'.
+* The output is typically the main results file, but is anyway specified here in case
+* we want to use the same function for writing different files (e.g. for gradient flows).
+*
+* All observables are evaluated in a single pass over the lattice. Terms that appear both
+* in the total action and in individual observables (Wilson actions, hopping terms)
+* are calculated only once per site. The volume averages are then packed into one array
+* in the same order as in write_labels() and combined from all nodes with a single reduction.
 */
-void measure(FILE* file, lattice const* l, fields const* f, params const* p, weight* w) {
-
-	double start, end, time;
+void measure(results_buffer* out, lattice const* l, fields const* f, params const* p, weight* w) {
 
 	// observables that we want to measure
 	double action = 0.0;
@@ -106,12 +129,18 @@ void measure(FILE* file, lattice const* l, fields const* f, params const* p, wei
 	double Sphisq = 0.0;
 	double S2phisq = 0.0;
 
-	// some overlap here. action_local() already calculates local wilson action, hopping terms etc.
+	/* Same terms as in action_local(), but the pieces are also stored as observables */
 	for (long i=0; i<l->sites; i++) {
-		action += action_local(l, f, p, i);
-		wilson += local_su2wilson(l, f, p, i);
+
+		double wil = local_su2wilson(l, f, p, i);
+		wilson += wil;
+		// higgspotential() includes potentials for all scalars
+		double act = wil + higgspotential(f, p, i);
+
 		#ifdef U1
-			u1wilson += local_u1wilson(l, f, p, i);
+			double u1wil = local_u1wilson(l, f, p, i);
+			u1wilson += u1wil;
+			act += u1wil;
 		#endif
 
 		double mod = 0.0;
@@ -121,16 +150,18 @@ void measure(FILE* file, lattice const* l, fields const* f, params const* p, wei
 			for (int db=0; db<NHIGGS; db++) {
 
 				mod = doubletsq(f->su2doublet[db][i]);
-				// Covariant derivative, includes all directions
-				covariant_phi[db] += covariant_doublet(l, f, i, db);
+				// Covariant derivative, includes all directions. Same as covariant_doublet()
+				double cov = 2.0 * l->dim * mod;
+				for (int dir=0; dir<l->dim; dir++) {
+					cov += hopping_doublet_forward(l, f, i, dir, db);
+				}
+				covariant_phi[db] += cov;
+				act += cov;
 				phi2[db] += mod;
 				phi4[db] += mod*mod;
 			}
-
-			#ifdef TRIPLET // only implemented for one Higgs!!
-				mod = doubletsq(f->su2doublet[0][i]);
-				phi2Sigma2 += mod * tripletsq(f->su2triplet[i]);
-			#endif
+			// keep mod = phi^2 for the first doublet for use below
+			mod = doubletsq(f->su2doublet[0][i]);
 
 		#endif
 
@@ -145,9 +176,17 @@ void measure(FILE* file, lattice const* l, fields const* f, params const* p, wei
 			double tripletmod = tripletsq(f->su2triplet[i]);
 			Sigma2 += tripletmod;
 			Sigma4 += tripletmod * tripletmod;
+			// hopping terms, same as in covariant_triplet()
+			double hop = 0.0;
 			for (int dir=0; dir<l->dim; dir++) {
-				hopping_Sigma += hopping_triplet_forward(l, f, p, i, dir);
+				hop += hopping_triplet_forward(l, f, p, i, dir);
 			}
+			hopping_Sigma += hop;
+			act += 2.0 * l->dim * tripletmod + hop;
+
+			#if (NHIGGS > 0) // only implemented for one Higgs!!
+				phi2Sigma2 += mod * tripletmod;
+			#endif
 
 			// calculate charge density of magnetic monopoles
 			double charge = magcharge_cube(l, f, p, i);
@@ -157,155 +196,214 @@ void measure(FILE* file, lattice const* l, fields const* f, params const* p, wei
 
 		#ifdef SINGLET
 			double S = f->singlet[i][0];
+			// kinetic term, rest is in higgspotential()
+			double kin = 0.0;
 			for (int dir=0; dir<l->dim; dir++) {
-				double S_next = f->singlet[ l->next[i][dir] ][0]; 
-				singlet_covariant += S*S - S*S_next;
+				double S_next = f->singlet[ l->next[i][dir] ][0];
+				kin += S*S - S*S_next;
 			}
+			singlet_covariant += kin;
+			act += kin;
 			singlet += S;
 			singlet2 += S*S;
 			singlet3 += S*S*S;
 			singlet4 += S*S*S*S;
 			#if (NHIGGS == 1)
-				mod = doubletsq(f->su2doublet[0][i]);
 				Sphisq += mod * S;
 				S2phisq += mod * S * S;
 			#endif
 		#endif
-	}
 
-	// combine results from all nodes.
-	start = clock();
-
-	// multicanonical weight and order parameter value
-	double weight = 0.0;
-	double muca_param = 0.0;
-	if (p->multicanonical) {
-		muca_param = w->param_value[EVEN] + w->param_value[ODD];
-		weight = get_weight(w, muca_param);
+		action += act;
 	}
-	// our muca action is S' = S + W, but Kari uses S = S - W.
-	// store weight with a minus sign here to ensure compability with Kari's tools
-	weight = -1.0 * weight;
 
-	// collect from other nodes
-	action = reduce_sum(action, l->comm);
-	wilson = reduce_sum(wilson, l->comm);
+	/* Pack the volume averages in the same order as in write_labels().
+	* For hopping terms and gauge actions, take also the average over directions.
+	* For Wilson gauge actions I divide by their respective beta, which was included in local_su2wilson() etc.
+	* The first two columns are the multicanonical weight and order parameter, filled in after the reduction. */
+	double vol = ((double) l->vol);
+	double res[out->columns];
+	int k = 0;
+	res[k++] = 0.0; res[k++] = 0.0;
+	res[k++] = action; res[k++] = wilson / (vol * p->betasu2);
 	#ifdef U1
-	u1wilson = reduce_sum(u1wilson, l->comm);
+		res[k++] = u1wilson / (vol * p->betau1);
 	#endif
 
-	#if (NHIGGS > 0)
+	#if (NHIGGS > 0 )
 	for (int db=0; db<NHIGGS; db++) {
-		covariant_phi[db] = reduce_sum(covariant_phi[db], l->comm);
-		phi2[db] = reduce_sum(phi2[db], l->comm);
-		phi4[db] = reduce_sum(phi4[db], l->comm);
+		res[k++] = covariant_phi[db]/(vol * l->dim);
+		res[k++] = phi2[db]/vol;
+		res[k++] = phi4[db]/vol;
 	}
 	#endif
 
 	#if (NHIGGS == 2)
-		phi12.re = reduce_sum(phi12.re, l->comm);
-		phi12.im = reduce_sum(phi12.im, l->comm);
+		res[k++] = phi12.re/vol; res[k++] = phi12.im/vol;
 	#endif
 
 	#ifdef TRIPLET
-	hopping_Sigma = reduce_sum(hopping_Sigma, l->comm);
-	Sigma2 = reduce_sum(Sigma2, l->comm);
-	Sigma4 = reduce_sum(Sigma4, l->comm);
-	mag_charge = reduce_sum(mag_charge, l->comm);
-	mag_charge_abs = reduce_sum(mag_charge_abs, l->comm);
-	// magnetic charge should be quantized in units of 4pi/g
-	mag_charge_abs /= (2.0*M_PI*sqrt(p->betasu2)); // this is now the total number of monopoles
+		res[k++] = hopping_Sigma/(vol * l->dim);
+		res[k++] = Sigma2/vol;
+		res[k++] = Sigma4/vol;
 		#if (NHIGGS > 0)
-		phi2Sigma2 = reduce_sum(phi2Sigma2, l->comm);
+			res[k++] = phi2Sigma2/vol;
 		#endif
 	#endif
+	#ifdef TRIPLET
+		// store total magnetic charge density (should be ~0)
+		// and number of monopoles + antimonopoles (should be an integer).
+		// magnetic charge should be quantized in units of 4pi/g
+		res[k++] = mag_charge;
+		res[k++] = mag_charge_abs / (2.0*M_PI*sqrt(p->betasu2));
+	#endif
 
 	#ifdef SINGLET
-		singlet_covariant = reduce_sum(singlet_covariant, l->comm);
-		singlet = reduce_sum(singlet, l->comm);
-		singlet2 = reduce_sum(singlet2, l->comm);
-		singlet3 = reduce_sum(singlet3, l->comm);
-		singlet4 = reduce_sum(singlet4, l->comm);
-		#if (NHIGGS==1)
-			Sphisq = reduce_sum(Sphisq, l->comm);
-			S2phisq = reduce_sum(S2phisq, l->comm);
+		res[k++] = singlet_covariant / (vol * l->dim);
+		res[k++] = singlet/vol; res[k++] = singlet2/vol;
+		res[k++] = singlet3/vol; res[k++] = singlet4/vol;
+		#if (NHIGGS == 1)
+			res[k++] = Sphisq/vol; res[k++] = S2phisq/vol;
 		#endif
 	#endif
 
+	if (k != out->columns) {
+		printf0("!!! Error in measure(): got %d observables but %d labels\n", k, out->columns);
+		die(701);
+	}
+
+	// combine results from all nodes.
+	double start = wall_time();
+	reduce_sum_array(res, k, l->comm);
 
 	#ifdef GRADFLOW
 		// for debugging
-		Global_current_action = action;
+		Global_current_action = res[2];
 	#endif
 
-	end = clock();
-	time = ((double) (end - start)) / CLOCKS_PER_SEC;
-	Global_comms_time += time;
+	Global_comms_time += wall_time() - start;
 
-	/* write volume averages to file. For hopping terms and gauge actions,
-	* take also the average over directions */
+	// Write to the file from root node
+	if (!l->rank) {
+		// multicanonical weight and order parameter value
+		double weight = 0.0;
+		double muca_param = 0.0;
+		if (p->multicanonical) {
+			muca_param = w->param_value[EVEN] + w->param_value[ODD];
+			weight = get_weight(w, muca_param);
+		}
+		// our muca action is S' = S + W, but Kari uses S = S - W.
+		// store weight with a minus sign here to ensure compability with Kari's tools
+		res[0] = -1.0 * weight;
+		res[1] = muca_param;
 
-	double vol = ((double) l->vol);
+		write_results(out, res);
+	}
 
-	// Write to the file from root node. Use same ordering here as in print_labels()
-	// For Wilson gauge actions I divide by their respective beta, which was included in local_su2wilson() etc
-	if (!l->rank) {
-		fprintf(file, "%g %g ", weight, muca_param);
-		fprintf(file, "%g %g ",
-			action, wilson / (vol * p->betasu2)
-		);
-		#ifdef U1
-			fprintf(file, "%g ", u1wilson / (vol * p->betau1));
-		#endif
+}
 
-		#if (NHIGGS > 0 )
-		for (int db=0; db<NHIGGS; db++) {
-			fprintf(file, "%g %g %g ",
-				covariant_phi[db]/(vol * l->dim), phi2[db]/vol, phi4[db]/vol
-			);
+
+/* Prepare a results buffer for measure(). Needs to be called in all nodes,
+* but the file only needs to be open in the root node.
+* binary = 0: each measurement is written immediately as a line of text ("%g" format).
+* binary = 1: measurements are stored as fixed-width binary records (one double per column)
+* in a buffer of max_records records, and only written to file in flush_results().
+* The binary file starts with a header written by write_results_header(); if the file is not empty,
+* we instead check that the existing header is compatible and append to it. */
+void init_results(results_buffer* out, FILE* file, int binary, long max_records) {
+
+	out->file = file;
+	out->binary = binary;
+	out->columns = write_labels(NULL);
+	out->records = 0;
+	out->max_records = 0;
+	out->buf = NULL;
+
+	if (!binary) return;
+
+	// keep the buffer at a reasonable size
+	if (max_records * out->columns > MAX_RESULTS_BUFFER) max_records = MAX_RESULTS_BUFFER / out->columns;
+	if (max_records < 1) max_records = 1;
+	out->max_records = max_records;
+
+	int ok = 1;
+	if (!myRank) {
+		out->buf = malloc(max_records * out->columns * sizeof(*(out->buf)));
+		if (out->buf == NULL) {
+			printf("Failed to allocate memory for results buffer!\n");
+			ok = 0;
 		}
-		#endif
 
-		#if (NHIGGS == 2)
-		fprintf(file, "%g %g ",
-			phi12.re/vol, phi12.im/vol
-		);
-		#endif
+		fseek(file, 0, SEEK_END);
+		if (ok && ftell(file) == 0) {
+			write_results_header(file, out->columns);
+		} else if (ok) {
+			// existing file, check that the number of columns matches
+			char magic[sizeof(RESULTS_MAGIC)];
+			int columns = -1;
+			rewind(file);
+			if (fread(magic, sizeof(magic), 1, file) != 1 || strncmp(magic, RESULTS_MAGIC, sizeof(magic))
+					|| fread(&columns, sizeof(columns), 1, file) != 1 || columns != out->columns) {
+				printf("!!! Existing results file is not a compatible binary file (got %d columns, expected %d)\n",
+					columns, out->columns);
+				ok = 0;
+			}
+			fseek(file, 0, SEEK_END);
+		}
+	}
+	bcast_int(&ok, MPI_COMM_WORLD);
+	if (!ok) die(702);
+}
 
-		#ifdef TRIPLET
-			fprintf(file, "%g %g %g ",
-				hopping_Sigma/(vol * l->dim), Sigma2/vol, Sigma4/vol
-			);
-			#if (NHIGGS > 0)
-			fprintf(file, "%g ",
-				phi2Sigma2/vol
-			);
-			#endif
-		#endif
-		#ifdef TRIPLET
-			// store total magnetic charge density (should be ~0)
-			// and number of monopoles + antimonopoles (should be an integer)
-			fprintf(file, "%g %g ", mag_charge, mag_charge_abs );
-		#endif
+/* Header for binary results files: magic string, number of columns (int)
+* and the contents of the "labels" file terminated by a null character. */
+void write_results_header(FILE* file, int columns) {
+	fwrite(RESULTS_MAGIC, sizeof(RESULTS_MAGIC), 1, file);
+	fwrite(&columns, sizeof(columns), 1, file);
+	write_labels(file);
+	fputc('\0', file);
+	fflush(file);
+}
 
-		#ifdef SINGLET
-			fprintf(file, "%g ",
-				singlet_covariant / (vol * l->dim)
-			);
-			fprintf(file, "%g %g %g %g ",
-				singlet/vol, singlet2/vol, singlet3/vol, singlet4/vol
-			);
-			#if (NHIGGS == 1)
-				fprintf(file, "%g %g ",
-					Sphisq/vol, S2phisq/vol
-				);
-			#endif
-		#endif
+/* Write one measurement (out->columns values) from the root node.
+* In binary mode the record is only copied to the buffer, which is flushed when full. */
+void write_results(results_buffer* out, double const* res) {
 
-		fprintf(file, "\n"); // end write
-		fflush(file);
+	if (!out->binary) {
+		for (int k=0; k<out->columns; k++) {
+			fprintf(out->file, "%g ", res[k]);
+		}
+		fprintf(out->file, "\n"); // end write
+		fflush(out->file);
+		return;
 	}
 
+	memcpy(&out->buf[out->records * out->columns], res, out->columns * sizeof(*res));
+	out->records++;
+	if (out->records >= out->max_records) {
+		flush_results(out);
+	}
+}
+
+/* Write all buffered binary records to file. Called at checkpoints,
+* does nothing in non-root nodes or in text mode. */
+void flush_results(results_buffer* out) {
+
+	if (myRank || !out->binary || out->records <= 0) return;
+
+	long written = fwrite(out->buf, out->columns * sizeof(*(out->buf)), out->records, out->file);
+	if (written != out->records) {
+		printf("!!! WARNING: wrote only %ld of %ld measurements to results file!\n", written, out->records);
+	}
+	fflush(out->file);
+	out->records = 0;
+}
+
+/* Flush remaining measurements and free the buffer. Does not close the file. */
+void free_results(results_buffer* out) {
+	flush_results(out);
+	free(out->buf);
+	out->buf = NULL;
 }
 
 
@@ -343,145 +441,158 @@ double action_local(lattice const* l, fields const* f, params const* p, long i)
 }
 
 
-/* Make a label file for local measurements. */
-void print_labels_local(lattice const* l, char* fname) {
-	FILE* f = fopen(fname, "w+");
+/* Write labels for local measurements into the given file, or just count them if f = NULL.
+* Return value is the number of observables per site. */
+int write_labels_local(FILE* f) {
 
 	int k = 1;
-	// first columns are the site coordinates
-	for (int dir=0; dir<l->dim; dir++) {
-		fprintf(f, "%d x%d\n", k, dir); k++;
-	}
+	#if (NHIGGS > 0)
+		for (int db=0; db<NHIGGS; db++) {
+			char label[50];
+			sprintf(label, "phi^2 (doublet %d)", db+1);
+			add_label(f, &k, label);
+		}
+	#endif
 	#ifdef TRIPLET
-		fprintf(f, "%d Sigma^2\n", k); k++;
-		fprintf(f, "%d magnetic charge (integer)\n", k); k++;
+		add_label(f, &k, "Sigma^2");
+		add_label(f, &k, "magnetic charge (integer)");
+	#endif
+	#ifdef SINGLET
+		add_label(f, &k, "S");
 	#endif
 
+	return k-1;
+}
+
+/* Make a label file for local measurements. Site coordinates are not stored in the
+* measurement files; instead the sites are in the natural ordering of the full lattice,
+* see write_local_field(). */
+void print_labels_local(lattice const* l, char* fname) {
+	FILE* f = fopen(fname, "w+");
+	write_labels_local(f);
 	fclose(f);
 }
 
 /* Measures and writes quantities locally at each site. Extensive!
-* Output is not in any particular order in terms of the coordinates.
-* Assumes that sites in each node are ordered in the same fashion
-* and that all nodes have the same number of (real) sites!
-* Could also just send the coordinates, but this needs more comms and/or memory... */
+* Output is a binary file written by write_local_field(), so the site coordinates are implicit. */
 void measure_local(char* fname, lattice const* l, fields const* f, params const* p) {
 
-	FILE* file;
+	int n_meas = write_labels_local(NULL);
+	if (n_meas <= 0) return;
 
-	int n_meas = 1; // includes offset!
-	#ifdef TRIPLET
-		// Tr Sigma^2 = 0.5*Sigma^a Sigma^a
-		double Sigma2[l->sites]; n_meas++;
-		double magcharge[l->sites]; n_meas++;
-	#endif
+	double* meas = malloc(l->sites * n_meas * sizeof(*meas));
 
 	for (long i=0; i<l->sites; i++) {
 
-		#ifdef TRIPLET
-
-			Sigma2[i] = tripletsq(f->su2triplet[i]);
-			magcharge[i] = magcharge_cube(l, f, p, i) / (2.0*M_PI*sqrt(p->betasu2)); // integer!
+		double* m = &meas[i * n_meas];
+		int k = 0;
+		#if (NHIGGS > 0)
+			for (int db=0; db<NHIGGS; db++) {
+				m[k] = doubletsq(f->su2doublet[db][i]); k++;
+			}
 		#endif
-	} // end i
-
-	if (!l->rank) {
-		file = fopen(fname, "wb");
-	}
 
-	int coord_offset[l->dim];
-	for (int dir=0; dir<l->dim; dir++) {
-		coord_offset[dir] = l->offset[dir];
-	}
-
-	#ifdef MPI
-	/* Send everything to root node for writing.
-	* There will be one send per measurement array, incl. offset.
-	* So need tags to avoid errors, but I use blocking sends. */
-	int tag = 0;
-	if (l->rank != 0) {
-		MPI_Send(&coord_offset, l->dim, MPI_INT, 0, tag, MPI_COMM_WORLD); tag++;
 		#ifdef TRIPLET
-			MPI_Send(&Sigma2, l->sites, MPI_DOUBLE, 0, tag, MPI_COMM_WORLD); tag++;
-			MPI_Send(&magcharge, l->sites, MPI_DOUBLE, 0, tag, MPI_COMM_WORLD); tag++;
+			// Tr Sigma^2 = 0.5*Sigma^a Sigma^a
+			m[k] = tripletsq(f->su2triplet[i]); k++;
+			m[k] = magcharge_cube(l, f, p, i) / (2.0*M_PI*sqrt(p->betasu2)); k++; // integer!
 		#endif
-	}
-
-	#endif
-
 
+		#ifdef SINGLET
+			m[k] = f->singlet[i][0]; k++;
+		#endif
+	} // end i
 
-	if (!l->rank) {
-		// loop over MPI ranks
-		for (int r=0; r<l->size; r++) {
-
-			#ifdef MPI
-			// get the data and offsets from rank == r node (if r=0, just write own meas)
-			if (r != 0) {
-				tag = 0;
-				MPI_Recv(&coord_offset, l->dim, MPI_INT, r, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE); tag++;
-				#ifdef TRIPLET
-					MPI_Recv(&Sigma2, l->sites, MPI_DOUBLE, r, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE); tag++;
-					MPI_Recv(&magcharge, l->sites, MPI_DOUBLE, r, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE); tag++;
-				#endif
-			}
-			#endif
-
-			for (long i=0; i<l->sites; i++) {
-
+	write_local_field(fname, l, meas, n_meas);
+	free(meas);
+}
 
-				// Binary: smaller files
-				int coords[l->dim];
-				for (int dir=0; dir<l->dim; dir++) {
-					coords[dir] = l->coords[i][dir] + coord_offset[dir];
-				}
 
-				fwrite(coords, sizeof(*coords), l->dim, file);
+/* Write a site-dependent array to a binary file. 'data' has n components per site,
+* accessed as data[i*n + k] with i running over real sites in my node.
+* In the file, sites are in the natural ordering of the full lattice (see coordsToIndex(),
+* x[0] runs fastest) so that coordinates need not be stored.
+* File layout: LOCAL_MAGIC, then dim, L[0], ..., L[dim-1] and n as ints, followed by vol*n doubles.
+* With MPI, all nodes write their own slice directly into the file using collective MPI-IO.
+* Assumes the standard layout where each node holds a hypercubic slice of size sliceL. */
+void write_local_field(char* fname, lattice const* l, double const* data, int n) {
 
-				// merge measurements at site=i to an array for writing
-				int k = 0;
-				double meas[n_meas - 1];
+	// reorder my sites into the natural ordering of my slice
+	double* buf = malloc(l->sites * n * sizeof(*buf));
+	int sliceL[l->dim];
+	for (int dir=0; dir<l->dim; dir++) {
+		sliceL[dir] = l->sliceL[dir];
+	}
+	for (long i=0; i<l->sites; i++) {
+		long x[l->dim];
+		for (int dir=0; dir<l->dim; dir++) {
+			x[dir] = l->coords[i][dir] - l->offset[dir];
+		}
+		long j = coordsToIndex(l->dim, sliceL, x);
+		memcpy(&buf[j*n], &data[i*n], n * sizeof(*buf));
+	}
 
-				#ifdef TRIPLET
-					meas[k] = Sigma2[i]; k++;
-					meas[k] = magcharge[i]; k++;
-				#endif
-				fwrite(meas, sizeof(*meas), n_meas - 1, file);
+	// header
+	int header_ints = l->dim + 2;
+	int header[header_ints];
+	header[0] = l->dim;
+	for (int dir=0; dir<l->dim; dir++) {
+		header[dir+1] = l->L[dir];
+	}
+	header[l->dim+1] = n;
 
-				fwrite("\n", sizeof(char), 1, file);
-				// end binary
+	#ifdef MPI
 
-				// Formatted: text files only
-				/*
-				// write coords
-				for (int dir=0; dir<l->dim; dir++) {
-					fprintf(file, "%ld ", l->coords[i][dir] + coord_offset[dir]);
-				}
-				// then the measurements
-				#ifdef TRIPLET
-					fprintf(file, "%g %g ", Sigma2[i], magcharge[i]);
-				#endif
+		long header_size = sizeof(LOCAL_MAGIC) + header_ints * sizeof(header[0]);
 
-				fprintf(file, "\n");
-				*/
+		/* My part of the file as a subarray of the full lattice. Array dimensions are in C order,
+		* so the slowest index comes first: (x[dim-1], ..., x[0], component) */
+		int sizes[l->dim+1], subsizes[l->dim+1], starts[l->dim+1];
+		for (int dir=0; dir<l->dim; dir++) {
+			sizes[l->dim-1-dir] = l->L[dir];
+			subsizes[l->dim-1-dir] = l->sliceL[dir];
+			starts[l->dim-1-dir] = l->offset[dir];
+		}
+		sizes[l->dim] = n; subsizes[l->dim] = n; starts[l->dim] = 0;
+
+		MPI_Datatype filetype;
+		MPI_Type_create_subarray(l->dim+1, sizes, subsizes, starts, MPI_ORDER_C, MPI_DOUBLE, &filetype);
+		MPI_Type_commit(&filetype);
+
+		MPI_File fh;
+		int err = MPI_File_open(l->comm, fname, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+		if (err != MPI_SUCCESS) {
+			printf0("!!! Unable to open file %s for local measurements\n", fname);
+			MPI_Type_free(&filetype);
+			free(buf);
+			return;
+		}
+		MPI_File_set_size(fh, 0); // overwrite any old file
 
-			} // end i
+		if (!l->rank) {
+			MPI_File_write_at(fh, 0, LOCAL_MAGIC, sizeof(LOCAL_MAGIC), MPI_CHAR, MPI_STATUS_IGNORE);
+			MPI_File_write_at(fh, sizeof(LOCAL_MAGIC), header, header_ints, MPI_INT, MPI_STATUS_IGNORE);
+		}
 
-		} // end r
+		MPI_File_set_view(fh, header_size, MPI_DOUBLE, filetype, "native", MPI_INFO_NULL);
+		MPI_File_write_all(fh, buf, l->sites * n, MPI_DOUBLE, MPI_STATUS_IGNORE);
+		MPI_File_close(&fh);
+		MPI_Type_free(&filetype);
 
-	}
+	#else
 
-	if (!l->rank) {
+		FILE* file = fopen(fname, "wb");
+		if (file == NULL) {
+			printf0("!!! Unable to open file %s for local measurements\n", fname);
+			free(buf);
+			return;
+		}
+		fwrite(LOCAL_MAGIC, sizeof(LOCAL_MAGIC), 1, file);
+		fwrite(header, sizeof(header[0]), header_ints, file);
+		fwrite(buf, sizeof(*buf), l->sites * n, file);
 		fclose(file);
-	}
 
-	/*
-	#ifdef MPI // wait for nonblocking sends to be received
-		for (int k=0; k<n_meas; k++) {
-			MPI_Wait(&req[k], MPI_STATUS_IGNORE);
-		}
-		barrier();
 	#endif
-	*/
 
+	free(buf);
 }
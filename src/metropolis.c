@@ -21,7 +21,7 @@ int metro_su2link(lattice const* l, fields* f, params const* p, long i, int dir)
 
 	// generate new link randomly
 	double newlink[4];
-	random_su2link(newlink);
+	random_su2link(newlink, p->metro_step_su2link);
 
 	su2rot(f->su2link[i][dir], newlink);
 
@@ -41,129 +41,261 @@ int metro_su2link(lattice const* l, fields* f, params const* p, long i, int dir)
 }
 
 #ifdef U1
-/* Update a single U(1) link using Metropolis.
+/* Update a single U(1) link using Metropolis with p->metro_hits proposals.
 * Remember that our links are U_i(x) = exp(i a_i(x))
-* and a_i(x) is in f.u1link
-* Returns 1 if update was accepted and 0 if rejected. */
+* and a_i(x) is in f.u1link.
+* The local action depends on the neighboring fields only through the
+* coefficients of u1link_staple(), so these are calculated once per site.
+* Returns the number of accepted proposals. */
 int metro_u1link(lattice const* l, fields* f, params const* p, long i, int dir) {
 
-	double oldlink = f->u1link[i][dir];
+	double* a = &f->u1link[i][dir];
+	double r = p->r_u1;
 
-	double linkact_old = localact_u1link(l, f, p, i, dir);
+	double k[4];
+	u1link_staple(l, f, p, i, dir, k);
 
-	// multiply link by a random phase (can adjust the overall number here)
-	f->u1link[i][dir] += 0.95*(dran() - 0.5);
+	double act_old = u1link_action(k, r, *a);
+	int accepted = 0;
 
-	double linkact_new = localact_u1link(l, f, p, i, dir);
+	for (int hit=0; hit<p->metro_hits; hit++) {
 
-	double diff = linkact_new - linkact_old;
-	if (diff < 0) {
-		return 1;
-	}
-	else if (diff > 0 && ( exp(-(diff)) > dran() )) {
-		return 1;
-	}
-	else {
-		f->u1link[i][dir] = oldlink;
-		return 0;
+		double oldlink = *a;
+		// multiply link by a random phase
+		*a += p->metro_step_u1link*(dran() - 0.5);
+
+		double act_new = u1link_action(k, r, *a);
+
+		double diff = act_new - act_old;
+		if (diff < 0 || exp(-(diff)) > dran()) {
+			act_old = act_new;
+			accepted++;
+		} else {
+			*a = oldlink;
+		}
 	}
+
+	return accepted;
 }
 #endif
 
 
 #if (NHIGGS > 0)
-/* Update an SU(2) scalar doublet using Metropolis.
-* Returns 1 if update was accepted and 0 if rejected */
+/* Local action of the doublet at site i in terms of the hopping "staple" s,
+* see staple_doublet(). Differs from localact_doublet() by a constant that
+* does not depend on the doublet at site i. */
+double localact_doublet_staple(lattice const* l, fields const* f, params const* p,
+			double const* s, long i, int higgs_id) {
+
+	double* phi = f->su2doublet[higgs_id][i];
+	double tot = s[0]*phi[0] + s[1]*phi[1] + s[2]*phi[2] + s[3]*phi[3];
+	// local part of the covariant derivative
+	tot += 2.0 * l->dim * doubletsq(phi);
+
+	return tot + higgspotential(f, p, i);
+}
+
+/* Update an SU(2) scalar doublet using Metropolis with p->metro_hits proposals.
+* The hopping terms are calculated only once per site.
+* Returns the number of accepted proposals */
 int metro_doublet(lattice const* l, fields* f, params const* p, long i, int higgs_id) {
 
 	double **phi = f->su2doublet[higgs_id];
 	double oldfield[4];
-	memcpy(oldfield, phi[i], SU2DB * sizeof(phi[i][0]));
 
-	double act_old = localact_doublet(l, f, p, i, higgs_id);
+	double s[SU2DB];
+	staple_doublet(s, l, f, p, i, higgs_id);
 
-	// modify the old field by random values
-	for (int k=0; k<SU2DB; k++) {
-		phi[i][k] += 1.0*(dran() - 0.5);
-	}
+	double act_old = localact_doublet_staple(l, f, p, s, i, higgs_id);
+	int accepted = 0;
 
-	double act_new = localact_doublet(l, f, p, i, higgs_id);
+	for (int hit=0; hit<p->metro_hits; hit++) {
 
-	int accept;
-	double diff = act_new - act_old;
-	if (diff < 0) {
-		accept = 1;
-	}
-	else if (diff > 0 && ( exp(-(diff)) > dran() )) {
-		accept = 1;
-	}
-	else {
-		memcpy(phi[i], oldfield, SU2DB * sizeof(phi[i][0]));
-		accept = 0;
+		memcpy(oldfield, phi[i], SU2DB * sizeof(phi[i][0]));
+
+		// modify the old field by random values
+		for (int k=0; k<SU2DB; k++) {
+			phi[i][k] += p->metro_step_doublet*(dran() - 0.5);
+		}
+
+		double act_new = localact_doublet_staple(l, f, p, s, i, higgs_id);
+
+		double diff = act_new - act_old;
+		if (diff < 0 || exp(-(diff)) > dran()) {
+			act_old = act_new;
+			accepted++;
+		} else {
+			memcpy(phi[i], oldfield, SU2DB * sizeof(phi[i][0]));
+		}
 	}
 
-	return accept;
+	return accepted;
 }
 
 #endif // if (NHIGGS > 0)
 
 
-/* Update a single SU(2) scalar triplet using Metropolis.
-* Returns 1 if update was accepted and 0 if rejected. */
+#ifdef TRIPLET
+/* Local action of the triplet at site i in terms of the hopping "staple" s,
+* see staple_triplet(). Differs from localact_triplet() by a constant that
+* does not depend on the triplet at site i. */
+double localact_triplet_staple(lattice const* l, fields const* f, params const* p,
+			double const* s, long i) {
+
+	double* a = f->su2triplet[i];
+	double mod = tripletsq(a);
+	// hopping terms and the local part of the covariant derivative
+	double tot = s[0]*a[0] + s[1]*a[1] + s[2]*a[2] + 2.0 * l->dim * mod;
+
+	tot += p->msq_triplet * mod + p->b4 * mod * mod;
+	#if (NHIGGS > 0)
+		tot += p->a2 * doubletsq(f->su2doublet[0][i]) * mod;
+	#endif
+
+	return tot;
+}
+
+/* Update a single SU(2) scalar triplet using Metropolis with p->metro_hits proposals.
+* The hopping terms are calculated only once per site.
+* Returns the number of accepted proposals. */
 int metro_triplet(lattice const* l, fields* f, params const* p, long i) {
 
-	double oldfield[3];
-	oldfield[0] = f->su2triplet[i][0];
-	oldfield[1] = f->su2triplet[i][1];
-	oldfield[2] = f->su2triplet[i][2];
+	double* a = f->su2triplet[i];
+	double oldfield[SU2TRIP];
 
-	double act_old = localact_triplet(l, f, p, i);
+	double s[SU2TRIP];
+	staple_triplet(s, l, f, p, i);
+	double act_old = localact_triplet_staple(l, f, p, s, i);
+	int accepted = 0;
 
-	// modify the old field by random values
-	f->su2triplet[i][0] += 1.0*(dran() - 0.5);
-	f->su2triplet[i][1] += 1.0*(dran() - 0.5);
-	f->su2triplet[i][2] += 1.0*(dran() - 0.5);
+	for (int hit=0; hit<p->metro_hits; hit++) {
 
+		memcpy(oldfield, a, SU2TRIP*sizeof(double));
+		// modify the old field by random values
+		a[0] += p->metro_step_triplet*(dran() - 0.5);
+		a[1] += p->metro_step_triplet*(dran() - 0.5);
+		a[2] += p->metro_step_triplet*(dran() - 0.5);
 
-	double act_new = localact_triplet(l, f, p, i);
+		double act_new = localact_triplet_staple(l, f, p, s, i);
 
-	double diff = act_new - act_old;
-	if (diff < 0) {
-		return 1;
-	}
-	else if (diff > 0 && ( exp(-(diff)) > dran() )) {
-		return 1;
-	}
-	else {
-		f->su2triplet[i][0] = oldfield[0];
-		f->su2triplet[i][1] = oldfield[1];
-		f->su2triplet[i][2] = oldfield[2];
-		return 0;
+		double diff = act_new - act_old;
+		if (diff < 0 || exp(-(diff)) > dran()) {
+			act_old = act_new;
+			accepted++;
+		} else {
+			memcpy(a, oldfield, SU2TRIP*sizeof(double));
+		}
 	}
+
+	return accepted;
 }
+#endif // TRIPLET
 
 #ifdef SINGLET
 
-/* Metropolis update for a singlet field at site i */
+/* Local action of the singlet at site i in terms of the sum nn of the singlet
+* at the nearest neighbors, see staple_singlet(). Equal to localact_singlet(). */
+double localact_singlet_staple(lattice const* l, fields const* f, params const* p, double nn, long i) {
+	double S = f->singlet[i][0];
+	// kinetic term \sum_{x,i} [S(x)^2 - S(x)S(x+i)], see localact_singlet()
+	return l->dim * S*S - S * nn + potential_singlet(f, p, i);
+}
+
+/* Metropolis update for a singlet field at site i with p->metro_hits proposals.
+* Neighbors enter the action only through their sum, which is calculated once.
+* Returns the number of accepted proposals */
 int metro_singlet(lattice const* l, fields* f, params const* p, long i) {
-	double oldfield = f->singlet[i][0];
-	double act_old = localact_singlet(l, f, p, i);
 
-	f->singlet[i][0] += 1.0*(dran() - 0.5);
-	double act_new = localact_singlet(l, f, p, i);
+	double* S = &f->singlet[i][0];
+	double nn = staple_singlet(l, f, i);
 
-	double diff = act_new - act_old;
-	if (diff < 0) {
-		return 1;
-	}
-	else if (diff > 0 && ( exp(-(diff)) > dran() )) {
-		return 1;
-	}
-	else {
-		f->singlet[i][0] = oldfield;
-		return 0;
+	double act_old = localact_singlet_staple(l, f, p, nn, i);
+	int accepted = 0;
+
+	for (int hit=0; hit<p->metro_hits; hit++) {
+
+		double oldfield = *S;
+		*S += p->metro_step_singlet*(dran() - 0.5);
+
+		double act_new = localact_singlet_staple(l, f, p, nn, i);
+
+		double diff = act_new - act_old;
+		if (diff < 0 || exp(-(diff)) > dran()) {
+			act_old = act_new;
+			accepted++;
+		} else {
+			*S = oldfield;
+		}
 	}
 
+	return accepted;
 }
 
 #endif
+
+
+/* Adjust the Metropolis step sizes towards acceptance rate p->metro_target,
+* using the proposals made since the previous call. The step is multiplied by
+* exp(acceptance - target), which stabilizes at the target rate.
+* Counts are summed over nodes so that all nodes end up with the same steps.
+* 'prev' holds the counters at the previous call and is updated here.
+* Only called during thermalization, so the steps are fixed during measurements. */
+void tune_metropolis(lattice const* l, params* p, counters const* c, counters* prev) {
+
+	// max number of fields with Metropolis steps, and the counts for each
+	double* step[5];
+	double acc[10] = {0}; // accepted in acc[k], total in acc[5+k]
+	int n = 0;
+
+	// SU(2) counters include heatbath updates, so tune only if using Metropolis
+	if (p->algorithm_su2link == METROPOLIS) {
+		step[n] = &p->metro_step_su2link;
+		acc[n] = c->accepted_su2link - prev->accepted_su2link;
+		acc[5+n] = c->total_su2link - prev->total_su2link;
+		n++;
+	}
+
+	#ifdef U1
+		if (p->algorithm_u1link == METROPOLIS || p->algorithm_u1link == OVERRELAX) {
+			step[n] = &p->metro_step_u1link;
+			acc[n] = c->accepted_u1link - prev->accepted_u1link;
+			acc[5+n] = c->total_u1link - prev->total_u1link;
+			n++;
+		}
+	#endif
+
+	// scalar counters count Metropolis proposals only (overrelaxation has its own)
+	#if (NHIGGS > 0)
+		step[n] = &p->metro_step_doublet;
+		acc[n] = 0.0; acc[5+n] = 0.0;
+		for (int db=0; db<NHIGGS; db++) {
+			acc[n] += c->accepted_doublet[db] - prev->accepted_doublet[db];
+			acc[5+n] += c->total_doublet[db] - prev->total_doublet[db];
+		}
+		n++;
+	#endif
+
+	#ifdef TRIPLET
+		step[n] = &p->metro_step_triplet;
+		acc[n] = c->accepted_triplet - prev->accepted_triplet;
+		acc[5+n] = c->total_triplet - prev->total_triplet;
+		n++;
+	#endif
+
+	#ifdef SINGLET
+		step[n] = &p->metro_step_singlet;
+		acc[n] = c->accepted_singlet - prev->accepted_singlet;
+		acc[5+n] = c->total_singlet - prev->total_singlet;
+		n++;
+	#endif
+
+	allreduce_array(acc, 10, l->comm);
+
+	for (int k=0; k<n; k++) {
+		if (acc[5+k] > 0) {
+			*step[k] *= exp(acc[k] / acc[5+k] - p->metro_target);
+		}
+	}
+
+	*prev = *c;
+}
@@ -380,9 +380,11 @@ double get_weight(weight const* w, double val) {
 
 
 /* Global accept/reject step for multicanonical updating.
-* oldval is the old order parameter value before field was updated locally
+* oldval is the old order parameter value before field was updated locally.
+* dH is the change in the unweighted Hamiltonian, which is nonzero only for
+* global updates that do not sample exp(-S) by themselves (hybrid Monte Carlo).
 * Return 1 if update was accepted, 0 otherwise.*/
-int multicanonical_acceptance(lattice const* l, weight* w, double oldval, double newval) {
+int multicanonical_acceptance(lattice const* l, weight* w, double oldval, double newval, double dH) {
 
 	// if we call this function while w->do_acceptance is 0 then something went wrong
 	if (!w->do_acceptance) {
@@ -399,7 +401,7 @@ int multicanonical_acceptance(lattice const* l, weight* w, double oldval, double
 		W_new = get_weight(w, newval);
 		W_old = get_weight(w, oldval);
 
-		double diff = W_new - W_old;
+		double diff = W_new - W_old + dH;
 
 		if(exp(-(diff)) > dran()) {
       accept = 1;
@@ -703,47 +705,55 @@ int whichbin(weight const* w, double val) {
 	}
 }
 
-/* Calculate muca order parameter and distribute to all nodes.
-* Only the contribution from sites with parity = par is recalculated
-* while the other parity contribution is read from w.param_value */
-double calc_orderparam(lattice const* l, fields const* f, params const* p, weight* w, char par) {
-	double tot = 0.0;
-	long offset, max;
-	if (par == EVEN) {
-		offset = 0; max = l->evensites;
-	} else {
-		offset = l->evensites; max = l->sites;
-	}
+/* Contribution of site i to the order parameter, not divided by volume.
+* Used by update sweeps that keep track of the order parameter, see weight.track_orderparam */
+double orderparam_site(fields const* f, weight const* w, long i) {
 
 	switch(w->orderparam) {
-
 #ifdef TRIPLET
 		case SIGMASQ :
-			for (long i=offset; i<max; i++) tot += tripletsq(f->su2triplet[i]);
-			break;
+			return tripletsq(f->su2triplet[i]);
 #endif
-
 #if defined (TRIPLET) && (NHIGGS > 0)
-    case PHI2MINUSSIGMA2 :
-      for (long i=offset; i<max; i++) tot += doubletsq(f->su2doublet[0][i]) - tripletsq(f->su2triplet[i]);
-      break;
+		case PHI2MINUSSIGMA2 :
+			return doubletsq(f->su2doublet[0][i]) - tripletsq(f->su2triplet[i]);
 #endif
-
 #if (NHIGGS > 0)
 		case PHISQ :
-			for (long i=offset; i<max; i++) tot += doubletsq(f->su2doublet[0][i]);
-			break;
+			return doubletsq(f->su2doublet[0][i]);
 #endif
-
 #if (NHIGGS > 1)
 		case PHI2SQ :
-			for (long i=offset; i<max; i++) tot += doubletsq(f->su2doublet[1][i]);
-			break;
+			return doubletsq(f->su2doublet[1][i]);
 #endif
+	}
+	return 0.0;
+}
 
-	} // end switch
+/* Sum of the order parameter over my sites with parity par, not divided by volume.
+* No communication. Uses orderparam_site() so that the update sweeps agree with this */
+double local_orderparam(lattice const* l, fields const* f, weight const* w, char par) {
+	double tot = 0.0;
+	long offset, max;
+	if (par == EVEN) {
+		offset = 0; max = l->evensites;
+	} else {
+		offset = l->evensites; max = l->sites;
+	}
+
+	for (long i=offset; i<max; i++) {
+		tot += orderparam_site(f, w, i);
+	}
+
+	return tot;
+}
+
+/* Calculate muca order parameter and distribute to all nodes.
+* Only the contribution from sites with parity = par is recalculated
+* while the other parity contribution is read from w.param_value */
+double calc_orderparam(lattice const* l, fields const* f, params const* p, weight* w, char par) {
 
-	tot = allreduce(tot, l->comm) / l->vol;
+	double tot = allreduce(local_orderparam(l, f, w, par), l->comm) / l->vol;
 
 	w->param_value[par] = tot;
 	// add other parity contribution
@@ -33,6 +33,58 @@ double polysolve3(long double a, long double b, long double c, long double d) {
 	return x;
 }
 
+#if (NHIGGS > 0) || defined(TRIPLET) || defined(SINGLET)
+/* Same as polysolve3(), but for n independent cubics a[k] x^3 + b[k] x^2 + c[k] x + d[k] = 0,
+* with the real roots stored in x[k]. Works in double precision on flat arrays so that
+* the compiler can vectorize the loops. The closed form solution takes the sign of the square root
+* that avoids cancellation, and is then polished with Newton iteration.
+* Lanes where the double precision result cannot be trusted (discriminant close to zero or
+* large residual after polishing) are redone with polysolve3() in long double. */
+void polysolve3_batch(int n, double* a, double* b, double* c, double* d, double* x) {
+
+	int bad[OVERRELAX_BATCH];
+
+	for (int k=0; k<n; k++) {
+		double discr = 18.0*a[k]*b[k]*c[k]*d[k] - 4.0*b[k]*b[k]*b[k]*d[k] + b[k]*b[k]*c[k]*c[k]
+				- 4.0*a[k]*c[k]*c[k]*c[k] - 27.0*a[k]*a[k]*d[k]*d[k];
+		// size of the individual terms, for judging if discr is reliable
+		double scale = fabs(18.0*a[k]*b[k]*c[k]*d[k]) + fabs(4.0*b[k]*b[k]*b[k]*d[k]) + b[k]*b[k]*c[k]*c[k]
+				+ fabs(4.0*a[k]*c[k]*c[k]*c[k]) + 27.0*a[k]*a[k]*d[k]*d[k];
+
+		double del0 = b[k]*b[k] - 3.0*a[k]*c[k];
+		double del1 = 2.0*b[k]*b[k]*b[k] - 9.0*a[k]*b[k]*c[k] + 27.0*a[k]*a[k]*d[k];
+		// del1^2 - 4 del0^3 = -27 a^2 discr. fabs() keeps this finite for bad lanes
+		double root = sqrt(27.0 * a[k]*a[k] * fabs(discr));
+		double A = cbrt(0.5 * (del1 + copysign(root, del1)));
+
+		x[k] = -1.0 * (b[k] + A + del0 / A) / (3.0 * a[k]);
+		bad[k] = !(discr < -1e-12 * scale) || A == 0.0;
+	}
+
+	// Newton polishing. Two steps are plenty since the closed form is already close
+	for (int it=0; it<2; it++) {
+		for (int k=0; k<n; k++) {
+			double y = x[k];
+			double v = ((a[k]*y + b[k])*y + c[k])*y + d[k];
+			double dv = (3.0*a[k]*y + 2.0*b[k])*y + c[k];
+			x[k] = (dv != 0.0) ? y - v / dv : y;
+		}
+	}
+
+	for (int k=0; k<n; k++) {
+		double y = x[k];
+		double v = ((a[k]*y + b[k])*y + c[k])*y + d[k];
+		double size = fabs(a[k]*y*y*y) + fabs(b[k]*y*y) + fabs(c[k]*y) + fabs(d[k]);
+		// also catches NaN
+		if (!(fabs(v) <= 1e-10 * size)) bad[k] = 1;
+	}
+
+	for (int k=0; k<n; k++) {
+		if (bad[k]) x[k] = polysolve3(a[k], b[k], c[k], d[k]);
+	}
+}
+#endif
+
 
 #if (NHIGGS > 0)
 
@@ -50,81 +102,94 @@ double polysolve3(long double a, long double b, long double c, long double d) {
 * p(X') = min(p0, 1), p0 = (dS(X)/dX) / (dS(X')/dX'). If new X is accepted,
 * the Y overrelaxation reads: phi'_a = -phi_a - f_a (X' + X).
 * Note however that the Y overrelaxation is not necessary at all, X update is enough.
-* So if the action is not invariant under Y -> -Y, can choose to keep Y constant instead. */
-int overrelax_doublet(lattice const* l, fields* f, params const* p, long i) {
+* So if the action is not invariant under Y -> -Y, can choose to keep Y constant instead.
+*
+* Updates the n <= OVERRELAX_BATCH sites i, i+1, ..., i+n-1, which must have the same parity.
+* Staples are calculated site by site, after which the cubic equations are solved
+* for all n sites at once. Returns the number of accepted updates. */
+int overrelax_doublet(lattice const* l, fields* f, params const* p, long i, int n) {
 
 	// 1 Higgs doublet only!! For 2 Higgses see overrelax_higgs2()
-	double s[SU2DB] = {0.0};
 	int higgs_id = 0;
-
 	double** higgs = f->su2doublet[higgs_id];
-	double mod = doubletsq(higgs[i]);
-
-	// calculate hopping staple s_a (denote s_a = F_a)
-	staple_doublet(s, l, f, p, i, higgs_id);
-	// staple normalization
-	double F = 0.0;
-	for (int k=0; k<SU2DB; k++) {
-		F += s[k] * s[k];
-	}
-	F = sqrt(F);
-
-	// Cartesian X and Y coordinates for the Higgs.
-	double X = 0.0;
-	for (int k=0; k<SU2DB; k++) {
-		X += higgs[i][k] * s[k]; // this "contains" a minus sign
-	}
-	X /= F;
-	double Y[4], Ysq = 0.0;
-	for (int k=0; k<SU2DB; k++) {
-		Y[k] = higgs[i][k] - X * s[k] / F;
-		Ysq += Y[k] * Y[k];
-	}
 
-	// remaining terms in the local action
-	double B = 0.5 * p->msq_phi + 1.0 * l->dim;
-	#ifdef TRIPLET
-		B += 0.5 * p->a2 * tripletsq(f->su2triplet[i]);
-	#endif
-	#ifdef SINGLET
-		// V = 1/2 a1 S \he\phi\phi + 1/2 a2 S^2 \he\phi\phi + ...
-		double S = f->singlet[i][0];
-		B += 0.25 * p->a1_s * S + 0.25 * p->a2_s * S*S;
-	#endif
+	double s[OVERRELAX_BATCH][SU2DB];
+	double B[OVERRELAX_BATCH], F[OVERRELAX_BATCH], X[OVERRELAX_BATCH], Ysq[OVERRELAX_BATCH];
+	// coefficients of the cubic, and the solution
+	double alpha[OVERRELAX_BATCH], beta[OVERRELAX_BATCH], gamma[OVERRELAX_BATCH], delta[OVERRELAX_BATCH];
+	double newX[OVERRELAX_BATCH];
 
 	double C = 0.25 * p->lambda_phi;
 
-	// we need to solve V(X') - V(X) = 0, where Y is kept constant. Write this as
-	// (x - y) (alpha x^3 + beta * x^2 + gamma * x + delta) = 0
-	// for x = X', y = X, and find a nontrivial real root.
-	// Note: need to be careful about large numbers here. Best to not rescale by C
-	long double alpha = C;
-	long double beta = C*X;
-	long double cc = B + 2.0 * Ysq * C; // quadratic term coefficient in V
-	long double gamma = (cc + C * X*X);
-	long double delta = (F + cc * X + C * X*X*X);
-
-	double newX = polysolve3(alpha, beta, gamma, delta);
-	// now accept/reject based on the derivatives
-	// dV/dX = F + 2B*X + 4C(X^3 + Y^2 X), with again same Y in both cases
-	double dV = F + 2.0*B*X + 4.0*C*(X*X*X + Ysq*X);
-	double dV_new = F + 2.0*B*newX + 4.0*C*(newX*newX*newX + Ysq*newX);
-
-	beta = fabs(dV/dV_new);
-
-	if (beta >= dran()) {
-		// accept, so overrelax Y' = -Y using the new X
-		// phi'_a = Y' - X' f_a = -phi_a - (X' + X) f_a,
-		// but my X calculated above has diff sign already. */
-		for (int k=0; k<SU2DB; k++) {
-			f->su2doublet[0][i][k] = -1.0*higgs[i][k] + (newX + X) * s[k] / F;
+	for (int k=0; k<n; k++) {
+		long site = i + k;
+		// calculate hopping staple s_a (denote s_a = F_a)
+		staple_doublet(s[k], l, f, p, site, higgs_id);
+
+		// remaining terms in the local action
+		B[k] = 0.5 * p->msq_phi + 1.0 * l->dim;
+		#ifdef TRIPLET
+			B[k] += 0.5 * p->a2 * tripletsq(f->su2triplet[site]);
+		#endif
+		#ifdef SINGLET
+			// V = 1/2 a1 S \he\phi\phi + 1/2 a2 S^2 \he\phi\phi + ...
+			double S = f->singlet[site][0];
+			B[k] += 0.25 * p->a1_s * S + 0.25 * p->a2_s * S*S;
+		#endif
+	}
+
+	for (int k=0; k<n; k++) {
+		double* phi = higgs[i + k];
+		// staple normalization and Cartesian X and Y coordinates for the Higgs
+		double FF = 0.0, XX = 0.0;
+		for (int a=0; a<SU2DB; a++) {
+			FF += s[k][a] * s[k][a];
+			XX += phi[a] * s[k][a]; // this "contains" a minus sign
 		}
-		return 1;
-	} else {
-		// reject, no changes to the field
-		return 0;
+		FF = sqrt(FF);
+		XX /= FF;
+		double YY = 0.0;
+		for (int a=0; a<SU2DB; a++) {
+			double y = phi[a] - XX * s[k][a] / FF;
+			YY += y * y;
+		}
+		F[k] = FF; X[k] = XX; Ysq[k] = YY;
+
+		// we need to solve V(X') - V(X) = 0, where Y is kept constant. Write this as
+		// (x - y) (alpha x^3 + beta * x^2 + gamma * x + delta) = 0
+		// for x = X', y = X, and find a nontrivial real root.
+		// Note: need to be careful about large numbers here. Best to not rescale by C
+		double cc = B[k] + 2.0 * YY * C; // quadratic term coefficient in V
+		alpha[k] = C;
+		beta[k] = C*XX;
+		gamma[k] = cc + C * XX*XX;
+		delta[k] = FF + cc * XX + C * XX*XX*XX;
+	}
+
+	polysolve3_batch(n, alpha, beta, gamma, delta, newX);
+
+	int accepted = 0;
+	for (int k=0; k<n; k++) {
+		// now accept/reject based on the derivatives
+		// dV/dX = F + 2B*X + 4C(X^3 + Y^2 X), with again same Y in both cases
+		double x = X[k], y = newX[k];
+		double dV = F[k] + 2.0*B[k]*x + 4.0*C*(x*x*x + Ysq[k]*x);
+		double dV_new = F[k] + 2.0*B[k]*y + 4.0*C*(y*y*y + Ysq[k]*y);
+
+		if (fabs(dV/dV_new) >= dran()) {
+			// accept, so overrelax Y' = -Y using the new X
+			// phi'_a = Y' - X' f_a = -phi_a - (X' + X) f_a,
+			// but my X calculated above has diff sign already. */
+			double* phi = higgs[i + k];
+			for (int a=0; a<SU2DB; a++) {
+				phi[a] = -1.0*phi[a] + (y + x) * s[k][a] / F[k];
+			}
+			accepted++;
+		}
+		// if rejected, no changes to the field
 	}
 
+	return accepted;
 }
 
 #endif // NHIGGS > 0
@@ -133,106 +198,77 @@ int overrelax_doublet(lattice const* l, fields* f, params const* p, long i) {
 #ifdef TRIPLET
 
 /* Same Cartesian overrelax as overrelax_doublet(), but for adjoint scalar.
+* Updates the n <= OVERRELAX_BATCH sites i, ..., i+n-1 of the same parity.
 */
-int overrelax_triplet(lattice const* l, fields* f, params const* p, long i) {
-
-	double s[3] = {0.0, 0.0, 0.0};
-	double u[SU2LINK];
-	double b[SU2TRIP];
-
-	// calculate hopping staple s_a (denote. s_a = F_a)
-	for (int dir=0; dir<l->dim; dir++) {
-		long next = l->next[i][dir];
-		// link variable
-		for (int d=0; d<SU2LINK; d++) {
-			u[d] = f->su2link[i][dir][d];
-		}
-		// Sigma at next site
+int overrelax_triplet(lattice const* l, fields* f, params const* p, long i, int n) {
+
+	double s[OVERRELAX_BATCH][SU2TRIP];
+	double B[OVERRELAX_BATCH], F[OVERRELAX_BATCH], X[OVERRELAX_BATCH], Ysq[OVERRELAX_BATCH];
+	double alpha[OVERRELAX_BATCH], beta[OVERRELAX_BATCH], gamma[OVERRELAX_BATCH], delta[OVERRELAX_BATCH];
+	double newX[OVERRELAX_BATCH];
+
+	double C = 0.25 * p->b4;
+
+	for (int k=0; k<n; k++) {
+		// calculate hopping staple s_a (denote. s_a = F_a)
+		staple_triplet(s[k], l, f, p, i + k);
+
+		// remaining terms in the local action
+		B[k] = 0.5 * p->msq_triplet + 1.0 * l->dim;
+		#ifdef HIGGS
+			B[k] += 0.5 * p->a2 * doubletsq(f->su2doublet[i + k]);
+		#endif
+	}
+
+	for (int k=0; k<n; k++) {
+		double* a = f->su2triplet[i + k];
+		// staple normalization and Cartesian X and Y coordinates
+		double FF = 0.0, XX = 0.0;
 		for (int d=0; d<SU2TRIP; d++) {
-			b[d] = f->su2triplet[next][d];
-		}
-		s[0] += -(b[0]*(u[0]*u[0])) - b[0]*(u[1]*u[1]) + 2*b[2]*u[0]*u[2] -
-		 				2*b[1]*u[1]*u[2] + b[0]*(u[2]*u[2]) - 2*b[1]*u[0]*u[3]
-						- 2*b[2]*u[1]*u[3] + b[0]*(u[3]*u[3]);
-		s[1] += -(b[1]*(u[0]*u[0])) - 2*b[2]*u[0]*u[1] + b[1]*(u[1]*u[1]) -
-						2*b[0]*u[1]*u[2] - b[1]*(u[2]*u[2]) + 2*b[0]*u[0]*u[3] -
-						2*b[2]*u[2]*u[3] + b[1]*(u[3]*u[3]);
-		s[2] += -(b[2]*(u[0]*u[0])) + 2*b[1]*u[0]*u[1] + b[2]*(u[1]*u[1])
-						- 2*b[0]*u[0]*u[2] + b[2]*(u[2]*u[2]) - 2*b[0]*u[1]*u[3]
-						- 2*b[1]*u[2]*u[3] - b[2]*(u[3]*u[3]);
-		// same for backwards directions
-		long prev = l->prev[i][dir];
-		for (int d=0; d<SU2LINK; d++) {
-			u[d] = f->su2link[prev][dir][d];
+			FF += s[k][d] * s[k][d];
+			XX += a[d] * s[k][d];
 		}
+		FF = sqrt(FF);
+		XX /= FF;
+		double YY = 0.0;
 		for (int d=0; d<SU2TRIP; d++) {
-			b[d] = f->su2triplet[prev][d];
+			double y = a[d] - XX * s[k][d] / FF;
+			YY += y * y;
 		}
-		s[0] += -(b[0]*(u[0]*u[0])) - b[0]*(u[1]*u[1]) - 2*b[2]*u[0]*u[2]
-						- 2*b[1]*u[1]*u[2] + b[0]*(u[2]*u[2]) + 2*b[1]*u[0]*u[3]
-						- 2*b[2]*u[1]*u[3] + b[0]*(u[3]*u[3]);
-		s[1] += -(b[1]*(u[0]*u[0])) + 2*b[2]*u[0]*u[1] + b[1]*(u[1]*u[1])
-						- 2*b[0]*u[1]*u[2] - b[1]*(u[2]*u[2]) - 2*b[0]*u[0]*u[3]
-						- 2*b[2]*u[2]*u[3] + b[1]*(u[3]*u[3]);
-		s[2] += -(b[2]*(u[0]*u[0])) - 2*b[1]*u[0]*u[1] + b[2]*(u[1]*u[1])
-						+ 2*b[0]*u[0]*u[2] + b[2]*(u[2]*u[2]) - 2*b[0]*u[1]*u[3]
-						- 2*b[1]*u[2]*u[3] - b[2]*(u[3]*u[3]);
-	}
-	// staple normalization
-	double F = 0.0;
-	for (int k=0; k<SU2TRIP; k++) {
-		F += s[k] * s[k];
-	}
-	F = sqrt(F);
-
-	// Cartesian X and Y coordinates
-	double X = 0.0;
-	for (int k=0; k<SU2TRIP; k++) {
-		X += f->su2triplet[i][k] * s[k];
-	}
-	X /= F;
-	double Y[SU2TRIP], Ysq = 0.0;
-	for (int k=0; k<SU2TRIP; k++) {
-		Y[k] = f->su2triplet[i][k] - X * s[k] / F;
-		Ysq += Y[k] * Y[k];
+		F[k] = FF; X[k] = XX; Ysq[k] = YY;
+
+		// we need to solve V(X') - V(X) = 0, where Y is kept constant. Write this as
+		// (x - y) (alpha x^3 + beta * x^2 + gamma * x + delta) = 0
+		// for x = X', y = X, and find a nontrivial real root.
+		double cc = B[k] + 2.0 * YY * C; // quadratic term coefficient in V
+		alpha[k] = C;
+		beta[k] = C*XX;
+		gamma[k] = cc + C * XX*XX;
+		delta[k] = FF + cc * XX + C * XX*XX*XX;
 	}
 
-	// remaining terms in the local action
-	double B = 0.5 * p->msq_triplet + 1.0 * l->dim;
-	#ifdef HIGGS
-		B += 0.5 * p->a2 * doubletsq(f->su2doublet[i]);
-	#endif
-	double C = 0.25 * p->b4;
-
-	// we need to solve V(X') - V(X) = 0, where Y is kept constant. Write this as
-	// (x - y) (alpha x^3 + beta * x^2 + gamma * x + delta) = 0
-	// for x = X', y = X, and find a nontrivial real root.
-	// Note: need to be careful about large numbers here. Best to not rescale by C
-	long double alpha = C;
-	long double beta = C*X;
-	long double cc = B + 2.0 * Ysq * C; // quadratic term coefficient in V
-	long double gamma = (cc + C * X*X);
-	long double delta = (F + cc * X + C * X*X*X);
-
-	double newX = polysolve3(alpha, beta, gamma, delta);
-	// now accept/reject based on the derivatives
-	// dV/dX = F + 2B*X + 4C(X^3 + Y^2 X), with again same Y in both cases
-	double dV = F + 2.0*B*X + 4.0*C*(X*X*X + Ysq*X);
-	double dV_new = F + 2.0*B*newX + 4.0*C*(newX*newX*newX + Ysq*newX);
-
-	beta = fabs(dV/dV_new);
-
-	if (beta >= dran()) {
-		// accept, so overrelax Y' = -Y using the new X
-		for (int k=0; k<SU2TRIP; k++) {
-			f->su2triplet[i][k] = -1.0*f->su2triplet[i][k] + (newX + X) * s[k] / F;
+	polysolve3_batch(n, alpha, beta, gamma, delta, newX);
+
+	int accepted = 0;
+	for (int k=0; k<n; k++) {
+		// now accept/reject based on the derivatives
+		// dV/dX = F + 2B*X + 4C(X^3 + Y^2 X), with again same Y in both cases
+		double x = X[k], y = newX[k];
+		double dV = F[k] + 2.0*B[k]*x + 4.0*C*(x*x*x + Ysq[k]*x);
+		double dV_new = F[k] + 2.0*B[k]*y + 4.0*C*(y*y*y + Ysq[k]*y);
+
+		if (fabs(dV/dV_new) >= dran()) {
+			// accept, so overrelax Y' = -Y using the new X
+			double* a = f->su2triplet[i + k];
+			for (int d=0; d<SU2TRIP; d++) {
+				a[d] = -1.0*a[d] + (y + x) * s[k][d] / F[k];
+			}
+			accepted++;
 		}
-		return 1;
-	} else {
-		// reject, no changes to the field
-		return 0;
+		// if rejected, no changes to the field
 	}
 
+	return accepted;
 }
 
 #endif // TRIPLET
@@ -240,48 +276,63 @@ int overrelax_triplet(lattice const* l, fields* f, params const* p, long i) {
 
 #ifdef SINGLET
 
-int overrelax_singlet(lattice const* l, fields* f, params const* p, long i) {
+/* Singlet overrelaxation for the n <= OVERRELAX_BATCH sites i, ..., i+n-1 of the same parity.
+* Returns the number of accepted updates. */
+int overrelax_singlet(lattice const* l, fields* f, params const* p, long i, int n) {
 
-	double S = f->singlet[i][0];
-	/* Local action due to S(x): act = c1 S + c2 S^2 + c3 S^3 + c4 S^4 */
-	double c1 = p->b1_s;
-	for (int dir=0; dir<l->dim; dir++) {
-		long next = l->next[i][dir];
-		long prev = l->prev[i][dir];
-		c1 -= (f->singlet[next][0] + f->singlet[prev][0]);
-	}
-
-	double c2 = l->dim + 0.5*p->msq_s;
+	/* Local action due to S(x): act = c1 S + c2 S^2 + c3 S^3 + c4 S^4.
+	* Only c1 and c2 depend on the site */
+	double c1[OVERRELAX_BATCH], c2[OVERRELAX_BATCH];
 	double c3 = 1.0/3.0 * p->b3_s;
 	double c4 = 0.25 * p->b4_s;
 
-	#if (NHIGGS == 1)
-		double phisq = doubletsq(f->su2doublet[0][i]);
-		c1 += 0.5*p->a1_s*phisq;
-		c2 += 0.5*p->a2_s*phisq;
-	#endif
+	for (int k=0; k<n; k++) {
+		long site = i + k;
+		c1[k] = p->b1_s;
+		for (int dir=0; dir<l->dim; dir++) {
+			long next = l->next[site][dir];
+			long prev = l->prev[site][dir];
+			c1[k] -= (f->singlet[next][0] + f->singlet[prev][0]);
+		}
+		c2[k] = l->dim + 0.5*p->msq_s;
+
+		#if (NHIGGS == 1)
+			double phisq = doubletsq(f->su2doublet[0][site]);
+			c1[k] += 0.5*p->a1_s*phisq;
+			c2[k] += 0.5*p->a2_s*phisq;
+		#endif
+	}
 
 	/* Solve Y from act(S) - act(Y) = 0. Can factor out trivial solution Y=S, so
 	* need to solve d0 + d1 Y + d2 Y^2 + d3 Y^3 = 0 */
-	double d0 = c1 + c2*S + c3*S*S + c4*S*S*S;
-	double d1 = c2 + c3*S + c4*S*S;
-	double d2 = c3 + c4*S;
-	double d3 = c4;
+	double d0[OVERRELAX_BATCH], d1[OVERRELAX_BATCH], d2[OVERRELAX_BATCH], d3[OVERRELAX_BATCH];
+	double Y[OVERRELAX_BATCH];
+	for (int k=0; k<n; k++) {
+		double S = f->singlet[i + k][0];
+		d0[k] = c1[k] + c2[k]*S + c3*S*S + c4*S*S*S;
+		d1[k] = c2[k] + c3*S + c4*S*S;
+		d2[k] = c3 + c4*S;
+		d3[k] = c4;
+	}
 
-	double Y = polysolve3(d3, d2, d1, d0);
+	polysolve3_batch(n, d3, d2, d1, d0, Y);
 
-	/* Acc/rej to preserve detailed balance. Derivatives of the local action wrt. S and Y */
-	double dV = c1 + 2.0*c2*S + 3.0*c3*S*S + 4.0*c4*S*S*S;
-	double dV_new = c1 + 2.0*c2*Y + 3.0*c3*Y*Y + 4.0*c4*Y*Y*Y;
+	int accepted = 0;
+	for (int k=0; k<n; k++) {
+		/* Acc/rej to preserve detailed balance. Derivatives of the local action wrt. S and Y */
+		double S = f->singlet[i + k][0];
+		double y = Y[k];
+		double dV = c1[k] + 2.0*c2[k]*S + 3.0*c3*S*S + 4.0*c4*S*S*S;
+		double dV_new = c1[k] + 2.0*c2[k]*y + 3.0*c3*y*y + 4.0*c4*y*y*y;
 
-	if (fabs(dV/dV_new) >= dran()) {
-		f->singlet[i][0] = Y;
-		return 1;
-	} else {
-		// reject, no changes to the field
-		return 0;
+		if (fabs(dV/dV_new) >= dran()) {
+			f->singlet[i + k][0] = y;
+			accepted++;
+		}
+		// if rejected, no changes to the field
 	}
 
+	return accepted;
 }
 
 #endif
@@ -291,44 +342,30 @@ int overrelax_singlet(lattice const* l, fields* f, params const* p, long i) {
 /* XY-overrelax for multiple Higgs doublets. higgs_id specifies which doublet
 * is updated. Here I am more consistent with signs and take the local action to be
 * V[phi] ~ -F_a phi_a + others. Also, Y is not changed at all here, so the update works
-* even for potentials that are not invariant under Y -> -Y. */
-int overrelax_higgs2(lattice const* l, fields* f, params const* p, long i, int higgs_id) {
-
-	double s[SU2DB] = {0.0};
+* even for potentials that are not invariant under Y -> -Y.
+* Updates the n <= OVERRELAX_BATCH sites i, ..., i+n-1 of the same parity. */
+int overrelax_higgs2(lattice const* l, fields* f, params const* p, long i, int n, int higgs_id) {
 
 	double** higgs = f->su2doublet[higgs_id];
-	double mod = doubletsq(higgs[i]);
-
-	// calculate hopping staple s_a (denote s_a = F_a)
-	staple_doublet(s, l, f, p, i, higgs_id); // now S ~ f[a] s[a], does not include minus sign
-
-	/* Now there is f12 = phi1^+ phi2 etc in the potential, add these to the "staple".
-	* There are also f1[a] * f1^2 etc, but these do NOT contribute to F_a which should
-	* remain constant in the local f1[a] -> f_new[a] update.
-	* Here R = Re f12, I = Im f12, H = phi_other (4-vec), G = +/- i sig_2 H (4-dimensional Pauli matrix),
-	* so in terms of f1[a] vectors: f11 = 0.5 * f1.f1, R = 0.5 * f1.f2, I = 0.5 * f1.G.
-	* The sign in G is - if updating phi1 (so H = phi2) and + if updating phi2. */
-	double* H;
-	double G[SU2DB];
-	int sign = -1; // sign of G
+
+	// normalized staples f_a, X coordinates and coefficients of the local action in X
+	double s[OVERRELAX_BATCH][SU2DB];
+	double X[OVERRELAX_BATCH];
+	double b1[OVERRELAX_BATCH], b2[OVERRELAX_BATCH], b3[OVERRELAX_BATCH], b4[OVERRELAX_BATCH];
 
 	// full staple is s[a] = s_hop[a] + A H + B G. m12^2 term and either lam6 or lam7 contribute
+	int sign = -1; // sign of G
+	int other = 1 - higgs_id;
 	complex lam67, lam67other;
 	double lam12, msq;
 	if (higgs_id == 0) {
-
-		H = f->su2doublet[1][i];
-
 		lam12 = p->lambda_phi;
 		msq = p->msq_phi;
 		lam67 = p->lam7;
 		lam67other = p->lam6;
 		lam67other.im *= -1.0;
 	} else {
-
-		H = f->su2doublet[0][i];
 		sign = 1;
-
 		lam12 = p->lam2;
 		msq = p->msq_phi2;
 		lam67 = p->lam6;
@@ -336,83 +373,193 @@ int overrelax_higgs2(lattice const* l, fields* f, params const* p, long i, int h
 		lam67other = p->lam7;
 	}
 
-	G[0] = sign*H[3]; G[1] = sign*H[2];
-	G[2] = -1.0*sign*H[1]; G[3] = -1.0*sign*H[0];
+	for (int k=0; k<n; k++) {
+		long site = i + k;
+		double* phi = higgs[site];
+
+		// calculate hopping staple s_a (denote s_a = F_a)
+		staple_doublet(s[k], l, f, p, site, higgs_id); // now S ~ f[a] s[a], does not include minus sign
+
+		/* Now there is f12 = phi1^+ phi2 etc in the potential, add these to the "staple".
+		* There are also f1[a] * f1^2 etc, but these do NOT contribute to F_a which should
+		* remain constant in the local f1[a] -> f_new[a] update.
+		* Here R = Re f12, I = Im f12, H = phi_other (4-vec), G = +/- i sig_2 H (4-dimensional Pauli matrix),
+		* so in terms of f1[a] vectors: f11 = 0.5 * f1.f1, R = 0.5 * f1.f2, I = 0.5 * f1.G.
+		* The sign in G is - if updating phi1 (so H = phi2) and + if updating phi2. */
+		double* H = f->su2doublet[other][site];
+		double G[SU2DB];
+		G[0] = sign*H[3]; G[1] = sign*H[2];
+		G[2] = -1.0*sign*H[1]; G[3] = -1.0*sign*H[0];
+
+		double Hsq = doubletsq(H);
+
+		for (int a=0; a<SU2DB; a++) {
+			s[k][a] += 0.5*(p->m12sq.re + Hsq * lam67.re) * H[a];
+			s[k][a] += 0.5*(-1.0*p->m12sq.im + Hsq * lam67.im) * G[a];
+			s[k][a] = -1.0*s[k][a]; // change staple sign to match F_a
+		}
+
+		// staple normalization
+		double F = 0.0;
+		for (int a=0; a<SU2DB; a++) F += s[k][a] * s[k][a];
+		F = sqrt(F);
 
-	double Hsq = doubletsq(H);
+		// Cartesian X and Y coordinates for the Higgs
+		double XX = 0.0;
+		for (int a=0; a<SU2DB; a++) {
+			s[k][a] /= F; // s <- s/F = f_a
+			XX += phi[a] * s[k][a];
+		}
+		X[k] = XX;
 
-	for (int k=0; k<SU2DB; k++) {
-		s[k] += 0.5*(p->m12sq.re + Hsq * lam67.re) * H[k];
-		s[k] += 0.5*(-1.0*p->m12sq.im + Hsq * lam67.im) * G[k];
-		s[k] = -1.0*s[k]; // change staple sign to match F_a
-	}
+		double Y[SU2DB], Ysq = 0.0;
+		for (int a=0; a<SU2DB; a++) {
+			Y[a] = phi[a] - XX * s[k][a];
+			Ysq += Y[a] * Y[a];
+		}
 
-	// staple normalization
-	double F = 0.0;
-	for (int k=0; k<SU2DB; k++) F += s[k] * s[k];
-	F = sqrt(F);
+		/* Write local action as V(X) = b4 X^4 + b3 X^3 + b2 X^2 + b1 X + b0.
+		* See Mathematica notebook overrelax.c for the expressions */
 
-	// Cartesian X and Y coordinates for the Higgs
-	double X = 0.0;
-	for (int k=0; k<SU2DB; k++) {
-		s[k] /= F; // s <- s/F = f_a
-		X += higgs[i][k] * s[k];
-	}
+		// some dot products
+		double Hf = 0.0, Gf = 0.0, HY = 0.0, GY = 0.0;
+		for (int a=0; a<SU2DB; a++) {
+			Hf += H[a] * s[k][a];
+			Gf += G[a] * s[k][a];
+			HY += H[a] * Y[a];
+			GY += G[a] * Y[a];
+		}
+
+		// terms that differ for phi1 and phi2 (b2 includes term from covariant der.)
+		b4[k] = 0.25 * lam12;
+		b3[k] = 0.25 * (Hf * lam67other.re + Gf * lam67other.im);
+		b2[k] = 0.5 * msq + 1.0*l->dim + 0.5*Ysq*lam12 + 0.25*(HY*lam67other.re + GY*lam67other.im);
+		b1[k] = -1.0*F + 0.25*Ysq*(Hf*lam67other.re + Gf*lam67other.im); // F contains terms from the "staple"
 
-	double Y[SU2DB], Ysq = 0.0;
-	for (int k=0; k<SU2DB; k++) {
-		Y[k] = higgs[i][k] - X * s[k];
-		Ysq += Y[k] * Y[k];
+		// then mutual terms for both phi1,2
+		b2[k] += 0.5*Hsq * p->lam3 + 0.25*p->lam4 * (Hf*Hf + Gf*Gf)
+				+ 0.25*p->lam5.re * (Hf*Hf - Gf*Gf) - 0.5*p->lam5.im * Gf*Hf;
+
+		b1[k] += 0.5*Hf * (HY*p->lam4 + HY*p->lam5.re - GY*p->lam5.im)
+				+ 0.5*Gf * (GY*p->lam4 - GY*p->lam5.re - HY*p->lam5.im);
 	}
 
-	/* Write local action as V(X) = b4 X^4 + b3 X^3 + b2 X^2 + b1 X + b0.
-	* See Mathematica notebook overrelax.c for the expressions */
+	/* Solve V(X') - V(X) = 0: write this as (x - X) (ax^3 + bx^2 + cx + d) = 0
+	*  and find the real root of the 3rd degree polynomial */
+	double aa[OVERRELAX_BATCH], bb[OVERRELAX_BATCH], cc[OVERRELAX_BATCH], dd[OVERRELAX_BATCH];
+	double Xn[OVERRELAX_BATCH];
+	for (int k=0; k<n; k++) {
+		double x = X[k];
+		aa[k] = b4[k];
+		bb[k] = b3[k] + b4[k]*x;
+		cc[k] = b2[k] + b3[k]*x + b4[k]*x*x;
+		dd[k] = b1[k] + b2[k]*x + b3[k]*x*x + b4[k]*x*x*x;
+	}
 
-	// some dot products
-	double Hf = 0.0, Gf = 0.0, HY = 0.0, GY = 0.0;
-	for (int k=0; k<SU2DB; k++) {
-		Hf += H[k] * s[k];
-		Gf += G[k] * s[k];
-		HY += H[k] * Y[k];
-		GY += G[k] * Y[k];
+	polysolve3_batch(n, aa, bb, cc, dd, Xn);
+
+	int accepted = 0;
+	for (int k=0; k<n; k++) {
+		/* now accept/reject based on the change in measure */
+		double x = X[k], y = Xn[k];
+		double dV = 4.0*b4[k]*x*x*x + 3.0*b3[k]*x*x + 2.0*b2[k]*x + b1[k];
+		double dV_new = 4.0*b4[k]*y*y*y + 3.0*b3[k]*y*y + 2.0*b2[k]*y + b1[k];
+
+		if (fabs(dV/dV_new) >= dran()) {
+			// accept, so change phi_a so that Y is unchanged.
+			double* phi = higgs[i + k];
+			for (int a=0; a<SU2DB; a++) {
+				phi[a] = phi[a] + s[k][a] * (y - x);
+			}
+			accepted++;
+		}
+		// if rejected, no changes to the field
 	}
 
-	// terms that differ for phi1 and phi2 (b2 includes term from covariant der.)
-	double b4 = 0.25 * lam12;
-	double b3 = 0.25 * (Hf * lam67other.re + Gf * lam67other.im);
-	double b2 = 0.5 * msq + 1.0*l->dim + 0.5*Ysq*lam12 + 0.25*(HY*lam67other.re + GY*lam67other.im);
-	double b1 = -1.0*F + 0.25*Ysq*(Hf*lam67other.re + Gf*lam67other.im); // F contains terms from the "staple"
+	return accepted;
+}
+#endif // NHIGGS == 2
+
 
-	// then mutual terms for both phi1,2
-	b2 += 0.5*Hsq * p->lam3 + 0.25*p->lam4 * (Hf*Hf + Gf*Gf)
-			+ 0.25*p->lam5.re * (Hf*Hf - Gf*Gf) - 0.5*p->lam5.im * Gf*Hf;
+/* SU(2) link overrelaxation. The local action is linear in the link,
+* S = Tr U.V + const. with V the staple from su2link_staple(), so the reflection
+*		U -> v^+ U^+ v^+,		v = V / sqrt(det V)
+* leaves the action invariant and is always accepted. The triplet hopping term is
+* quadratic in U and not in the staple, so with triplets the change in that term
+* is accepted/rejected with Metropolis (like in heatbath_su2link()).
+* Returns 1 if the update was accepted, 0 otherwise. */
+int overrelax_su2link(lattice const* l, fields* f, params const* p, long i, int dir) {
 
-	b1 += 0.5*Hf * (HY*p->lam4 + HY*p->lam5.re - GY*p->lam5.im)
-			+ 0.5*Gf * (GY*p->lam4 - GY*p->lam5.re - HY*p->lam5.im);
+	double* u = f->su2link[i][dir];
 
-	/* Solve V(X') - V(X) = 0: write this as (x - X) (ax^3 + bx^2 + cx + d) = 0
-	*  and find the real root of the 3rd degree polynomial */
-	long double aa = b4;
-	long double bb = b3 + b4*X;
-	long double cc = b2 + b3*X + b4*X*X;
-	long double dd = b1 + b2*X + b3*X*X + b4*X*X*X;
-
-	double Xn = polysolve3(aa, bb, cc, dd);
-	/* now accept/reject based on the change in measure */
-	double dV = 4.0*b4*X*X*X + 3.0*b3*X*X + 2.0*b2*X + b1;
-	double dV_new = 4.0*b4*Xn*Xn*Xn + 3.0*b3*Xn*Xn + 2.0*b2*Xn + b1;
-
-	b4 = fabs(dV/dV_new);
-	if (b4 >= dran()) {
-		// accept, so change phi_a so that Y is unchanged.
-		for (int k=0; k<SU2DB; k++) {
-			higgs[i][k] = higgs[i][k] + s[k] * (Xn - X);
+	double V[SU2LINK];
+	su2link_staple(l, f, p, i, dir, V);
+	double det = su2sqr(V);
+	if (det <= 0.0) return 0; // no preferred direction, nothing to reflect about
+
+	double oldlink[SU2LINK];
+	memcpy(oldlink, u, SU2LINK*sizeof(double));
+	#ifdef TRIPLET
+		double oldact = hopping_triplet_forward(l, f, p, i, dir);
+	#endif
+
+	// v^+, normalized to SU(2). Overall sign of v drops out
+	double v[SU2LINK];
+	double norm = 1.0 / sqrt(det);
+	v[0] = V[0] * norm;
+	for (int k=1; k<SU2LINK; k++) {
+		v[k] = -V[k] * norm;
+	}
+
+	// new link v^+ U^+ v^+
+	double new[SU2LINK] = { v[0], v[1], v[2], v[3] };
+	double udag[SU2LINK] = { u[0], -u[1], -u[2], -u[3] };
+	su2rot(new, udag);
+	su2rot(new, v);
+	memcpy(u, new, SU2LINK*sizeof(double));
+
+	#ifdef TRIPLET
+		double diff = hopping_triplet_forward(l, f, p, i, dir) - oldact;
+		if (diff > 0 && exp(-diff) < dran()) {
+			memcpy(u, oldlink, SU2LINK*sizeof(double));
+			return 0;
 		}
-		return 1;
-	} else {
-		// reject, no changes to the field
-		return 0;
+	#endif
+
+	return 1;
+}
+
+#ifdef U1
+/* U(1) link overrelaxation. Write the plaquette part of the action (see u1link_staple())
+* as -R cos(r a + c); then r a -> -r a - 2c leaves it invariant. The hopping terms are
+* included in the reflection if r = 1, otherwise they are accepted/rejected with Metropolis.
+* Returns 1 if the update was accepted, 0 otherwise. */
+int overrelax_u1link(lattice const* l, fields* f, params const* p, long i, int dir) {
+
+	double* a = &f->u1link[i][dir];
+	double r = p->r_u1;
+
+	double k[4];
+	u1link_staple(l, f, p, i, dir, k);
+
+	// -A cos(r a) + B sin(r a) = -R cos(r a + c) with R cos(c) = A, R sin(c) = B
+	double A = k[0], B = k[1];
+	if (r == 1.0) {
+		A += k[2];
+		B -= k[3];
 	}
+	double c = atan2(B, A);
+
+	double oldlink = *a;
+	double act_old = u1link_action(k, r, oldlink);
+	*a = -oldlink - 2.0 * c / r;
 
+	// only nonzero because of the hopping terms when r != 1, or rounding
+	double diff = u1link_action(k, r, *a) - act_old;
+	if (diff > 0 && exp(-diff) < dran()) {
+		*a = oldlink;
+		return 0;
+	}
+	return 1;
 }
-#endif // NHIGGS == 2
+#endif
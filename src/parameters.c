@@ -177,19 +177,18 @@ void get_parameters(char *filename, lattice* l, params *p) {
 		}
   }
 
-  // Open results file for the root node only
+  // Results file is opened later in open_resultsfile()
   p->resultsfile = NULL;
   ok = 1;
-  char resFileName[maxLineLen];
-  GetString(config, "resultsfile", resFileName);
-  if(!myRank) p->resultsfile = fopen(resFileName, "a");
+  GetString(config, "resultsfile", p->resultsfile_name);
+  p->binary_results = GetInt(config, "binary_results");
 
 
   // Read update algorithms to use for fields
   int alg;
 
   alg = GetUpdateAlgorithm(config, "algorithm_su2link");
-  if ( !(alg == METROPOLIS || alg == HEATBATH) ) {
+  if ( !(alg == METROPOLIS || alg == HEATBATH || alg == OVERRELAX) ) {
     printf0("Cannot use algorithm %d for SU2 links, changing to metropolis...", alg);
     alg = METROPOLIS;
   }
@@ -197,7 +196,7 @@ void get_parameters(char *filename, lattice* l, params *p) {
 
   #ifdef U1
     alg = GetUpdateAlgorithm(config, "algorithm_u1link");
-    if (alg != METROPOLIS) {
+    if ( !(alg == METROPOLIS || alg == HEATBATH || alg == OVERRELAX) ) {
       printf0("Cannot use algorithm %d for U1 links, changing to metropolis...", alg);
       alg = METROPOLIS;
     }
@@ -242,6 +241,7 @@ void get_parameters(char *filename, lattice* l, params *p) {
   p->n_thermalize = GetLong(config, "n_thermalize");
 
   p->run_checks = GetInt(config, "run_checks");
+  p->random_seed = GetLong(config, "random_seed");
   p->reset = GetInt(config, "reset");
   p->multicanonical = GetInt(config, "multicanonical");
   p->do_local_meas = GetInt(config, "measure_local");
@@ -251,6 +251,22 @@ void get_parameters(char *filename, lattice* l, params *p) {
   #endif
 
   p->update_links = GetInt(config, "update_links");
+  p->overrelax_links = GetInt(config, "overrelax_links");
+  if (p->overrelax_links < 0) {
+    printf0("Need overrelax_links >= 0!! got %d\n", p->overrelax_links);
+    die(557);
+  }
+  p->metro_hits = GetInt(config, "metro_hits");
+  if (p->metro_hits < 1) {
+    printf0("Need metro_hits >= 1!! got %d\n", p->metro_hits);
+    die(555);
+  }
+  p->metro_step_su2link = GetDouble(config, "metro_step_su2link");
+  p->metro_target = GetDouble(config, "metro_target");
+  if (p->metro_target >= 1.0) {
+    printf0("Need metro_target < 1!! got %lf\n", p->metro_target);
+    die(556);
+  }
   p->update_su2doublet = GetInt(config, "update_doublet");
   p->scalar_sweeps = GetInt(config, "scalar_sweeps");
 
@@ -259,11 +275,18 @@ void get_parameters(char *filename, lattice* l, params *p) {
     p->msq_phi = GetDouble(config, "msq");
     p->lambda_phi = GetDouble(config, "lambda");
     p->phi0 = GetDouble(config, "phi0");
+    p->metro_step_doublet = GetDouble(config, "metro_step_doublet");
   #endif
 
   #ifdef U1
     p->betau1 = GetDouble(config, "betau1");
     p->r_u1 = GetDouble(config, "r_u1");
+    // heatbath picks one of r branches of the link, so r needs to be a positive integer
+    if (p->algorithm_u1link == HEATBATH && (p->r_u1 < 1.0 || p->r_u1 != floor(p->r_u1))) {
+      printf0("U(1) heatbath needs integer r_u1 >= 1, changing to metropolis...\n");
+      p->algorithm_u1link = METROPOLIS;
+    }
+    p->metro_step_u1link = GetDouble(config, "metro_step_u1link");
   #endif
 
   // Triplet parameters
@@ -271,6 +294,7 @@ void get_parameters(char *filename, lattice* l, params *p) {
     p->update_su2triplet = GetInt(config, "update_triplet");
     p->sigma0 = GetDouble(config, "sigma0");
     p->msq_triplet = GetDouble(config, "msq_triplet");
+    p->metro_step_triplet = GetDouble(config, "metro_step_triplet");
     p->b4 = GetDouble(config, "b4");
     #if (NHIGGS > 0)
       p->a2 = GetDouble(config, "a2");
@@ -281,6 +305,7 @@ void get_parameters(char *filename, lattice* l, params *p) {
   #ifdef SINGLET
     p->update_singlet = GetInt(config, "update_singlet");
     p->singlet0 = GetDouble(config, "singlet0");
+    p->metro_step_singlet = GetDouble(config, "metro_step_singlet");
     p->b1_s = GetDouble(config, "b1_s");
     p->msq_s = GetDouble(config, "msq_s");
     p->b3_s = GetDouble(config, "b3_s");
@@ -320,16 +345,42 @@ void get_parameters(char *filename, lattice* l, params *p) {
     p->do_trajectory = GetInt(config, "do_trajectory");
   #endif
 
+  #ifdef HMC
+    p->hmc_trajectories = GetInt(config, "hmc_trajectories");
+    p->hmc_steps = GetInt(config, "hmc_steps");
+    p->hmc_length = GetDouble(config, "hmc_length");
+    p->hmc_integrator = GetInt(config, "hmc_integrator");
+    if (p->hmc_integrator != HMC_LEAPFROG && p->hmc_integrator != HMC_OMELYAN) {
+      printf0("Invalid hmc_integrator!! got %d\n", p->hmc_integrator);
+      printf0("%d = leapfrog, %d = Omelyan\n", HMC_LEAPFROG, HMC_OMELYAN);
+      die(553);
+    }
+    if (p->hmc_trajectories > 0 && p->hmc_steps <= 0) {
+      printf0("Need hmc_steps > 0 for HMC!! got %d\n", p->hmc_steps);
+      die(554);
+    }
+  #endif
+
   #ifdef GRADFLOW
     p->do_flow = GetInt(config, "do_flow");
     p->flow_interval = GetInt(config, "flow_interval");
     p->flow_meas_interval = GetInt(config, "flow_meas_interval");
     p->flow_dt = GetDouble(config, "flow_dt");
     p->flow_t_max = GetDouble(config, "flow_t_max");
+    p->flow_integrator = GetInt(config, "flow_integrator");
+    p->flow_tolerance = GetDouble(config, "flow_tolerance");
+    GetString(config, "flow_observables", p->flow_observables);
+    p->flow_t2E_max = GetDouble(config, "flow_t2E_max");
+    if (p->flow_integrator != FLOW_EULER && p->flow_integrator != FLOW_RK3) {
+      printf0("Invalid flow_integrator!! got %d\n", p->flow_integrator);
+      printf0("%d = Euler, %d = third order Runge-Kutta\n", FLOW_EULER, FLOW_RK3);
+      die(552);
+    }
   #endif
 
   #ifdef MEASURE_Z
     p->do_z_meas = GetInt(config, "do_z_meas");
+    GetString(config, "z_observables", p->z_observables);
     p->setup_wall = GetInt(config, "setup_wall");
   #endif
 
@@ -338,11 +389,21 @@ void get_parameters(char *filename, lattice* l, params *p) {
 }
 
 
+/* Open the results file given in the config, root node only. This is not done in
+* get_parameters() so that the benchmark modes do not create any files. */
+void open_resultsfile(lattice const* l, params *p) {
+  // binary results file needs to be readable too, for checking the header (see init_results())
+  if (!l->rank) p->resultsfile = fopen(p->resultsfile_name, p->binary_results ? "a+b" : "a");
+}
+
 /* Just like get_parameters(), but reads params related to
 * multicanonical weighting.
 */
 void get_weight_parameters(char *filename, params *p, weight* w) {
 
+	// order parameter tracking is only turned on temporarily, see weight.track_orderparam
+	w->track_orderparam = 0;
+
 	if (!p->multicanonical) {
 		// no multicanonical, so just set dummy values
 		w->bins = 0;
@@ -417,6 +478,12 @@ void print_parameters(lattice l, params p) {
 		p.iterations, p.interval, p.checkpoint);
   printf("Will perform %d gauge sweeps, %d scalar sweeps per iteration\n",
     p.update_links, p.scalar_sweeps);
+  if (p.metro_hits > 1) {
+    printf("Metropolis with %d hits per site\n", p.metro_hits);
+  }
+  if (p.metro_target > 0) {
+    printf("Tuning Metropolis steps towards acceptance %.2lf during thermalization\n", p.metro_target);
+  }
 
 	printf("-------------------------- Lattice parameters --------------------------\n");
 	printf("SU(2) beta %g\n", p.betasu2);
@@ -0,0 +1,150 @@
+/** @file scaling.c
+*
+* Scaling benchmark, run with
+*
+*   mpirun -np <N> bin/su2 <config file> scaling <iterations>
+*
+* Times update_lattice() on random field configurations for different numbers of MPI nodes,
+* without reading or writing lattice, weight or measurement files. Rank counts are
+* n = 1, 2, 4, ... up to N, and N itself. For each n, the first n nodes of MPI_COMM_WORLD
+* run two benchmarks while the others wait:
+*   strong: the lattice from the config file, so the volume per node decreases as 1/n;
+*   weak: the config lattice enlarged n times, doubling side lengths one direction at a time,
+*         so the volume per node stays constant.
+* Each benchmark does one untimed iteration followed by <iterations> timed ones.
+* Multicanonical and HMC updates are not included.
+*
+* Results are written to scaling.csv, one line per benchmark, with columns
+*   mode, ranks, lattice, sites_per_rank, halo_sites_per_rank, iterations,
+*   seconds_per_iteration, ns_per_site_update, comms_fraction
+* ns_per_site_update is the time per iteration multiplied by the number of nodes and divided
+* by the volume, so it stays constant under perfect scaling. comms_fraction is the time spent
+* in halo exchanges relative to the total, averaged over nodes (see timers.c).
+*/
+
+#include "su2.h"
+
+/* Run the benchmark on the first n nodes of l->comm with side lengths L. The lattice
+* struct l only provides dim, rank and the communicator. Called from all nodes in l->comm. */
+static void scaling_run(lattice const* l, params const* p, weight* w, int const* L, int n,
+			int iterations, char* mode, FILE* file) {
+
+	lattice s;
+	s.dim = l->dim;
+	s.L = malloc(s.dim * sizeof(*s.L));
+	s.vol = 1;
+	for (int dir=0; dir<s.dim; dir++) {
+		s.L[dir] = L[dir];
+		s.vol *= L[dir];
+	}
+
+	if (s.vol % n != 0) {
+		printf0("Skipping %s scaling with %d nodes: cannot split %ld sites evenly\n", mode, n, s.vol);
+		free(s.L);
+		return;
+	}
+
+	#ifdef MPI
+		int member = (l->rank < n);
+		MPI_Comm_split(l->comm, member ? 0 : MPI_UNDEFINED, l->rank, &s.comm);
+	#else
+		int member = 1;
+		s.comm = l->comm;
+	#endif
+
+	if (member) {
+		s.rank = l->rank;
+		s.size = n;
+		#ifdef BLOCKING
+			s.blocklist.sends = 0; s.blocklist.recvs = 0;
+		#endif
+		int do_prints = 0;
+		layout(&s, do_prints, 0);
+
+		fields f;
+		counters c;
+		alloc_fields(&s, &f);
+		set_random_fields(&f, &s);
+		init_counters(&c);
+
+		update_lattice(&s, &f, p, &c, w); // warmup
+		barrier(s.comm);
+		reset_timers();
+		double start = wall_time();
+		for (int k=0; k<iterations; k++) {
+			update_lattice(&s, &f, p, &c, w);
+		}
+		double time = wall_time() - start;
+		double comms = (timer_total(TIMER_HALO) + timer_total(TIMER_GAUGEHALO)) / time;
+
+		comms = allreduce(comms, s.comm) / n;
+		double halos = allreduce((double) s.halos, s.comm) / n;
+		time = allreduce_max(time, s.comm) / iterations;
+
+		if (!s.rank) {
+			fprintf(file, "%s,%d,", mode, n);
+			for (int dir=0; dir<s.dim; dir++) fprintf(file, (dir > 0) ? "x%d" : "%d", s.L[dir]);
+			fprintf(file, ",%ld,%g,%d,%.6e,%.6e,%.4f\n", s.vol / n, halos, iterations,
+						time, 1e9 * time * n / s.vol, comms);
+			fflush(file);
+			printf("%s scaling, %d nodes: %lf seconds per iteration, %.2lf%% comms\n", mode, n, time, 100.0*comms);
+		}
+
+		free_fields(&s, &f);
+		free_lattice(&s); // also frees s.L
+		#ifdef MPI
+			MPI_Comm_free(&s.comm);
+		#endif
+	} else {
+		free(s.L);
+	}
+
+	barrier(l->comm);
+}
+
+/* Strong and weak scaling benchmarks, see the top of this file.
+* l needs dim, L, rank, size and comm from get_parameters() and main(), but no layout.
+* p and w are modified to turn off multicanonical and random sweep ordering. */
+void scaling_benchmark(lattice const* l, params* p, weight* w, int iterations) {
+
+	p->multicanonical = 0;
+	p->random_sweeps = 0;
+	w->do_acceptance = 0;
+	w->track_orderparam = 0;
+
+	if (iterations < 1) iterations = 1;
+
+	FILE* file = NULL;
+	if (!l->rank) {
+		file = fopen("scaling.csv", "w");
+		fprintf(file, "mode,ranks,lattice,sites_per_rank,halo_sites_per_rank,iterations,"
+					"seconds_per_iteration,ns_per_site_update,comms_fraction\n");
+	}
+	printf0("\nScaling benchmark with up to %d nodes, %d iterations per run\n", l->size, iterations);
+
+	int L[l->dim];
+	for (int n=1; n<=l->size; ) {
+
+		scaling_run(l, p, w, l->L, n, iterations, "strong", file);
+
+		// enlarge the lattice n times
+		memcpy(L, l->L, l->dim * sizeof(*L));
+		int m = n, dir = 0;
+		while (m % 2 == 0) {
+			L[dir] *= 2;
+			dir = (dir + 1) % l->dim;
+			m /= 2;
+		}
+		L[dir] *= m;
+		scaling_run(l, p, w, L, n, iterations, "weak", file);
+
+		// next power of two, and finally the full number of nodes
+		if (n == l->size) break;
+		n = (2*n < l->size) ? 2*n : l->size;
+	}
+
+	if (!l->rank) {
+		fclose(file);
+		printf("Wrote scaling results to scaling.csv\n");
+	}
+}
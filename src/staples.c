@@ -302,3 +302,109 @@ void staple_doublet(double* res, lattice const* l, fields const* f, params const
 }
 
 #endif // if NHIGGS > 0
+
+/* ----- SU(2) triplets ----- */
+
+#ifdef TRIPLET
+/* Same as staple_doublet(), but for the triplet: calculate s[a] so that
+* the hopping terms -2 \sum_i Tr A(x) U_i(x) A(x+i) U_i(x)^+ (and same for x-i) equal A_a(x) s[a].
+* These do not depend on A(x), so the local action is linear in s. */
+void staple_triplet(double* s, lattice const* l, fields const* f, params const* p, long i) {
+
+	double u[SU2LINK];
+	double b[SU2TRIP];
+
+	s[0] = 0.0; s[1] = 0.0; s[2] = 0.0;
+	for (int dir=0; dir<l->dim; dir++) {
+		long next = l->next[i][dir];
+		// link variable
+		for (int d=0; d<SU2LINK; d++) {
+			u[d] = f->su2link[i][dir][d];
+		}
+		// Sigma at next site
+		for (int d=0; d<SU2TRIP; d++) {
+			b[d] = f->su2triplet[next][d];
+		}
+		s[0] += -(b[0]*(u[0]*u[0])) - b[0]*(u[1]*u[1]) + 2*b[2]*u[0]*u[2] -
+		 				2*b[1]*u[1]*u[2] + b[0]*(u[2]*u[2]) - 2*b[1]*u[0]*u[3]
+						- 2*b[2]*u[1]*u[3] + b[0]*(u[3]*u[3]);
+		s[1] += -(b[1]*(u[0]*u[0])) - 2*b[2]*u[0]*u[1] + b[1]*(u[1]*u[1]) -
+						2*b[0]*u[1]*u[2] - b[1]*(u[2]*u[2]) + 2*b[0]*u[0]*u[3] -
+						2*b[2]*u[2]*u[3] + b[1]*(u[3]*u[3]);
+		s[2] += -(b[2]*(u[0]*u[0])) + 2*b[1]*u[0]*u[1] + b[2]*(u[1]*u[1])
+						- 2*b[0]*u[0]*u[2] + b[2]*(u[2]*u[2]) - 2*b[0]*u[1]*u[3]
+						- 2*b[1]*u[2]*u[3] - b[2]*(u[3]*u[3]);
+		// same for backwards directions
+		long prev = l->prev[i][dir];
+		for (int d=0; d<SU2LINK; d++) {
+			u[d] = f->su2link[prev][dir][d];
+		}
+		for (int d=0; d<SU2TRIP; d++) {
+			b[d] = f->su2triplet[prev][d];
+		}
+		s[0] += -(b[0]*(u[0]*u[0])) - b[0]*(u[1]*u[1]) - 2*b[2]*u[0]*u[2]
+						- 2*b[1]*u[1]*u[2] + b[0]*(u[2]*u[2]) + 2*b[1]*u[0]*u[3]
+						- 2*b[2]*u[1]*u[3] + b[0]*(u[3]*u[3]);
+		s[1] += -(b[1]*(u[0]*u[0])) + 2*b[2]*u[0]*u[1] + b[1]*(u[1]*u[1])
+						- 2*b[0]*u[1]*u[2] - b[1]*(u[2]*u[2]) - 2*b[0]*u[0]*u[3]
+						- 2*b[2]*u[2]*u[3] + b[1]*(u[3]*u[3]);
+		s[2] += -(b[2]*(u[0]*u[0])) - 2*b[1]*u[0]*u[1] + b[2]*(u[1]*u[1])
+						+ 2*b[0]*u[0]*u[2] + b[2]*(u[2]*u[2]) - 2*b[0]*u[1]*u[3]
+						- 2*b[1]*u[2]*u[3] - b[2]*(u[3]*u[3]);
+	}
+}
+#endif // TRIPLET
+
+#ifdef SINGLET
+/* Sum of the singlet at the nearest neighbors of site i. The hopping terms of
+* the local singlet action are -S(x) times this, see localact_singlet(). */
+double staple_singlet(lattice const* l, fields const* f, long i) {
+	double nn = 0.0;
+	for (int dir=0; dir<l->dim; dir++) {
+		nn += f->singlet[l->next[i][dir]][0] + f->singlet[l->prev[i][dir]][0];
+	}
+	return nn;
+}
+#endif
+
+#ifdef U1
+/* Coefficients of the local action of the U(1) link a = a_dir(x),
+*		S = -A cos(r a) + B sin(r a) - C cos(a) - D sin(a) + const.,
+* stored as k = {A, B, C, D}. A, B come from the plaquettes and include beta_U1,
+* C, D come from the doublet hopping terms. See u1link_action(). */
+void u1link_staple(lattice const* l, fields const* f, params const* p, long i, int dir, double* k) {
+
+	double a = f->u1link[i][dir];
+	double r = p->r_u1;
+
+	// plaquettes are r*(a + c_k) with c_k independent of a
+	double A = 0.0, B = 0.0;
+	for (int dir2 = 0; dir2<l->dim; dir2++) {
+		if (dir2 != dir) {
+			double c1 = u1ptrace(l, f, i, dir, dir2) - a;
+			// link enters the plaquette at x - dir2 with a minus sign
+			double c2 = -u1ptrace(l, f, l->prev[i][dir2], dir, dir2) - a;
+			A += cos(r * c1) + cos(r * c2);
+			B += sin(r * c1) + sin(r * c2);
+		}
+	}
+	k[0] = p->betau1 * A;
+	k[1] = p->betau1 * B;
+
+	// hopping terms are linear in cos(a) and sin(a)
+	k[2] = 0.0; k[3] = 0.0;
+	#if (NHIGGS > 0)
+		for (int db=0; db<NHIGGS; db++) {
+			double* phi1 = f->su2doublet[db][i];
+			double* phi2 = f->su2doublet[db][l->next[i][dir]];
+			k[2] += hopping_trace_su2u1(phi1, f->su2link[i][dir], phi2, 0.0);
+			k[3] += hopping_trace_su2u1(phi1, f->su2link[i][dir], phi2, 0.5*M_PI);
+		}
+	#endif
+}
+
+/* Local U(1) link action at link value a, with coefficients k from u1link_staple() */
+double u1link_action(double const* k, double r, double a) {
+	return -k[0]*cos(r * a) + k[1]*sin(r * a) - k[2]*cos(a) - k[3]*sin(a);
+}
+#endif
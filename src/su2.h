@@ -8,6 +8,25 @@
 	#define NHIGGS 0
 #endif
 
+// max number of sites that scalar overrelaxation updates at once, see overrelax.c
+#define OVERRELAX_BATCH 32
+
+// wall-clock timer regions, see timers.c
+#define TIMER_UPDATE 0
+#define TIMER_LINKS 1
+#define TIMER_SCALARS 2
+#define TIMER_MUCA 3
+#define TIMER_GAUGEHALO 4
+#define TIMER_HALO 5
+#define TIMER_MEASURE 6
+#define TIMER_MEASURE_Z 7
+#define TIMER_FLOW 8
+#define TIMER_CORRELATORS 9
+#define TIMER_TRAJECTORY 10
+#define TIMER_HMC 11
+#define TIMER_CHECKPOINT 12
+#define N_TIMERS 13
+
 
 /* Struct "lattice": contains info on lattice dimensions, lookup tables for
 * sites and everything related to parallelization. */
@@ -54,8 +73,9 @@ typedef struct {
 	#ifdef BLOCKING
 		// communications between the blocked lattice and the original
 		comlist_struct blocklist;
-		// some MPI nodes may not fit on the blocked lattice and have to standby
-		int standby;
+		/* blocked lattices that cannot be split evenly over all MPI nodes
+		* are replicated: each node holds a full copy in its own communicator */
+		int replicated;
 		int blocking_level;
 	#endif
 
@@ -82,8 +102,11 @@ typedef struct {
 	long n_thermalize;
 	long interval;
 	FILE *resultsfile;
+	char resultsfile_name[200]; // opened in open_resultsfile()
+	int binary_results; // 1 = write measurements as buffered binary records, 0 = plain text
 	char latticefile[100];
 	int run_checks;
+	long random_seed; // 0 = take the seed from time()
 	int do_local_meas;
 
 	int multicanonical;
@@ -123,8 +146,20 @@ typedef struct {
 	int algorithm_su2doublet;
 	int algorithm_su2triplet;
 
+	/* Metropolis: how many proposals per site and visit (scalars and U(1) links),
+	* and the widths of the proposal distributions. The widths are tuned during
+	* thermalization if metro_target > 0, and stored in the latticefile */
+	int metro_hits;
+	double metro_step_su2link;
+	double metro_step_u1link;
+	double metro_step_doublet;
+	double metro_step_triplet;
+	double metro_step_singlet;
+	double metro_target; // target acceptance rate for tuning the widths
+
 	// How many times to update a field per sweep
 	int update_links;
+	int overrelax_links; // overrelaxation sweeps per heatbath/Metropolis sweep if links use overrelax
 	int scalar_sweeps; // update all scalars n times per iteration
 	// additional sweeps on top of scalar_sweeps
 	int update_su2doublet;
@@ -159,6 +194,8 @@ typedef struct {
 
 	#ifdef MEASURE_Z
 		int n_meas_z; // how many quantities to measure along z
+		char z_observables[200]; // comma separated list of observables to measure along z, see z_coord.c
+		int* z_obs; // which observables to measure, set in print_z_labels()
 		int meas_interval_z; // read in from config file in get_parameters()
 		int do_z_meas;
 		// Prepare an initial configuration with phase interface ("wall")?
@@ -172,12 +209,23 @@ typedef struct {
 		double flow_t_max; // max time for a single flow (start from t=0)
 		int flow_interval; // how many non-flow iterations between flows
 		int flow_meas_interval; // how often to measure during flowing (in units of dt)
+		int flow_integrator; // FLOW_EULER or FLOW_RK3
+		double flow_tolerance; // max distance per step for adaptive RK3 step size, 0 for fixed step
+		char flow_observables[200]; // "full", "default" or comma separated list, see gradflow.c
+		double flow_t2E_max; // stop flowing when t^2 <E> reaches this, 0 = always flow to flow_t_max
 	#endif
 
 	#ifdef HB_TRAJECTORY
 		int do_trajectory; // measure realtime trajectories if nonzero, specify in config file
 	#endif
 
+	#ifdef HMC
+		int hmc_trajectories; // HMC trajectories per iteration, after the local updates. 0 = no HMC
+		int hmc_steps; // molecular dynamics steps per trajectory
+		double hmc_length; // trajectory length in molecular dynamics time
+		int hmc_integrator; // HMC_LEAPFROG or HMC_OMELYAN
+	#endif
+
 } params;
 
 
@@ -212,6 +260,8 @@ typedef struct {
 	// count metropolis updates
 	long total_su2link, accepted_su2link;
 	long total_u1link, accepted_u1link;
+	long total_overrelax_su2link, acc_overrelax_su2link;
+	long total_overrelax_u1link, acc_overrelax_u1link;
 	#if (NHIGGS > 0)
 		long total_doublet[NHIGGS], accepted_doublet[NHIGGS];
 		long total_overrelax_doublet[NHIGGS], acc_overrelax_doublet[NHIGGS];
@@ -228,6 +278,7 @@ typedef struct {
 	long total_overrelax_triplet, acc_overrelax_triplet;
 
 	long total_muca, accepted_muca;
+	long total_hmc, accepted_hmc;
 } counters;
 
 
@@ -245,6 +296,13 @@ typedef struct {
 	* Will not update weight either if set to 0. Used in update sweep routines. */
 	int do_acceptance;
 
+	/* 1 if update sweeps keep track of the local order parameter in local_param[parity],
+	* i.e. the sum over my sites of that parity, not divided by volume. Only the sweeps for fields
+	* that the order parameter depends on contribute. Used in realtime trajectories, where
+	* there is no muca accept/reject and so the order parameter is not otherwise recalculated. */
+	int track_orderparam;
+	double local_param[2];
+
 	// how many times is multicanonical_acceptance() called per update sweep (separately for each field, parity)
 	int checks_per_sweep;
 
@@ -274,6 +332,49 @@ typedef struct {
 } weight;
 
 
+/* Output buffer for volume averages, see measure.c.
+* In binary mode, each measurement is a fixed-width record of 'columns' doubles, kept in memory
+* until flush_results() is called (at checkpoints, or when the buffer fills up).
+* The binary file starts with RESULTS_MAGIC, the number of columns (int) and
+* the text from write_labels() terminated by '\0'. Use scripts/meas_to_text.py to convert. */
+#define RESULTS_MAGIC "su2meas"
+#define LOCAL_MAGIC "su2local" // same for local measurements, see write_local_field()
+typedef struct {
+	FILE* file; // open in root node only
+	int binary;
+	int columns;
+	long records, max_records;
+	double* buf;
+} results_buffer;
+
+#ifdef GRADFLOW
+/* Work space for gradient flow, see gradflow.c. Allocated once with init_flow()
+* and reused by every call to grad_flow(), so that flows do not allocate memory. */
+typedef struct {
+	fields flow; // flowing fields
+	fields forces; // gradient forces for each field
+	fields acc; // RK3 accumulator, RK3 only
+	fields err; // RK3 second order estimate, adaptive step only
+	fields start; // fields at the start of a step, adaptive step only
+	int rk3, adaptive; // which of the above are allocated
+	int full_meas; // use measure() instead of the observables below
+	int n_obs; // how many flow observables to measure
+	int* obs; // which observables, indices to flow_registry in gradflow.c
+} flow_context;
+#endif
+
+#ifdef HMC
+/* Work space for hybrid Monte Carlo, see hmc.c. Allocated once with init_hmc().
+* Momenta and forces for SU(2) links are adjoint vectors stored in components 1-3
+* of a "link", as in gradflow.c */
+typedef struct {
+	fields mom; // conjugate momenta
+	fields forces; // molecular dynamics forces, -dS/dq
+	fields backup; // configuration at the start of a trajectory, restored on reject
+} hmc_context;
+#endif
+
+
 // comms.c
 void printf0(char *msg, ...);
 void make_comlists(lattice *l, comlist_struct *comlist);
@@ -282,7 +383,13 @@ void reorder_sitelist(lattice* l, sendrecv_struct* sr);
 void reorder_comlist(lattice* l, comlist_struct* comlist);
 double reduce_sum(double res, MPI_Comm comm);
 double allreduce(double res, MPI_Comm comm);
+double allreduce_max(double res, MPI_Comm comm);
+double allreduce_min(double res, MPI_Comm comm);
 long reduce_sum_long(long res, MPI_Comm comm);
+void reduce_sum_array(double* arr, int size, MPI_Comm comm);
+void allreduce_array(double* arr, int size, MPI_Comm comm);
+void allreduce_array_max(double* arr, int size, MPI_Comm comm);
+void allreduce_array_min(double* arr, int size, MPI_Comm comm);
 void bcast_int(int *res, MPI_Comm comm);
 void bcast_long (long *res, MPI_Comm comm);
 void bcast_double(double *res, MPI_Comm comm);
@@ -306,6 +413,24 @@ void send_field(sendrecv_struct* send, MPI_Comm comm, MPI_Request* req, char par
 void test_comms(lattice* l);
 void test_comms_individual(lattice* l);
 
+// timers.c
+double wall_time();
+void reset_timers();
+void timer_start(int id);
+void timer_stop(int id);
+double timer_total(int id);
+void write_timings(lattice const* l, char* fname, long iter, long n_iter);
+#ifdef PERF_COUNTERS
+void init_perf_counters(lattice const* l);
+void timer_add_flops(int id, double flops);
+#endif
+
+// checks.c
+void test_action(lattice* l, params const* p);
+
+// scaling.c
+void scaling_benchmark(lattice const* l, params* p, weight* w, int iterations);
+
 // layout.c
 void layout(lattice *l, int do_prints, int run_checks);
 void make_slices(lattice *l, int do_prints);
@@ -385,7 +510,12 @@ double potential_singlet(fields const* f, params const* p, long i);
 // smearing
 void smear_link(lattice const* l, fields const* f, int const* smear_dir, double* res, long i, int dir);
 void smear_triplet(lattice const* l, fields const* f, int const* smear_dir, double* res, long i);
-void smear_fields(lattice const* l, fields const* f, fields* f_b, int const* block_dir);
+#if (NHIGGS > 0)
+void smear_doublet(lattice const* l, fields const* f, int const* smear_dir, double* res, long i, int higgs_id);
+#endif
+#ifdef SINGLET
+double smear_singlet(lattice const* l, fields const* f, int const* smear_dir, long i);
+#endif
 #endif
 
 
@@ -395,37 +525,65 @@ void su2staple_clockwise(double* V, double* u1, double* u2, double* u3);
 void su2staple_wilson(lattice const* l, fields const* f, long i, int dir, double* V);
 void su2staple_wilson_onedir(lattice const* l, fields const* f, long i, int mu, int nu, int dagger, double* res);
 void su2link_staple(lattice const* l, fields const* f, params const* p, long i, int dir, double* V);
+#ifdef U1
+void u1link_staple(lattice const* l, fields const* f, params const* p, long i, int dir, double* k);
+double u1link_action(double const* k, double r, double a);
+#endif
 void staple_doublet(double* res, lattice const* l, fields const* f, params const* p, long i, int higgs_id);
+#ifdef TRIPLET
+void staple_triplet(double* s, lattice const* l, fields const* f, params const* p, long i);
+#endif
+#ifdef SINGLET
+double staple_singlet(lattice const* l, fields const* f, long i);
+#endif
 
 
 // metropolis.c
 int metro_su2link(lattice const* l, fields* f, params const* p, long i, int dir);
 int metro_u1link(lattice const* l, fields* f, params const* p, long i, int dir);
 int metro_doublet(lattice const* l, fields* f, params const* p, long i, int higgs_id);
+double localact_doublet_staple(lattice const* l, fields const* f, params const* p,
+			double const* s, long i, int higgs_id);
+#ifdef TRIPLET
 int metro_triplet(lattice const* l, fields* f, params const* p, long i);
+double localact_triplet_staple(lattice const* l, fields const* f, params const* p,
+			double const* s, long i);
+#endif
 #ifdef SINGLET
 int metro_singlet(lattice const* l, fields* f, params const* p, long i);
+double localact_singlet_staple(lattice const* l, fields const* f, params const* p, double nn, long i);
 #endif
+void tune_metropolis(lattice const* l, params* p, counters const* c, counters* prev);
 
 // heatbath.c
 int heatbath_su2link(lattice const* l, fields* f, params const* p, long i, int dir);
+#ifdef U1
+int heatbath_u1link(lattice const* l, fields* f, params const* p, long i, int dir);
+#endif
 
 // overrelax.c
 double polysolve3(long double a, long double b, long double c, long double d);
+#if (NHIGGS > 0) || defined(TRIPLET) || defined(SINGLET)
+void polysolve3_batch(int n, double* a, double* b, double* c, double* d, double* x);
+#endif
+int overrelax_su2link(lattice const* l, fields* f, params const* p, long i, int dir);
+#ifdef U1
+int overrelax_u1link(lattice const* l, fields* f, params const* p, long i, int dir);
+#endif
 #if (NHIGGS > 0)
-int overrelax_doublet(lattice const* l, fields* f, params const* p, long i); // for N=1 Higgs potentials
-int overrelax_higgs2(lattice const* l, fields* f, params const* p, long i, int higgs_id); // for N>1 Higgs potentials
+int overrelax_doublet(lattice const* l, fields* f, params const* p, long i, int n); // for N=1 Higgs potentials
+int overrelax_higgs2(lattice const* l, fields* f, params const* p, long i, int n, int higgs_id); // for N>1 Higgs potentials
 #endif
-int overrelax_triplet(lattice const* l, fields* f, params const* p, long i);
+int overrelax_triplet(lattice const* l, fields* f, params const* p, long i, int n);
 #ifdef SINGLET
-int overrelax_singlet(lattice const* l, fields* f, params const* p, long i);
+int overrelax_singlet(lattice const* l, fields* f, params const* p, long i, int n);
 #endif
 
 
 // update.c
 void update_lattice(lattice* l, fields* f, params const* p, counters* c, weight* w);
-void checkerboard_sweep_su2link(lattice const* l, fields* f, params const* p, counters* c, int parity, int dir);
-void checkerboard_sweep_u1link(lattice const* l, fields* f, params const* p, counters* c, int parity, int dir);
+void checkerboard_sweep_su2link(lattice const* l, fields* f, params const* p, counters* c, int parity, int dir, int overrelax);
+void checkerboard_sweep_u1link(lattice const* l, fields* f, params const* p, counters* c, int parity, int dir, int overrelax);
 int checkerboard_sweep_su2doublet(lattice const* l, fields* f, params const* p, counters* c,
 			weight* w, int parity, int metro, int higgs_id);
 int checkerboard_sweep_su2triplet(lattice const* l, fields* f, params const* p, counters* c, weight* w, int parity, int metro);
@@ -439,12 +597,13 @@ void shuffle(int *arr, int len);
 
 // init.c
 void setsu2(fields* f, lattice const* l);
-void random_su2link(double *su2);
+void random_su2link(double *su2, double step);
 void setu1(fields* f, lattice const* l);
 #ifdef SINGLET
 void set_singlets(fields* f, lattice const* l, params const* p);
 #endif
 void setfields(fields* f, lattice* l, params const* p);
+void set_random_fields(fields* f, lattice* l);
 void setdoublets(fields* f, lattice const* l, params const* p);
 void settriplets(fields* f, lattice const* l, params const* p);
 void cp_field(lattice const* l, double** field, double** new, int dofs, int parity);
@@ -455,12 +614,13 @@ void init_counters(counters* c);
 void print_acceptance(params p, counters c);
 void write_field(lattice const* l, FILE *file, double *field, int size);
 void read_field(lattice const* l, FILE *file, double *field, int size);
-void save_lattice(lattice const* l, fields f, counters c, char* fname);
-void load_lattice(lattice* l, fields* f, counters* c, char* fname);
+void save_lattice(lattice const* l, fields f, counters c, params const* p, char* fname);
+void load_lattice(lattice* l, fields* f, counters* c, params* p, char* fname);
 
 // parameters.c
 int OpenRead(char* fname, FILE** file);
 void get_parameters(char *filename, lattice* l, params *p);
+void open_resultsfile(lattice const* l, params *p);
 void get_weight_parameters(char *filename, params *p, weight* w);
 void print_parameters(lattice l, params p);
 void read_updated_parameters(char *filename, lattice const* l, params *p);
@@ -472,12 +632,20 @@ void GetString(FILE* fileIn, char* label, char* result);
 int GetUpdateAlgorithm(FILE* fileIn, char* label);
 
 // measure.c
-void measure(FILE* file, lattice const* l, fields const* f, params const* p, weight* w);
+void measure(results_buffer* out, lattice const* l, fields const* f, params const* p, weight* w);
 // weight not necessarily constant because measure() can recalculate the order parameter
 double action_local(lattice const* l, fields const* f, params const* p, long i);
-void print_labels();
+int write_labels(FILE* f);
+int print_labels();
+void init_results(results_buffer* out, FILE* file, int binary, long max_records);
+void write_results_header(FILE* file, int columns);
+void write_results(results_buffer* out, double const* res);
+void flush_results(results_buffer* out);
+void free_results(results_buffer* out);
+int write_labels_local(FILE* f);
 void measure_local(char* fname, lattice const* l, fields const* f, params const* p);
 void print_labels_local(lattice const* l, char* fname);
+void write_local_field(char* fname, lattice const* l, double const* data, int n);
 
 // multicanonical.c
 void load_weight(weight *w);
@@ -487,8 +655,10 @@ void linearize_weight(weight* w);
 double get_weight(weight const* w, double val);
 void muca_accumulate_hits(weight* w, double val);
 int update_weight(weight* w);
-int multicanonical_acceptance(lattice const* l, weight* w, double oldval, double newval);
+int multicanonical_acceptance(lattice const* l, weight* w, double oldval, double newval, double dH);
 int whichbin(weight const* w, double val);
+double orderparam_site(fields const* f, weight const* w, long i);
+double local_orderparam(lattice const* l, fields const* f, weight const* w, char par);
 double calc_orderparam(lattice const* l, fields const* f, params const* p, weight* w, char par);
 void alloc_muca_backups(lattice const* l, weight* w);
 void free_muca_arrays(fields* f, weight *w);
@@ -497,17 +667,9 @@ void update_weight_slow(weight* w);
 
 #ifdef CORRELATORS
 // correlation.c
-	#if (NHIGGS > 0)
-		double higgs_correlator(lattice* l, fields const* f, int x, int dir, int higgs_id);
-	#endif
 	#ifdef TRIPLET
-		double triplet_correlator(lattice* l, fields const* f, int d, int dir);
-		complex projected_photon_operator(lattice* l, fields const* f, int z, int dir, int* mom);
-		complex projected_photon_correlator(lattice* l, fields const* f, int d, int dir);
-		double projected_photon_operator_old(lattice* l, fields const* f, params const* p, int z, int dir,
-		      int* mom, double* res_re, double* res_im);
-		void projected_photon_correlator_old(lattice* l, fields const* f, params const* p, int d,
-		  		int dir, double* res_re, double* res_im);
+		double photon_clover_op(lattice const* l, fields const* f, long site, int dir);
+		double photon_alpha_op(lattice const* l, fields const* f, params const* p, long site, int dir);
 	#endif
 	double plane_sum(double (*funct)(double*), double** field, lattice* l, long x, int dir);
 	void measure_correlators(char* fname, lattice* l, fields const* f, params const* p, int dir, int meas_id);
@@ -540,13 +702,45 @@ void update_weight_slow(weight* w);
 
 #ifdef GRADFLOW
 	// gradflow.c
-	void grad_flow(lattice* l, fields const* f, params* p, weight* w, double t_max, double dt, int flow_id);
+	void init_flow(lattice const* l, params const* p, flow_context* ctx);
+	void free_flow(lattice const* l, flow_context* ctx);
+	void grad_flow(lattice* l, fields const* f, params* p, weight* w, flow_context* ctx,
+				double t_max, double dt, int flow_id);
+	void flow_step_euler(lattice* l, fields* flow, params const* p, fields* forces, double dt);
+	double flow_step_rk3(lattice* l, fields* flow, params const* p, fields* forces, fields* acc,
+				fields* err, fields const* start, double dt);
+	void remove_counterterms(params* p);
+#endif
+
+#if defined(GRADFLOW) || defined(HMC)
+	// gradflow.c, forces and field updates
 	void grad_force_link(lattice const* l, fields const* f, params const* p, double* force, long i, int dir);
 	void grad_force_triplet(lattice const* l, fields const* f, params const* p, double* force, long i);
+	#if (NHIGGS > 0)
+		void grad_force_doublet(lattice const* l, fields const* f, params const* p, double* force, long i, int higgs_id);
+	#endif
+	#ifdef SINGLET
+		double grad_force_singlet(lattice const* l, fields const* f, params const* p, long i);
+	#endif
+	#ifdef U1
+		double grad_force_u1link(lattice const* l, fields const* f, params const* p, long i, int dir);
+	#endif
 	void calc_gradient(lattice const* l, fields const* f, params const* p, fields* forces);
+	void su2exp_algebra(double const* z, double dt, double* u);
 	void flow_gauge(lattice const* l, fields* flow, fields const* forces, double dt);
-	void flow_triplet(lattice const* l, fields* flow, fields const* forces, double dt);
-	void remove_counterterms(params* p);
+	#ifdef TRIPLET
+		void flow_triplet(lattice const* l, fields* flow, fields const* forces, double dt);
+	#endif
+	#if (NHIGGS > 0)
+		void flow_doublet(lattice const* l, fields* flow, fields const* forces, double dt);
+	#endif
+	#ifdef SINGLET
+		void flow_singlet(lattice const* l, fields* flow, fields const* forces, double dt);
+	#endif
+	#ifdef U1
+		void flow_u1link(lattice const* l, fields* flow, fields const* forces, double dt);
+	#endif
+	void flow_fields(lattice const* l, fields* flow, fields const* forces, double dt);
 #endif
 
 #ifdef BLOCKING
@@ -554,11 +748,7 @@ void update_weight_slow(weight* w);
 	int max_block_level(lattice const* l, int const* block_dir);
 	void block_lattice(lattice* l, lattice* b, int const* block_dir);
 	void make_blocklists(lattice* l, lattice* b, int const* block_dir);
-	void standby_layout(lattice* l);
-	void transfer_blocked_gaugefield(lattice* l, lattice* b, double*** field, double*** field_b, int dofs, int dir);
-	void transfer_blocked_field(lattice* l, lattice* b, double** field, double** field_b, int dofs);
-	void make_blocked_fields(lattice* l, lattice* b, fields const* f, fields* f_blocked);
-	void block_fields_ownnode(lattice const* l, lattice const* b, fields const* f_smeared, fields* f_blocked);
+	void make_blocked_fields(lattice* l, lattice* b, fields const* f, fields* f_blocked, int const* block_dir, int smear);
 	void test_blocking(lattice* l, lattice* b, int const* block_dir);
 #endif
 
@@ -572,14 +762,30 @@ void update_weight_slow(weight* w);
 	  int interval; // how often to measure in trajectory mode
 	  int mode_interval; // how often to switch to trajectory mode
 	  double min, max; // min and max values of the order parameter before trajectory is considered complete
+	  // concurrent replicas, see init_replicas()
+	  int replicas; // how many trajectories to run at the same time (optional in realtime_config, default 1)
+	  int replica_id; // replica that my node belongs to
+	  lattice rl; // my replica of the lattice, in a sub-communicator. Only used if replicas > 1
+	  comlist_struct scatter; // for copying fields from the full lattice to the replicas
 	} trajectory;
 
 	// hb_trajectory.c
 	void make_realtime_trajectories(lattice* l, fields const* f, params* p, counters* c,
 		 	weight* w, trajectory* traj, int id);
+	void init_replicas(lattice* l, trajectory* traj, int run_checks);
+	void free_replicas(trajectory* traj);
 	void read_realtime_config(char *filename, trajectory* traj);
 	void print_realtime_params(params p, trajectory traj);
 
 #endif
 
+#ifdef HMC
+	// hmc.c
+	void init_hmc(lattice const* l, hmc_context* ctx);
+	void free_hmc(lattice const* l, hmc_context* ctx);
+	double total_action(lattice const* l, fields const* f, params const* p);
+	void hmc_forces(lattice const* l, fields const* f, params const* p, fields* forces);
+	int hmc_trajectory(lattice* l, fields* f, params const* p, counters* c, weight* w, hmc_context* ctx);
+#endif
+
 #endif // end #ifndef SU2_H
@@ -797,9 +797,69 @@ void smear_link(lattice const* l, fields const* f, int const* smear_dir, double*
 }
 
 
-// TODO doublet
-void smear_doublet(lattice const* l, fields const* f, int const* smear_dir, double* res, long i) {
+#if (NHIGGS > 0)
+/* Smear the doublet field 'higgs_id' at site i and store in res (doublet components).
+* Analogous to smear_triplet(), this calculates
+* 	Phi(x) + sum_j [ U_j(x) Phi(x+j) exp(-i Y alpha_j(x) sigma_3) + U^+_j(x-j) Phi(x-j) exp(i Y alpha_j(x-j) sigma_3) ]
+* normalized with the number of sites. The sum is over directions specified in smear_dir.
+* The hypercharge factors are included only if U1 is defined (Y = 1, see hopping_trace_su2u1()). */
+void smear_doublet(lattice const* l, fields const* f, int const* smear_dir, double* res, long i, int higgs_id) {
+
+	double** phi = f->su2doublet[higgs_id];
+	int sites = 1; // how many sites are involved in smearing
+	memcpy(res, phi[i], SU2DB * sizeof(*res));
+
+	for (int dir=0; dir<l->dim; dir++) {
+		if (smear_dir[dir]) {
+			double a[SU2DB];
+
+			// forward connection U_j(x) Phi(x+j)
+			long next = l->next[i][dir];
+			memcpy(a, f->su2link[i][dir], SU2LINK * sizeof(*a));
+			su2rot(a, phi[next]);
+			#ifdef U1
+				double yf[SU2DB] = { cos(f->u1link[i][dir]), 0.0, 0.0, -sin(f->u1link[i][dir]) };
+				su2rot(a, yf);
+			#endif
+			for (int k=0; k<SU2DB; k++) res[k] += a[k];
+
+			// backward connection U^+_j(x-j) Phi(x-j)
+			long prev = l->prev[i][dir];
+			double* u = f->su2link[prev][dir];
+			a[0] = u[0]; a[1] = -u[1]; a[2] = -u[2]; a[3] = -u[3];
+			su2rot(a, phi[prev]);
+			#ifdef U1
+				double yb[SU2DB] = { cos(f->u1link[prev][dir]), 0.0, 0.0, sin(f->u1link[prev][dir]) };
+				su2rot(a, yb);
+			#endif
+			for (int k=0; k<SU2DB; k++) res[k] += a[k];
+
+			sites += 2; // involves 2 nearest neighbors
+		}
+	}
+
+	for (int k=0; k<SU2DB; k++) {
+		res[k] /= ((double) sites);
+	}
+}
+#endif
+
+#ifdef SINGLET
+/* Smear the singlet at site i by averaging over itself and its nearest neighbors
+* in the directions specified in smear_dir. Returns the smeared value. */
+double smear_singlet(lattice const* l, fields const* f, int const* smear_dir, long i) {
+
+	int sites = 1;
+	double res = f->singlet[i][0];
+	for (int dir=0; dir<l->dim; dir++) {
+		if (smear_dir[dir]) {
+			res += f->singlet[ l->next[i][dir] ][0] + f->singlet[ l->prev[i][dir] ][0];
+			sites += 2;
+		}
+	}
+	return res / ((double) sites);
 }
+#endif
 
 /* Smear the triplet field at site i and store in res (triplet components).
 * This is done by calculating
@@ -857,52 +917,4 @@ void smear_triplet(lattice const* l, fields const* f, int const* smear_dir, doub
 }
 
 
-/* Smear all fields and store in f_b. Does not smear fields at odd sites in smearing
-* directions, because those are not needed for blocked lattices. */
-void smear_fields(lattice const* l, fields const* f, fields* f_b, int const* block_dir) {
-
-  // no halos
-  for (long i=0; i<l->sites; i++) {
-    int skip = 0;
-
-    // smear fields only on the sites that end up on the blocked lattice
-    for (int dir=0; dir<l->dim; dir++) {
-      if (block_dir[dir] && l->coords[i][dir] % 2 != 0) {
-        // no need to smear these
-        skip = 1;
-        break;
-      }
-    }
-
-    if (!skip) {
-      // create blocked fields by smearing in the specified dirs.
-
-      // gauge links. links pointing in non-smeared directions remain unchanged
-      for (int dir=0; dir<l->dim; dir++) {
-        if (block_dir[dir]) {
-          smear_link(l, f, block_dir, f_b->su2link[i][dir], i, dir);
-          #ifdef U1
-
-          #endif
-        } else {
-          memcpy(f_b->su2link[i][dir], f->su2link[i][dir], SU2LINK * sizeof(*f->su2link[i][dir]));
-          #ifdef U1
-            f_b->u1link[i][dir] = f->u1link[i][dir];
-          #endif
-        }
-      } // end dir
-
-      // scalars
-      #if (NHIGGS > 0)
-
-      #endif
-      #ifdef TRIPLET
-        smear_triplet(l, f, block_dir, f_b->su2triplet[i], i);
-      #endif
-
-    }
-
-  } // end i
-}
-
 #endif // end BLOCKING
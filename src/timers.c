@@ -0,0 +1,317 @@
+/** @file timers.c
+*
+* Wall-clock timers for the different phases of the simulation.
+*
+* A region is timed with timer_start(id) ... timer_stop(id), with the ids defined in su2.h.
+* Regions can be nested: the time spent in a nested region is included in the total time
+* of the enclosing region, while the "self" time of a region excludes it. For example,
+* halo exchanges done after a link sweep count towards both "update" and "gaugehalo",
+* but only the latter has them in its self time.
+*
+* Timings are accumulated between calls to write_timings(), which combines them over
+* MPI ranks and appends min/avg/max per iteration of each region to a text file.
+* The first line of each block is the elapsed wall-clock time ("total"),
+* so that fractions of the total time can be read off directly.
+*
+* With -DPERF_COUNTERS (Linux only), the timers also read CPU hardware counters
+* (cycles, instructions, cache references and misses) with the perf_event_open system call,
+* so no external library is needed. Counts are for user space of my process only and
+* are written as extra columns of self counts per iteration, averaged over nodes.
+* Events that the CPU or kernel does not provide are written as nan; in particular
+* perf_event_paranoid > 2 or running in a virtual machine can disable all of them.
+* If the kernel has to multiplex the counters, the counts are scaled up by
+* time_enabled / time_running, so they are estimates in that case.
+* The last column is an analytic estimate of the floating point operations per iteration,
+* added to the regions with timer_add_flops() (see update_lattice()), or nan
+* for regions without an estimate. Comparing it with the cycle count gives flops per cycle.
+*/
+
+#include "su2.h"
+
+#ifdef PERF_COUNTERS
+	#include <linux/perf_event.h>
+	#include <sys/syscall.h>
+	#define N_PERF 4
+#endif
+
+// maximum depth of nested regions
+#define TIMER_MAX_DEPTH 16
+
+// names of the regions in the output, in the order of the TIMER_* ids
+static char* timer_names[N_TIMERS] = {
+	"update", "link_sweeps", "scalar_sweeps", "muca_checks", "gaugehalo", "halo",
+	"measure", "measure_z", "gradflow", "correlators", "trajectories", "hmc", "checkpoint"
+};
+
+static struct {
+	double start; // wall_time() at timer_start()
+	double total; // accumulated time
+	double nested; // accumulated time in nested regions
+	long calls;
+	#ifdef PERF_COUNTERS
+		long long perf_start[N_PERF]; // counter values at timer_start()
+		long long perf[N_PERF], perf_nested[N_PERF];
+		double flops; // analytic estimate, see timer_add_flops()
+	#endif
+} timers[N_TIMERS];
+
+// stack of active regions
+static int timer_stack[TIMER_MAX_DEPTH];
+static int timer_depth = 0;
+
+// wall_time() at the last reset
+static double timers_reset_time = 0.0;
+
+#ifdef PERF_COUNTERS
+// hardware events, in the order of the output columns
+static struct {
+	char* name;
+	unsigned long long config;
+} perf_events[N_PERF] = {
+	{ "cycles", PERF_COUNT_HW_CPU_CYCLES },
+	{ "instructions", PERF_COUNT_HW_INSTRUCTIONS },
+	{ "cache_refs", PERF_COUNT_HW_CACHE_REFERENCES },
+	{ "cache_misses", PERF_COUNT_HW_CACHE_MISSES }
+};
+
+/* The events that could be opened are read together as one group with leader perf_fd.
+* perf_slot[e] is the position of event e in the group, or -1 if it is not available. */
+static int perf_fd = -1;
+static int perf_slot[N_PERF];
+static long long perf_reset[N_PERF]; // counter values at the last reset
+
+/* Open the hardware counters on my node. Should be called before reset_timers(). */
+void init_perf_counters(lattice const* l) {
+
+	int n = 0;
+	for (int e=0; e<N_PERF; e++) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = perf_events[e].config;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		// pid = 0, cpu = -1: count my process on any CPU
+		int fd = syscall(__NR_perf_event_open, &attr, 0, -1, perf_fd, 0);
+		perf_slot[e] = -1;
+		if (fd < 0) continue;
+		if (perf_fd < 0) perf_fd = fd;
+		perf_slot[e] = n;
+		n++;
+	}
+
+	if (!l->rank) {
+		printf("Hardware counters in timed regions:");
+		for (int e=0; e<N_PERF; e++) {
+			if (perf_slot[e] >= 0) printf(" %s", perf_events[e].name);
+		}
+		if (n == 0) printf(" none available! Check /proc/sys/kernel/perf_event_paranoid");
+		printf("\n");
+	}
+}
+
+/* Read current values of all counters, 0 for unavailable events. If the group was
+* not on the CPU all the time (more events than hardware counters), the values
+* are scaled by time_enabled / time_running. */
+static void read_perf(long long* val) {
+	struct {
+		unsigned long long nr;
+		unsigned long long time_enabled, time_running;
+		unsigned long long values[N_PERF];
+	} buf;
+
+	if (perf_fd < 0 || read(perf_fd, &buf, sizeof(buf)) <= 0) {
+		buf.nr = 0;
+	}
+	double scale = 1.0;
+	if (buf.nr > 0 && buf.time_running > 0 && buf.time_running < buf.time_enabled) {
+		scale = (double) buf.time_enabled / buf.time_running;
+	}
+	for (int e=0; e<N_PERF; e++) {
+		int k = perf_slot[e];
+		val[e] = (k >= 0 && k < buf.nr) ? (long long) (scale * buf.values[k]) : 0;
+	}
+}
+
+/* Add an analytic estimate of floating point operations done in region id,
+* written to the timings file next to the hardware counts. */
+void timer_add_flops(int id, double flops) {
+	timers[id].flops += flops;
+}
+#endif
+
+
+/* Wall-clock time in seconds from an arbitrary starting point.
+* Unlike clock(), this includes time spent waiting for other nodes. */
+double wall_time() {
+	#ifdef MPI
+		return MPI_Wtime();
+	#else
+		struct timespec t;
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		return (double) t.tv_sec + 1e-9 * (double) t.tv_nsec;
+	#endif
+}
+
+/* Zero all timers. Does not touch regions that are currently active,
+* so this should be called outside all timed regions. */
+void reset_timers() {
+	for (int id=0; id<N_TIMERS; id++) {
+		timers[id].total = 0.0;
+		timers[id].nested = 0.0;
+		timers[id].calls = 0;
+		#ifdef PERF_COUNTERS
+			for (int e=0; e<N_PERF; e++) {
+				timers[id].perf[e] = timers[id].perf_nested[e] = 0;
+			}
+			timers[id].flops = 0.0;
+		#endif
+	}
+	timers_reset_time = wall_time();
+	#ifdef PERF_COUNTERS
+		read_perf(perf_reset);
+	#endif
+}
+
+void timer_start(int id) {
+	if (timer_depth >= TIMER_MAX_DEPTH) {
+		printf("!!! Node %d: too many nested timers when starting %s\n", myRank, timer_names[id]);
+		die(558);
+	}
+	timer_stack[timer_depth] = id;
+	timer_depth++;
+	timers[id].calls++;
+	#ifdef PERF_COUNTERS
+		read_perf(timers[id].perf_start);
+	#endif
+	timers[id].start = wall_time();
+}
+
+/* Stop the region id, which must be the most recently started active region. */
+void timer_stop(int id) {
+	double elapsed = wall_time() - timers[id].start;
+	#ifdef PERF_COUNTERS
+		long long counts[N_PERF];
+		read_perf(counts);
+		for (int e=0; e<N_PERF; e++) {
+			counts[e] -= timers[id].perf_start[e];
+		}
+	#endif
+	if (timer_depth <= 0 || timer_stack[timer_depth-1] != id) {
+		printf("!!! Node %d: timer_stop(%s) does not match the active timer\n", myRank, timer_names[id]);
+		die(559);
+	}
+	timer_depth--;
+	timers[id].total += elapsed;
+	if (timer_depth > 0) {
+		timers[timer_stack[timer_depth-1]].nested += elapsed;
+	}
+	#ifdef PERF_COUNTERS
+		for (int e=0; e<N_PERF; e++) {
+			timers[id].perf[e] += counts[e];
+			if (timer_depth > 0) timers[timer_stack[timer_depth-1]].perf_nested[e] += counts[e];
+		}
+	#endif
+}
+
+/* Time accumulated in region id since the last reset, on my node. */
+double timer_total(int id) {
+	return timers[id].total;
+}
+
+/* Append timings per iteration to file fname, assuming that n_iter iterations
+* have been done since the last reset, and reset the timers. Each line has
+*   iter name calls total_min total_avg total_max self_min self_avg self_max
+* where calls is per iteration averaged over nodes and the times are in seconds per iteration,
+* min/avg/max being over nodes. Regions that were not entered are left out.
+* With PERF_COUNTERS, the self counts of each hardware event and the flop estimate
+* follow in the same line, per iteration and averaged over nodes.
+* Needs to be called from all nodes in l->comm, but only the root node writes. */
+void write_timings(lattice const* l, char* fname, long iter, long n_iter) {
+
+	double now = wall_time();
+	if (n_iter < 1) n_iter = 1;
+	double norm = 1.0 / n_iter;
+
+	// slot 0 is the total elapsed time, the regions are in slots 1, ..., N_TIMERS
+	const int n = N_TIMERS + 1;
+	double tot[n], self[n], calls[n];
+	tot[0] = self[0] = (now - timers_reset_time) * norm;
+	calls[0] = 1.0;
+	for (int id=0; id<N_TIMERS; id++) {
+		tot[id+1] = timers[id].total * norm;
+		self[id+1] = (timers[id].total - timers[id].nested) * norm;
+		calls[id+1] = timers[id].calls * norm;
+	}
+
+	/* Combine over nodes with one collective each for min, max and sum. The arrays are
+	* packed as total times in [0, n) and self times in [n, 2n), followed in the sum
+	* by calls in [2n, 3n) and with PERF_COUNTERS, flops in [3n, 4n) and hardware counts from 4n on. */
+	#ifdef PERF_COUNTERS
+		const int n_sum = (4 + N_PERF) * n;
+	#else
+		const int n_sum = 3 * n;
+	#endif
+	double min[2*n], max[2*n], sum[n_sum];
+	for (int k=0; k<n; k++) {
+		min[k] = max[k] = sum[k] = tot[k];
+		min[n+k] = max[n+k] = sum[n+k] = self[k];
+		sum[2*n+k] = calls[k];
+	}
+
+	#ifdef PERF_COUNTERS
+		double* flops = &sum[3*n];
+		double (*counts)[N_PERF] = (double (*)[N_PERF]) &sum[4*n]; // counts[k][e]
+		flops[0] = 0.0;
+		for (int id=0; id<N_TIMERS; id++) {
+			flops[id+1] = timers[id].flops * norm;
+			flops[0] += flops[id+1];
+		}
+		long long now_perf[N_PERF];
+		read_perf(now_perf);
+		for (int e=0; e<N_PERF; e++) {
+			counts[0][e] = (now_perf[e] - perf_reset[e]) * norm;
+			for (int id=0; id<N_TIMERS; id++) {
+				counts[id+1][e] = (timers[id].perf[e] - timers[id].perf_nested[e]) * norm;
+			}
+		}
+	#endif
+
+	allreduce_array_min(min, 2*n, l->comm);
+	allreduce_array_max(max, 2*n, l->comm);
+	allreduce_array(sum, n_sum, l->comm);
+	for (int k=0; k<n_sum; k++) {
+		sum[k] /= l->size; // averages over nodes
+	}
+
+	if (!l->rank) {
+		FILE* f = fopen(fname, "a");
+		fprintf(f, "# iteration %ld: %ld iterations on %d nodes, seconds per iteration\n", iter, n_iter, l->size);
+		fprintf(f, "# iter name calls total_min total_avg total_max self_min self_avg self_max");
+		#ifdef PERF_COUNTERS
+			for (int e=0; e<N_PERF; e++) fprintf(f, " %s", perf_events[e].name);
+			fprintf(f, " flops");
+		#endif
+		fprintf(f, "\n");
+		for (int k=0; k<n; k++) {
+			if (k > 0 && max[k] <= 0.0) continue;
+			fprintf(f, "%ld %s %g %.6e %.6e %.6e %.6e %.6e %.6e", iter, (k > 0) ? timer_names[k-1] : "total",
+						sum[2*n+k], min[k], sum[k], max[k], min[n+k], sum[n+k], max[n+k]);
+			#ifdef PERF_COUNTERS
+				for (int e=0; e<N_PERF; e++) {
+					if (perf_slot[e] >= 0) fprintf(f, " %.6e", counts[k][e]);
+					else fprintf(f, " nan");
+				}
+				if (flops[k] > 0.0) fprintf(f, " %.6e", flops[k]);
+				else fprintf(f, " nan");
+			#endif
+			fprintf(f, "\n");
+		}
+		fclose(f);
+	}
+
+	reset_timers();
+}
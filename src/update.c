@@ -12,13 +12,14 @@
 * Does NOT undo field changes in case of reject, this needs to be done manually afterwards */
 int muca_check(lattice const* l, fields* f, params const* p, counters* c, weight* w, int parity) {
 
+	timer_start(TIMER_MUCA);
 	// local field updates do not recalculate the muca order parameter, so the old
 	//value is still in w->param_value:
 	double orderparam_old = w->param_value[EVEN] + w->param_value[ODD];
 	// recalculate with the new fields; this also updates w->param_value[par]
 	double orderparam_new = calc_orderparam(l, f, p, w, parity);
 
-	int accept = multicanonical_acceptance(l, w, orderparam_old, orderparam_new);
+	int accept = multicanonical_acceptance(l, w, orderparam_old, orderparam_new, 0.0);
 	if (!accept) {
 		// rejected, undo changes to w->param_value
 		w->param_value[parity] = orderparam_old - w->param_value[otherparity(parity)];
@@ -26,13 +27,28 @@ int muca_check(lattice const* l, fields* f, params const* p, counters* c, weight
 	c->accepted_muca += accept;
 	c->total_muca++;
 
+	timer_stop(TIMER_MUCA);
 	return accept;
 }
 
 
+#if (NHIGGS > 0) || defined(TRIPLET) || defined(SINGLET)
+/* How many sites to give to a batched overrelaxation routine, starting from site i.
+* The batch stops at the end of the sweep (max) and, if until_check > 0,
+* after until_check sites so that multicanonical checks happen at the same sites as without batching. */
+static int overrelax_batch(long i, long max, long until_check) {
+	long n = OVERRELAX_BATCH;
+	if (max - i < n) n = max - i;
+	if (until_check > 0 && until_check < n) n = until_check;
+	return (int) n;
+}
+#endif
+
 /* Sweep over the lattice in a checkerboard layout and update half of the links.
-* Gauge links are updated only in direction specified by dir. */
-void checkerboard_sweep_su2link(lattice const* l, fields* f, params const* p, counters* c, int parity, int dir) {
+* Gauge links are updated only in direction specified by dir.
+* Last argument overrelax is 1 for an overrelaxation sweep and 0 otherwise;
+* with algorithm OVERRELAX the other sweeps use heatbath for ergodicity. */
+void checkerboard_sweep_su2link(lattice const* l, fields* f, params const* p, counters* c, int parity, int dir, int overrelax) {
 	// EVEN sites come before ODD
 	long offset, max;
 	if (parity == EVEN) {
@@ -42,7 +58,13 @@ void checkerboard_sweep_su2link(lattice const* l, fields* f, params const* p, co
 	}
 
 	for (long i=offset; i<max; i++) {
-		if (p->algorithm_su2link == HEATBATH) {
+		if (overrelax) {
+			c->acc_overrelax_su2link += overrelax_su2link(l, f, p, i, dir);
+			c->total_overrelax_su2link++;
+			continue;
+		}
+
+		if (p->algorithm_su2link == HEATBATH || p->algorithm_su2link == OVERRELAX) {
 			c->accepted_su2link += heatbath_su2link(l, f, p, i, dir);
 		} else if (p->algorithm_su2link == METROPOLIS) {
 			c->accepted_su2link += metro_su2link(l, f, p, i, dir);
@@ -53,8 +75,9 @@ void checkerboard_sweep_su2link(lattice const* l, fields* f, params const* p, co
 }
 
 #ifdef U1
-/* Same as checkerboard_sweep_su2link(), but for U(1) links instead. */
-void checkerboard_sweep_u1link(lattice const* l, fields* f, params const* p, counters* c, int parity, int dir) {
+/* Same as checkerboard_sweep_su2link(), but for U(1) links instead.
+* Non-overrelaxation sweeps use Metropolis. */
+void checkerboard_sweep_u1link(lattice const* l, fields* f, params const* p, counters* c, int parity, int dir, int overrelax) {
 	// EVEN sites come before ODD
 	long offset, max;
 	if (parity == EVEN) {
@@ -64,12 +87,16 @@ void checkerboard_sweep_u1link(lattice const* l, fields* f, params const* p, cou
 	}
 
 	for (long i=offset; i<max; i++) {
-		if (p->algorithm_u1link == HEATBATH) {
-			//c->accepted_u1link += heatbath_su2link(f, p, i, dir);
-		} else if (p->algorithm_u1link == METROPOLIS) {
+		if (overrelax) {
+			c->acc_overrelax_u1link += overrelax_u1link(l, f, p, i, dir);
+			c->total_overrelax_u1link++;
+		} else if (p->algorithm_u1link == HEATBATH) {
+			c->accepted_u1link += heatbath_u1link(l, f, p, i, dir);
+			c->total_u1link++;
+		} else if (p->algorithm_u1link == METROPOLIS || p->algorithm_u1link == OVERRELAX) {
 			c->accepted_u1link += metro_u1link(l, f, p, i, dir);
+			c->total_u1link += p->metro_hits;
 		}
-		c->total_u1link++;
 	}
 }
 #endif
@@ -92,13 +119,16 @@ int checkerboard_sweep_su2doublet(lattice const* l, fields* f, params const* p,
 		offset = l->evensites; max = l->sites;
 	}
 
-	// check if multicanonical is to be used
-	int do_muca = 0;
-	if (w->do_acceptance) {
+	// check if the order parameter depends on this doublet
+	int depends = 0;
+	if (higgs_id == 0 && (w->orderparam == PHISQ || w->orderparam == PHI2MINUSSIGMA2)) depends = 1;
+	else if (higgs_id == 1 && (w->orderparam == PHI2SQ)) depends = 1;
 
-		if (higgs_id == 0 && (w->orderparam == PHISQ || w->orderparam == PHI2MINUSSIGMA2)) do_muca = 1;
-		else if (higgs_id == 1 && (w->orderparam == PHI2SQ)) do_muca = 1;
-	}
+	// check if multicanonical is to be used
+	int do_muca = (depends && w->do_acceptance);
+	// keep track of the local order parameter, no muca
+	int track = (depends && w->track_orderparam && !do_muca);
+	double local_param = 0.0;
 
 	if (do_muca) {
 		cp_field(l, f->su2doublet[higgs_id], w->fbu.su2doublet[higgs_id], SU2DB, parity);
@@ -107,28 +137,37 @@ int checkerboard_sweep_su2doublet(lattice const* l, fields* f, params const* p,
 		accept = 0; // the sweep may be rejected by multicanonical
 	}
 
-	// then the update sweep, doing a global muca acc/rej every muca_interval sites
-	for (long i=offset; i<max; i++) {
+	/* then the update sweep, doing a global muca acc/rej every muca_interval sites.
+	* Overrelaxation updates up to OVERRELAX_BATCH sites at once, see overrelax_batch() */
+	for (long i=offset; i<max; ) {
 
+		int n = 1; // how many sites were updated
 		if (p->algorithm_su2doublet == OVERRELAX && (metro == 0)) {
 
+			n = overrelax_batch(i, max, do_muca ? muca_interval - muca_count % muca_interval : 0);
 			#if (NHIGGS == 2)
-				c->acc_overrelax_doublet[higgs_id] += overrelax_higgs2(l, f, p, i, higgs_id);
+				c->acc_overrelax_doublet[higgs_id] += overrelax_higgs2(l, f, p, i, n, higgs_id);
 			#else
-				c->acc_overrelax_doublet[higgs_id] += overrelax_doublet(l, f, p, i);
+				c->acc_overrelax_doublet[higgs_id] += overrelax_doublet(l, f, p, i, n);
 			#endif
-			c->total_overrelax_doublet[higgs_id]++;
+			c->total_overrelax_doublet[higgs_id] += n;
 
 		} else if (p->algorithm_su2doublet == METROPOLIS || (metro != 0)) {
 			c->accepted_doublet[higgs_id] += metro_doublet(l, f, p, i, higgs_id);
-			c->total_doublet[higgs_id]++;
+			c->total_doublet[higgs_id] += p->metro_hits;
+		}
+		i += n;
+
+		// updated sites are final for this sweep, since sites of the same parity are independent
+		if (track) {
+			for (long j=i-n; j<i; j++) local_param += orderparam_site(f, w, j);
 		}
 
 		if (do_muca) {
-			muca_count++;
+			muca_count += n;
 			if (muca_count % muca_interval == 0) {
 				// do the global muca acc/rej step, and take new backups unless the sweep is finished
-				int make_backups = (i < max-1);
+				int make_backups = (i < max);
 				int acc = muca_check(l, f, p, c, w, parity);
 				accept += acc;
 
@@ -151,6 +190,7 @@ int checkerboard_sweep_su2doublet(lattice const* l, fields* f, params const* p,
 		if (!acc) cp_field(l, w->fbu.su2doublet[higgs_id], f->su2doublet[higgs_id], SU2DB, parity);
 		accept += acc;
 	}
+	if (track) w->local_param[parity] = local_param;
 
 	return accept; // return is nonzero if at least one muca check was accepted
 }
@@ -175,10 +215,15 @@ int checkerboard_sweep_su2triplet(lattice const* l, fields* f, params const* p,
 		offset = l->evensites; max = l->sites;
 	}
 
+	int depends = (w->orderparam == SIGMASQ || w->orderparam == PHI2MINUSSIGMA2);
+	// keep track of the local order parameter if there is no muca
+	int track = (depends && w->track_orderparam && !w->do_acceptance);
+	double local_param = 0.0;
+
 	// multicanonical preparations if the order parameter depends on the triplet
 	int do_muca = 0;
 	if (w->do_acceptance) {
-		if (w->orderparam == SIGMASQ || w->orderparam == PHI2MINUSSIGMA2) {
+		if (depends) {
 			cp_field(l, f->su2triplet, w->fbu.su2triplet, SU2TRIP, parity);
 			muca_interval = (max - offset) / w->checks_per_sweep; // takes floor if not integer
 			if (muca_interval <= 0) muca_interval = 1;
@@ -189,20 +234,27 @@ int checkerboard_sweep_su2triplet(lattice const* l, fields* f, params const* p,
 
 
 	// then the update sweep, doing a global muca acc/rej every muca_interval sites
-	for (long i=offset; i<max; i++) {
+	for (long i=offset; i<max; ) {
+		int n = 1;
 		if (p->algorithm_su2triplet == OVERRELAX && (metro == 0)) {
-			c->acc_overrelax_triplet += overrelax_triplet(l, f, p, i);
-			c->total_overrelax_triplet++;
+			n = overrelax_batch(i, max, do_muca ? muca_interval - muca_count % muca_interval : 0);
+			c->acc_overrelax_triplet += overrelax_triplet(l, f, p, i, n);
+			c->total_overrelax_triplet += n;
 		} else if (p->algorithm_su2triplet == METROPOLIS || (metro != 0)) {
 			c->accepted_triplet += metro_triplet(l, f, p, i);
-			c->total_triplet++;
+			c->total_triplet += p->metro_hits;
+		}
+		i += n;
+
+		if (track) {
+			for (long j=i-n; j<i; j++) local_param += orderparam_site(f, w, j);
 		}
 
 		if (do_muca) {
-			muca_count++;
+			muca_count += n;
 			if (muca_count % muca_interval == 0) {
 				// do the global muca acc/rej step, and take new backups unless the sweep is finished
-				int make_backups = (i < max-1);
+				int make_backups = (i < max);
 				int acc = muca_check(l, f, p, c, w, parity);
 				accept += acc;
 
@@ -224,6 +276,7 @@ int checkerboard_sweep_su2triplet(lattice const* l, fields* f, params const* p,
 		if (!acc) cp_field(l, w->fbu.su2triplet, f->su2triplet, SU2TRIP, parity);
 		accept += acc;
 	}
+	if (track) w->local_param[parity] = local_param;
 	return accept;
 
 }
@@ -244,14 +297,17 @@ int checkerboard_sweep_singlet(lattice const* l, fields* f, params const* p, cou
 		offset = l->evensites; max = l->sites;
 	}
 
-	for (long i=offset; i<max; i++) {
+	for (long i=offset; i<max; ) {
+		int n = 1;
 		if (p->algorithm_singlet == OVERRELAX && (metro == 0)) {
-			c->acc_overrelax_singlet += overrelax_singlet(l, f, p, i);
-			c->total_overrelax_singlet++;
+			n = overrelax_batch(i, max, 0);
+			c->acc_overrelax_singlet += overrelax_singlet(l, f, p, i, n);
+			c->total_overrelax_singlet += n;
 		} else if (p->algorithm_singlet == METROPOLIS || (metro != 0)) {
 			c->accepted_singlet += metro_singlet(l, f, p, i);
-			c->total_singlet++;
+			c->total_singlet += p->metro_hits;
 		}
+		i += n;
 	}
 
 	return 1;
@@ -259,6 +315,77 @@ int checkerboard_sweep_singlet(lattice const* l, fields* f, params const* p, cou
 }
 #endif
 
+#ifdef PERF_COUNTERS
+/* Analytic flop estimates for the link and scalar sweeps, for the timings file
+* (see timer_add_flops()). Counts are for the algorithm rather than for the compiled code:
+* an SU(2) product is 28 flops, a Wilson staple two products and 4 additions,
+* and sin, cos, sqrt, log and random numbers count as one flop each. Most of the cost
+* is in the staples, which are calculated once per updated site; Metropolis adds
+* a smaller cost for each proposal. Arguments are the counters before and after the sweeps. */
+static double link_flops(lattice const* l, params const* p, counters const* old, counters const* c) {
+	int d = l->dim;
+	// Wilson staple, doublet hopping terms and the update step itself
+	double per_site = 120.0*(d-1) + 44.0;
+	#if (NHIGGS > 0)
+		#ifdef U1
+			per_site += NHIGGS * 50.0;
+		#else
+			per_site += NHIGGS * 36.0;
+		#endif
+	#endif
+	double flops = per_site * (c->total_su2link - old->total_su2link
+				+ c->total_overrelax_su2link - old->total_overrelax_su2link);
+
+	#ifdef U1
+		// plaquette and hopping coefficients of u1link_staple()
+		double u1_site = 24.0*(d-1) + NHIGGS * 96.0;
+		double hits = c->total_u1link - old->total_u1link;
+		double overrelax = c->total_overrelax_u1link - old->total_overrelax_u1link;
+		if (p->algorithm_u1link == HEATBATH) {
+			flops += (u1_site + 20.0) * hits;
+		} else {
+			flops += u1_site * (hits / p->metro_hits) + 20.0 * hits;
+		}
+		flops += (u1_site + 20.0) * overrelax;
+	#endif
+	return flops;
+}
+
+static double scalar_flops(lattice const* l, params const* p, counters const* old, counters const* c) {
+	int d = l->dim;
+	double flops = 0.0;
+
+	#if (NHIGGS > 0)
+		// staple_doublet(), then the local potential and the proposal
+		#ifdef U1
+			double db_site = 2*d * 44.0;
+		#else
+			double db_site = 2*d * 32.0;
+		#endif
+		double db_hit = (NHIGGS == 2) ? 70.0 : 30.0;
+		for (int db=0; db<NHIGGS; db++) {
+			double hits = c->total_doublet[db] - old->total_doublet[db];
+			double overrelax = c->total_overrelax_doublet[db] - old->total_overrelax_doublet[db];
+			flops += db_site * (hits / p->metro_hits + overrelax) + db_hit * (hits + overrelax);
+		}
+	#endif
+
+	#ifdef TRIPLET
+		// staple_triplet() is an adjoint rotation (about 45 flops) per hopping term
+		double hits = c->total_triplet - old->total_triplet;
+		double overrelax = c->total_overrelax_triplet - old->total_overrelax_triplet;
+		flops += 2*d * 45.0 * (hits / p->metro_hits + overrelax) + 30.0 * (hits + overrelax);
+	#endif
+
+	#ifdef SINGLET
+		double s_hits = c->total_singlet - old->total_singlet;
+		double s_overrelax = c->total_overrelax_singlet - old->total_overrelax_singlet;
+		flops += (2*d + 10.0) * (s_hits / p->metro_hits + s_overrelax) + 20.0 * (s_hits + s_overrelax);
+	#endif
+
+	return flops;
+}
+#endif
 
 /* Full update on all sites + halo communication.
 * Following, hep-lat/9804019, we first update the gauge links and then scalars.
@@ -270,6 +397,11 @@ int checkerboard_sweep_singlet(lattice const* l, fields* f, params const* p, cou
 void update_lattice(lattice* l, fields* f, params const* p, counters* c, weight* w) {
 
 	int accept;
+	#ifdef PERF_COUNTERS
+		counters old = *c;
+	#endif
+	timer_start(TIMER_UPDATE);
+	timer_start(TIMER_LINKS);
 
 	/* Sweeps for gauge links. Arrays par_a (parity) and dir_a (directions)
 	* specify the order of updates. These have length 2*dim. Defaults are (with dim=3)
@@ -299,25 +431,37 @@ void update_lattice(lattice* l, fields* f, params const* p, counters* c, weight*
 			bcast_int_array(dir_a, NV, l->comm);
 		}
 
-		// now update in the specified order
-		for (int j=0; j<NV; j++) {
-			int dir = dir_a[j];
-			int par = par_a[j];
-			checkerboard_sweep_su2link(l, f, p, c, par, dir);
-			update_gaugehalo(l, par, f->su2link, SU2LINK, dir);
-		}
-
-		#ifdef U1
+		/* now update in the specified order. With overrelaxation, first do
+		* p->overrelax_links overrelaxation sweeps and then one ergodic sweep */
+		int n_or = (p->algorithm_su2link == OVERRELAX) ? p->overrelax_links : 0;
+		for (int o=0; o<=n_or; o++) {
 			for (int j=0; j<NV; j++) {
 				int dir = dir_a[j];
 				int par = par_a[j];
-				checkerboard_sweep_u1link(l, f, p, c, par, dir);
-				// here I use update_halo() instead of update_gaugehalo(), so halo is
-				// actually updated for all directions after updating just one direction.
-				update_halo(l, par, f->u1link, l->dim);
+				checkerboard_sweep_su2link(l, f, p, c, par, dir, (o < n_or));
+				update_gaugehalo(l, par, f->su2link, SU2LINK, dir);
+			}
+		}
+
+		#ifdef U1
+			n_or = (p->algorithm_u1link == OVERRELAX) ? p->overrelax_links : 0;
+			for (int o=0; o<=n_or; o++) {
+				for (int j=0; j<NV; j++) {
+					int dir = dir_a[j];
+					int par = par_a[j];
+					checkerboard_sweep_u1link(l, f, p, c, par, dir, (o < n_or));
+					// here I use update_halo() instead of update_gaugehalo(), so halo is
+					// actually updated for all directions after updating just one direction.
+					update_halo(l, par, f->u1link, l->dim);
+				}
 			}
 		#endif
 	} // gauge links done
+	timer_stop(TIMER_LINKS);
+	#ifdef PERF_COUNTERS
+		timer_add_flops(TIMER_LINKS, link_flops(l, p, &old, c));
+		old = *c;
+	#endif
 
 
 	/* Scalar updates. We update all scalar fields p->scalar_sweeps times
@@ -333,6 +477,7 @@ void update_lattice(lattice* l, fields* f, params const* p, counters* c, weight*
 	// One more thing: If using overrelaxation update, then need metropolis sweep for ergodicity. 
 	// For this I increase the number of scalar sweeps by one and force metropolis on the last sweep if needed.
 
+	timer_start(TIMER_SCALARS);
 	int nsweeps = p->scalar_sweeps + 1;
 	for (int s=0; s<nsweeps; s++) {
 
@@ -426,7 +571,12 @@ void update_lattice(lattice* l, fields* f, params const* p, counters* c, weight*
 		#endif // singlet
 
 	} // end scalar_sweeps loop
+	timer_stop(TIMER_SCALARS);
+	#ifdef PERF_COUNTERS
+		timer_add_flops(TIMER_SCALARS, scalar_flops(l, p, &old, c));
+	#endif
 
+	timer_stop(TIMER_UPDATE);
 }
 
 
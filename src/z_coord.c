@@ -73,136 +73,146 @@ void init_z_coord(lattice* l) {
 
 }
 
-/* Labels for the measure_z file. Also sets l.n_meas_z.
-*/
-void print_z_labels(lattice const* l, params* p) {
-  int k = 1;
+/* Local observables that can be measured along z. Each of these returns the value
+* of the observable at site i, and the plane average is then taken in measure_along_z().
+* To add a new observable, write a function of this type and add it to z_registry below. */
 
-  if (!l->rank) {
-  	FILE* f = fopen("labels_z", "w+");
+#if (NHIGGS > 0)
+static double zobs_phisq(lattice const* l, fields const* f, params const* p, long i) {
+  return doubletsq(f->su2doublet[0][i]);
+}
 
-    fprintf(f, "%d z\n", k); k++;
-  	#if (NHIGGS > 0)
-  		fprintf(f, "%d phi^2\n", k); k++;
-  	#endif
-  	#ifdef TRIPLET
-  		fprintf(f, "%d Sigma^2\n", k); k++;
-  	#endif
-    #ifdef SINGLET
-  		fprintf(f, "%d S\n", k); k++;
-      fprintf(f, "%d S^2\n", k); k++;
-  	#endif
+static double zobs_covphi(lattice const* l, fields const* f, params const* p, long i) {
+  return covariant_doublet(l, f, i, 0) / l->dim;
+}
+#endif
 
+#if (NHIGGS == 2)
+static double zobs_phi2sq(lattice const* l, fields const* f, params const* p, long i) {
+  return doubletsq(f->su2doublet[1][i]);
+}
+#endif
 
-  	fclose(f);
-  }
-  bcast_int(&k, l->comm);
-  p->n_meas_z = k-2; // k started from 1, not 0, and don't count the first column "z"
+#ifdef TRIPLET
+static double zobs_Sigmasq(lattice const* l, fields const* f, params const* p, long i) {
+  return tripletsq(f->su2triplet[i]);
 }
 
-/* Measure stuff along the z axis.
-* Each node works on arrays of size p.L[z] (full lattice, not slice!),
-* and fills in only the elements in their own z range. These are then
-* combined using reduce_sum(). We do p.n_meas_z different measurements
-* so there are p.n_meas_z such arrays on each node.
-* id is the identifier for the current measurement.
-* TODO optimize communications, should be faster to send the whole arrays
-* instead of reducing sums in each element separately.
-*/
-/*
-void measure_along_z_old(lattice const* l, fields const* f, params const* p, long id) {
-  long z_max = l->L[l->z_dir];
-  long z_slice = l->sliceL[l->z_dir];
-  FILE* file;
-  int k; long z;
+static double zobs_magcharge(lattice const* l, fields const* f, params const* p, long i) {
+  return magcharge_cube(l, f, p, i) / (2.0*M_PI*sqrt(p->betasu2));
+}
+#endif
 
-  if (p->n_meas_z <= 0) {
-    return; // nothing to measure
-  }
+#ifdef SINGLET
+static double zobs_S(lattice const* l, fields const* f, params const* p, long i) {
+  return f->singlet[i][0];
+}
 
-  // Arrays for storing the observables as functions of z
-  // Can be understood as a field with z_max sites and n_meas_z DOFs
-  double** meas = make_field(z_max, p->n_meas_z);
-  // initialize to 0. will remain 0 outside the range of z in my node
-  for (z=0; z<z_max; z++) {
-    for (k=0; k<p->n_meas_z; k++) {
-      meas[z][k] = 0.0;
-    }
-  }
+static double zobs_Ssq(lattice const* l, fields const* f, params const* p, long i) {
+  return f->singlet[i][0] * f->singlet[i][0];
+}
+#endif
 
-  // measure something at each z
-  for (long z=0; z<z_slice; z++) {
-    double phisq = 0.0;
-    double Sigmasq = 0.0;
+static double zobs_su2wilson(lattice const* l, fields const* f, params const* p, long i) {
+  return local_su2wilson(l, f, p, i) / p->betasu2;
+}
 
-    for (long x=0; x<l->sites_per_z; x++) {
-      long i = l->site_at_z[z][x];
+#ifdef U1
+static double zobs_u1wilson(lattice const* l, fields const* f, params const* p, long i) {
+  return local_u1wilson(l, f, p, i) / p->betau1;
+}
+#endif
 
-      #ifdef HIGGS
-        phisq += doubletsq(f->su2doublet[i]);
-      #endif
-      #ifdef TRIPLET
-        Sigmasq += tripletsq(f->su2triplet[i]);
-      #endif
-    } // end area loop
+typedef struct {
+  char* name; // name used in the config file
+  char* label; // label in labels_z
+  double (*funct)(lattice const* l, fields const* f, params const* p, long i);
+  int is_default; // measured with "z_observables default"
+} z_observable;
+
+static z_observable z_registry[] = {
+  #if (NHIGGS > 0)
+    {"phisq", "phi^2", zobs_phisq, 1},
+    {"covphi", "2*(phi^2 - phi^+(x) U_i(x) phi(x+i)) (avg over directions)", zobs_covphi, 0},
+  #endif
+  #if (NHIGGS == 2)
+    {"phi2sq", "phi2^2", zobs_phi2sq, 0},
+  #endif
+  #ifdef TRIPLET
+    {"Sigmasq", "Sigma^2", zobs_Sigmasq, 1},
+    {"magcharge", "magnetic charge (integer)", zobs_magcharge, 0},
+  #endif
+  #ifdef SINGLET
+    {"S", "S", zobs_S, 1},
+    {"Ssq", "S^2", zobs_Ssq, 1},
+  #endif
+  {"action", "action", action_local, 0},
+  {"su2wilson", "SU(2) Wilson (divided by beta)", zobs_su2wilson, 0},
+  #ifdef U1
+    {"u1wilson", "U(1) Wilson (divided by beta)", zobs_u1wilson, 0},
+  #endif
+};
 
-    // store using the physical, full z coordinate.
-    // Use same ordering here as in labels_z()
-    k = 0;
-    #ifdef HIGGS
-      meas[z + l->offset_z][k] = phisq; k++;
-    #endif
-    #ifdef TRIPLET
-      meas[z + l->offset_z][k] = Sigmasq; k++;
-    #endif
+static const int n_registry = sizeof(z_registry) / sizeof(z_registry[0]);
 
-  } // end z loop
 
-  if (!l->rank) {
-    file = fopen("measure_z", "a");
-    // write header for the current set of measurements
-    fprintf(file, "\nMeasurement %ld:\n", id);
-  }
+/* Choose which observables to measure along z, based on p->z_observables
+* which is a comma separated list of names in z_registry, or "default".
+* Also writes the labels_z file and sets p.n_meas_z.
+*/
+void print_z_labels(lattice const* l, params* p) {
 
-  // now combine results from all nodes
-  for (z=0; z<z_max; z++) {
-    for (k=0; k<p->n_meas_z; k++) {
-      meas[z][k] = reduce_sum(meas[z][k], l->comm);
-    }
-  }
+  p->n_meas_z = 0;
+  p->z_obs = malloc(n_registry * sizeof(*(p->z_obs)));
 
-  // write to file
-  for (z=0; z<z_max; z++) {
-    k = 0;
-    if (!l->rank) {
-      fprintf(file, "%ld ", z);
-      #ifdef HIGGS
-        meas[z][k] = meas[z][k] / ((double)l->area);
-        fprintf(file, "%g ", meas[z][k]);
-        k++;
-      #endif
-      #ifdef TRIPLET
-        fprintf(file, "%g ", meas[z][k] / ((double)l->area) ); k++;
-      #endif
-      fprintf(file, "\n");
-  		fflush(file);
+  if (!strcasecmp(p->z_observables, "default")) {
+    for (int j=0; j<n_registry; j++) {
+      if (z_registry[j].is_default) {
+        p->z_obs[p->n_meas_z] = j;
+        p->n_meas_z++;
+      }
+    }
+  } else {
+    char list[200];
+    strncpy(list, p->z_observables, sizeof(list)-1);
+    list[sizeof(list)-1] = '\0';
+
+    for (char* name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+      int found = 0;
+      for (int j=0; j<n_registry; j++) {
+        if (!strcasecmp(name, z_registry[j].name)) {
+          if (p->n_meas_z < n_registry) {
+            p->z_obs[p->n_meas_z] = j;
+            p->n_meas_z++;
+          }
+          found = 1;
+          break;
+        }
+      }
+      if (!found) {
+        printf0("WARNING: Unknown observable '%s' in z_observables, ignoring. Available:", name);
+        for (int j=0; j<n_registry; j++) printf0(" %s", z_registry[j].name);
+        printf0("\n");
+      }
     }
   }
 
-  // done
   if (!l->rank) {
-    fclose(file);
+  	FILE* f = fopen("labels_z", "w+");
+    int k = 1;
+    fprintf(f, "%d z\n", k); k++;
+    for (int m=0; m<p->n_meas_z; m++) {
+      fprintf(f, "%d %s\n", k, z_registry[p->z_obs[m]].label); k++;
+    }
+  	fclose(f);
   }
-
-  free_field(meas);
 }
-*/
 
 /* Measure stuff along the z axis.
-* Each node works on arrays of size p.L[z] (full lattice, not slice!),
-* and fills in only the elements in their own z range. These are then
-* combined using reduce_sum(). We do p.n_meas_z different measurements
-* so there are p.n_meas_z such arrays on each node. */
+* Each node works on an array of size p.L[z] x p.n_meas_z (full lattice, not slice!),
+* and fills in only the elements in their own z range. The whole array is then
+* combined using a single reduction, so the number of collectives does not grow with L_z.
+* Observables are chosen in print_z_labels(). */
 void measure_along_z(lattice const* l, fields const* f, params const* p, long id) {
   long z_max = l->L[l->z_dir];
   long z_slice = l->sliceL[l->z_dir];
@@ -211,7 +221,9 @@ void measure_along_z(lattice const* l, fields const* f, params const* p, long id
 
   // how many things to measure. This is set by print_z_labels()
   int n_meas_z = p->n_meas_z;
-
+  if (n_meas_z <= 0) {
+    return; // nothing to measure
+  }
 
   /* arrays for storing the observables as functions of z
   * Can be understood as a field with z_max sites and n_meas_z DOFs */
@@ -226,59 +238,31 @@ void measure_along_z(lattice const* l, fields const* f, params const* p, long id
   // measure stuff at each z
   for (long z=0; z<z_slice; z++) {
 
-    for (long x=0; x<l->sites_per_z; x++) {
+    // Store measurements using the physical, full z coordinate.
+    // Also, use same ordering here as in print_z_labels().
+    double* res = meas[z + l->offset_z];
 
-      // NB: in print_z_labels(), k=0 is the z coord, but that was not counted in n_meas_z so I start the measurements from k=0 here
-      int k = 0; 
+    for (long x=0; x<l->sites_per_z; x++) {
 
       long i = l->site_at_z[z][x];
 
-      // Store measurements using the physical, full z coordinate. 
-      // Also, use same ordering here as in print_z_labels().
-      long z_phys = z + l->offset_z;
-
-      #if (NHIGGS > 0)
-        // phi^2
-        meas[z_phys][k] += doubletsq(f->su2doublet[0][i]);
-        k++;
-      #endif
-
-      #ifdef TRIPLET
-        meas[z_phys][k] += tripletsq(f->su2triplet[i]);
-        k++;
-      #endif
-
-      #ifdef SINGLET
-        // S
-        double s = f->singlet[i][0];
-        meas[z_phys][k] += s;
-        k++;
-
-        // S^2
-        meas[z_phys][k] += s*s;
-        k++;
-        
-      #endif
+      for (int k=0; k<n_meas_z; k++) {
+        res[k] += z_registry[p->z_obs[k]].funct(l, f, p, i);
+      }
     } // end area loop
 
   } // end z loop
 
+  // now combine results from all nodes. The field is contiguous, see make_field()
+  double start = wall_time();
+  reduce_sum_array(meas[0], z_max * n_meas_z, l->comm);
+  Global_comms_time += wall_time() - start;
+
+  // write plane averaged measurements to file
   if (!l->rank) {
     file = fopen("measure_z", "a");
-    // write header for the current set of measurements
-    //fprintf(file, "\nMeasurement %ld:\n", id);
-  }
-
-  // now combine results from all nodes
-  for (z=0; z<z_max; z++) {
-    for (int k=0; k<n_meas_z; k++) {
-      meas[z][k] = reduce_sum(meas[z][k], l->comm);
-    }
-  }
 
-  // write plane averaged measurements to file
-  for (z=0; z<z_max; z++) {
-    if (!l->rank) {
+    for (z=0; z<z_max; z++) {
       fprintf(file, "%ld ", z);
 
       for (int k=0; k<n_meas_z; k++) {
@@ -287,10 +271,7 @@ void measure_along_z(lattice const* l, fields const* f, params const* p, long id
 
       fprintf(file, "\n");
     }
-  }
 
-  // done
-  if (!l->rank) {
     fclose(file);
   }
 